@@ -0,0 +1,388 @@
+#include "../include/BPlusTree.h"
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <sys/wait.h>
+#include <unistd.h>
+
+/**
+ * B+树基准测试：对若干 order 和线程数组合，分别测量顺序/随机/zipfian 插入、
+ * 随机/zipfian 点查、范围扫描、随机删除以及不同读写比例的混合负载，
+ * 输出吞吐量、p50/p99/p999 单次操作延迟和每个键占用的节点字节数。
+ *
+ * 用法：bench [-n 键数] [-t 线程数列表] [-o order列表] [-w 负载列表]
+ * 例如：bench -n 200000 -t 1,4 -o 16,64 -w insert_rand,lookup_rand
+ **/
+
+// 统计节点占用字节数的分配器，内存仍由默认的节点池分配
+class CountingAllocator
+{
+public:
+    inline static std::atomic<long> liveBytes{0};
+
+    void* allocate(std::size_t bytes, std::size_t alignment)
+    {
+        liveBytes.fetch_add(bytes, std::memory_order_relaxed);
+        return this->pool.allocate(bytes, alignment);
+    }
+
+    void deallocate(void* p, std::size_t bytes, std::size_t alignment) noexcept
+    {
+        liveBytes.fetch_sub(bytes, std::memory_order_relaxed);
+        this->pool.deallocate(p, bytes, alignment);
+    }
+
+private:
+    NodePool pool;
+};
+
+// YCSB 的 zipfian 生成器（Gray 等人的算法），热点键经过散列打散到整个键空间
+class ZipfGenerator
+{
+public:
+    ZipfGenerator(long n, double theta, uint64_t seed) : n(n), theta(theta), gen(seed), dist(0.0, 1.0)
+    {
+        double zeta2 = 0;
+        for (long i = 1; i <= 2; ++i) zeta2 += 1.0 / std::pow(i, theta);
+        this->zetan = 0;
+        for (long i = 1; i <= n; ++i) this->zetan += 1.0 / std::pow(i, theta);
+        this->alpha = 1.0 / (1.0 - theta);
+        this->eta = (1 - std::pow(2.0 / n, 1 - theta)) / (1 - zeta2 / this->zetan);
+    }
+
+    long next()
+    {
+        double u = this->dist(this->gen);
+        double uz = u * this->zetan;
+        long rank;
+        if (uz < 1.0) rank = 0;
+        else if (uz < 1.0 + std::pow(0.5, this->theta)) rank = 1;
+        else rank = static_cast<long>(this->n * std::pow(this->eta * u - this->eta + 1, this->alpha));
+        if (rank >= this->n) rank = this->n - 1;
+        return static_cast<long>(fnv64(rank) % static_cast<uint64_t>(this->n));
+    }
+
+private:
+    long n;
+    double theta, zetan, alpha, eta;
+    std::mt19937_64 gen;
+    std::uniform_real_distribution<double> dist;
+
+    static uint64_t fnv64(uint64_t v)
+    {
+        uint64_t h = 0xcbf29ce484222325ULL;
+        for (int i = 0; i < 8; ++i)
+        {
+            h ^= v & 0xff;
+            h *= 0x100000001b3ULL;
+            v >>= 8;
+        }
+        return h;
+    }
+};
+
+struct BenchConfig
+{
+    long n = 1000000; // 每个负载的键数（也是操作数）
+    std::vector<int> threads = {1, 2, 4};
+    std::vector<int> orders = {8, 16, 32, 64, 128};
+    std::vector<std::string> workloads = {
+        "insert_seq", "insert_rand", "insert_zipf", "lookup_rand", "lookup_zipf",
+        "scan_100", "mixed_95_5", "mixed_50_50", "delete_rand"};
+};
+
+struct BenchResult
+{
+    double opsPerSec;
+    double p50, p99, p999; // 纳秒
+    double bytesPerKey;
+};
+
+// 多线程执行 ops 次操作，每个线程负责 [begin, end) 一段，记录每次操作的耗时
+template<typename Op>
+BenchResult runThreads(long ops, int threads, Op op)
+{
+    std::vector<std::vector<uint32_t>> latencies(threads);
+    std::vector<std::thread> workers;
+    std::atomic<int> ready{0};
+    std::atomic<bool> go{false};
+
+    for (int t = 0; t < threads; ++t)
+    {
+        workers.emplace_back([&, t]()
+        {
+            long begin = ops * t / threads;
+            long end = ops * (t + 1) / threads;
+            std::vector<uint32_t>& lat = latencies[t];
+            lat.reserve(end - begin);
+            ready++;
+            while (!go) std::this_thread::yield();
+            for (long i = begin; i < end; ++i)
+            {
+                auto s = std::chrono::steady_clock::now();
+                op(t, i);
+                auto e = std::chrono::steady_clock::now();
+                lat.push_back(static_cast<uint32_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(e - s).count()));
+            }
+        });
+    }
+
+    while (ready < threads) std::this_thread::yield();
+    auto start = std::chrono::steady_clock::now();
+    go = true;
+    for (auto& w : workers) w.join();
+    auto stop = std::chrono::steady_clock::now();
+
+    std::vector<uint32_t> all;
+    all.reserve(ops);
+    for (auto& lat : latencies) all.insert(all.end(), lat.begin(), lat.end());
+
+    auto percentile = [&all](double p) -> double
+    {
+        if (all.empty()) return 0;
+        size_t k = std::min(all.size() - 1, static_cast<size_t>(p * all.size()));
+        std::nth_element(all.begin(), all.begin() + k, all.end());
+        return all[k];
+    };
+
+    BenchResult result{};
+    double seconds = std::chrono::duration<double>(stop - start).count();
+    result.opsPerSec = ops / seconds;
+    result.p50 = percentile(0.50);
+    result.p99 = percentile(0.99);
+    result.p999 = percentile(0.999);
+    return result;
+}
+
+// 对一个 order 运行一个负载，树在负载开始前按需要预先装载
+template<int ORDER>
+BenchResult runWorkload(const std::string& name, const BenchConfig& cfg, int threads)
+{
+    using Tree = BPlusTree<ORDER, long, long, std::less<long>, CountingAllocator>;
+    const long n = cfg.n;
+    long baseBytes = CountingAllocator::liveBytes;
+    auto tree = std::make_unique<Tree>();
+
+    std::vector<long> shuffled(n);
+    std::iota(shuffled.begin(), shuffled.end(), 0);
+    std::shuffle(shuffled.begin(), shuffled.end(), std::mt19937_64{7});
+
+    // 预装载 0 ~ n-1 的偶数键，混合负载的写操作作用在奇数键上
+    auto preload = [&](bool evenOnly)
+    {
+        std::vector<std::pair<long, long>> sorted;
+        for (long k = 0; k < n; k += evenOnly ? 2 : 1) sorted.emplace_back(k, k);
+        tree->bulkLoad(sorted.begin(), sorted.end());
+    };
+
+    std::vector<ZipfGenerator> zipf;
+    if (name.find("zipf") != std::string::npos)
+    {
+        for (int t = 0; t < threads; ++t) zipf.emplace_back(n, 0.99, 1000 + t);
+    }
+    std::vector<std::mt19937_64> rng;
+    for (int t = 0; t < threads; ++t) rng.emplace_back(2000 + t);
+    // 每个线程各自累加读到的值，防止读操作被优化掉，按缓存行对齐避免伪共享
+    struct alignas(64) Sink { long value = 0; };
+    std::vector<Sink> sinks(threads);
+
+    BenchResult result{};
+    if (name == "insert_seq")
+    {
+        // 每个线程按升序插入自己的一段连续键
+        result = runThreads(n, threads, [&](int, long i) { tree->insert(i, i); });
+    }
+    else if (name == "insert_rand")
+    {
+        result = runThreads(n, threads, [&](int, long i) { tree->insert(shuffled[i], i); });
+    }
+    else if (name == "insert_zipf")
+    {
+        result = runThreads(n, threads, [&](int t, long i) { tree->insert(zipf[t].next(), i); });
+    }
+    else if (name == "lookup_rand")
+    {
+        preload(false);
+        result = runThreads(n, threads, [&](int t, long i)
+        {
+            auto v = tree->get(shuffled[i]);
+            sinks[t].value += v ? *v : 0;
+        });
+    }
+    else if (name == "lookup_zipf")
+    {
+        preload(false);
+        result = runThreads(n, threads, [&](int t, long)
+        {
+            auto v = tree->get(zipf[t].next());
+            sinks[t].value += v ? *v : 0;
+        });
+    }
+    else if (name == "scan_100")
+    {
+        // 只读扫描，迭代器不能与写操作并发
+        preload(false);
+        result = runThreads(n / 100, threads, [&](int t, long i)
+        {
+            long sum = 0;
+            int count = 0;
+            for (auto it = tree->lower_bound(shuffled[i]); it != tree->end() && count < 100; ++it, ++count)
+            {
+                sum += it.value();
+            }
+            sinks[t].value += sum;
+        });
+    }
+    else if (name == "mixed_95_5" || name == "mixed_50_50")
+    {
+        int writePercent = name == "mixed_95_5" ? 5 : 50;
+        preload(true);
+        result = runThreads(n, threads, [&](int t, long i)
+        {
+            uint64_t r = rng[t]();
+            long key = static_cast<long>((r >> 8) % n);
+            if (static_cast<int>(r % 100) >= writePercent)
+            {
+                auto v = tree->get(key);
+                sinks[t].value += v ? *v : 0;
+            }
+            else if (key % 2 == 1 && (r & 0x80))
+            {
+                tree->remove(key);
+            }
+            else
+            {
+                tree->insert(key | 1, i);
+            }
+        });
+    }
+    else if (name == "delete_rand")
+    {
+        preload(false);
+        result = runThreads(n, threads, [&](int, long i) { tree->remove(shuffled[i]); });
+    }
+    else
+    {
+        std::cerr << "unknown workload: " << name << std::endl;
+        std::exit(1);
+    }
+
+    long keys = tree->size;
+    result.bytesPerKey = keys > 0 ? static_cast<double>(CountingAllocator::liveBytes - baseBytes) / keys : 0;
+    return result;
+}
+
+// 每个负载在单独的子进程中运行，互不影响堆状态，树占用的内存随子进程退出一并回收
+template<int ORDER>
+BenchResult runIsolated(const std::string& name, const BenchConfig& cfg, int threads)
+{
+    int fds[2];
+    if (pipe(fds) != 0)
+    {
+        std::perror("pipe");
+        std::exit(1);
+    }
+
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        close(fds[0]);
+        BenchResult r = runWorkload<ORDER>(name, cfg, threads);
+        ssize_t written = write(fds[1], &r, sizeof(r));
+        _exit(written == sizeof(r) ? 0 : 1);
+    }
+
+    close(fds[1]);
+    BenchResult r{};
+    ssize_t got = read(fds[0], &r, sizeof(r));
+    close(fds[0]);
+    int status = 0;
+    waitpid(pid, &status, 0);
+    if (got != sizeof(r) || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+    {
+        std::cerr << "workload " << name << " failed" << std::endl;
+        std::exit(1);
+    }
+    return r;
+}
+
+template<int ORDER>
+void runOrder(const BenchConfig& cfg)
+{
+    for (int threads : cfg.threads)
+    {
+        for (const std::string& name : cfg.workloads)
+        {
+            BenchResult r = runIsolated<ORDER>(name, cfg, threads);
+            std::cout << std::left << std::setw(7) << ORDER << std::setw(9) << threads << std::setw(14) << name
+                      << std::right << std::fixed << std::setprecision(0)
+                      << std::setw(14) << r.opsPerSec << std::setw(10) << r.p50 << std::setw(10) << r.p99
+                      << std::setw(10) << r.p999 << std::setprecision(1) << std::setw(12) << r.bytesPerKey << std::endl;
+        }
+    }
+}
+
+// 解析逗号分隔的列表
+template<typename T>
+std::vector<T> parseList(const std::string& text)
+{
+    std::vector<T> items;
+    std::stringstream ss(text);
+    std::string item;
+    while (std::getline(ss, item, ','))
+    {
+        std::stringstream is(item);
+        T value;
+        is >> value;
+        items.push_back(value);
+    }
+    return items;
+}
+
+int main(int argc, char** argv)
+{
+    BenchConfig cfg;
+    for (int i = 1; i + 1 < argc; i += 2)
+    {
+        std::string flag = argv[i];
+        if (flag == "-n") cfg.n = std::atol(argv[i + 1]);
+        else if (flag == "-t") cfg.threads = parseList<int>(argv[i + 1]);
+        else if (flag == "-o") cfg.orders = parseList<int>(argv[i + 1]);
+        else if (flag == "-w") cfg.workloads = parseList<std::string>(argv[i + 1]);
+        else
+        {
+            std::cerr << "usage: " << argv[0] << " [-n keys] [-t threads,...] [-o orders,...] [-w workloads,...]" << std::endl;
+            return 1;
+        }
+    }
+
+    std::cout << std::left << std::setw(7) << "order" << std::setw(9) << "threads" << std::setw(14) << "workload"
+              << std::right << std::setw(14) << "ops/s" << std::setw(10) << "p50(ns)" << std::setw(10) << "p99(ns)"
+              << std::setw(10) << "p999(ns)" << std::setw(12) << "bytes/key" << std::endl;
+
+    // order 是模板参数，只能在编译期确定的几个取值中选择
+    for (int order : cfg.orders)
+    {
+        switch (order)
+        {
+            case 8: runOrder<8>(cfg); break;
+            case 16: runOrder<16>(cfg); break;
+            case 32: runOrder<32>(cfg); break;
+            case 64: runOrder<64>(cfg); break;
+            case 128: runOrder<128>(cfg); break;
+            default:
+                std::cerr << "unsupported order " << order << ", choose from 8,16,32,64,128" << std::endl;
+                return 1;
+        }
+    }
+    return 0;
+}
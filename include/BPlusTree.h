@@ -3,143 +3,173 @@
 
 #include <cassert>
 #include <functional>
-#include <stack>
 #include <queue>
 #include <iostream>
 #include <utility>
-#include <shared_mutex>
 #include <mutex>
+#include <atomic>
+#include <cstdint>
+#include <type_traits>
 #include <map>
+#include <unordered_map>
 #include <string>
 #include <thread>
 #include <fstream>
 #include <vector>
+#include <optional>
+#include <iterator>
+#include <algorithm>
+#include <numeric>
+#include <cmath>
+#include <limits>
+#include "KeySearch.h"
+#include "KeyCompression.h"
+#include "LeafStorage.h"
+#include "Codec.h"
+#include "StreamFormat.h"
+#include "TreeStats.h"
+#include "EpochReclaim.h"
+#include "ThreadPool.h"
+#include "NodePool.h"
+#include "PageFormat.h"
+#include "CheckpointFile.h"
 
-template<int order, typename Key, typename Value, typename Compare = std::less<Key>>
-
-class BPlusTree
+/**
+ * 乐观版本锁（optimistic lock coupling）
+ * 最低位为obsolete位（节点已从树中摘除），次低位为locked位，其余高位为版本号。
+ * 读者不写共享内存，只记录版本号，读完后校验版本号未变；写者加锁、解锁都会使版本号前进，令并发读者重试
+ **/
+class OptLock
 {
-private:
-    struct Node
+public:
+    // 读者：等待写者释放后读取当前版本，节点已被摘除时返回false
+    inline bool readLockOrRestart(uint64_t& version) const noexcept
     {
-        int n; // 节点的关键字个数
-        bool IS_LEAF; // 是否是叶子节点
-        Key keys[order]; // 节点键值的数组，具有唯一性和可排序性
-        Value* values; // 叶子节点保存的值的数组
-        std::shared_mutex mtx; // 读写锁
-
-        /** 对于叶子节点而言，其为双向链表中结点指向前后节点的指针，ptr[0]表示前一个节点，ptr[1]表示后一个节点; 
-        * 对于非叶子节点而言，其指向孩子节点，keys[i]的左子树是ptr[i]，右子树是ptr[i+1] 
-        **/
-        Node** ptr;
-
-        Node(bool isLeaf)
-        {
-            this->n = 0;
-            this->IS_LEAF = isLeaf;
- 
-            // 叶子节点
-            if(this->IS_LEAF)
-            {
-                this->values = new Value[order];
-                this->ptr = new Node*[2]; // 只需两个指针维护前后叶子（形成双链表）
-				for(int i = 0; i < 2; i++)
-                {
-					this->ptr[i] = nullptr;
-				}
-            }
-            else
-            {
-                // 非叶子节点
-                this->values = nullptr;
-                this->ptr = new Node*[order + 1]; // order + 1个子指针
-				for(int i = 0; i < order + 1; i++)
-                {
-					this->ptr[i] = nullptr;
-				}
-            }
+        version = this->word.load(std::memory_order_acquire);
+        while(version & LOCKED)
+        {
+            std::this_thread::yield();
+            version = this->word.load(std::memory_order_acquire);
         }
+        return !(version & OBSOLETE);
+    }
 
-        // 析构函数释放资源，只释放values和ptr，不递归删除子树（由外部统一管理）
-        ~Node()
+    // 读者：校验从读取版本到现在节点没有被修改
+    inline bool validate(uint64_t version) const noexcept
+    {
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return this->word.load(std::memory_order_relaxed) == version;
+    }
+
+    // 写者：把读到的版本原子地升级为写锁，版本已变化则失败
+    inline bool upgradeToWriteLockOrRestart(uint64_t version) noexcept
+    {
+        return this->word.compare_exchange_strong(version, version + LOCKED);
+    }
+
+    // 写者：自旋直到拿到写锁，再等待已登记的共享读者离开；等待期间新的共享读者不能进入
+    inline void writeLock() noexcept
+    {
+        uint64_t version = this->word.load(std::memory_order_relaxed);
+        while((version & LOCKED) || !this->word.compare_exchange_weak(version, version + LOCKED))
         {
-            if(this->isLeaf())
+            if(version & LOCKED)
             {
-                delete[] this->values;
+                std::this_thread::yield();
+                version = this->word.load(std::memory_order_relaxed);
             }
-            delete[] this->ptr;
         }
+        while(this->word.load(std::memory_order_acquire) >= SHARED)
+        {
+            std::this_thread::yield();
+        }
+    }
+
+    inline void writeUnlock() noexcept
+    {
+        this->word.fetch_add(LOCKED, std::memory_order_release);
+    }
 
-        // 二分查找，返回第一个大于等于该节点key的下标，
-        inline int search(Key key,const Compare& compare) const noexcept
+    // 共享读者：等待写者释放后登记，多个共享读者可以同时持有；
+    // 登记会改变版本字，期间乐观读者的校验和写锁升级都会失败并重试
+    inline void readLockShared() noexcept
+    {
+        uint64_t version = this->word.load(std::memory_order_relaxed);
+        while((version & LOCKED) || !this->word.compare_exchange_weak(version, version + SHARED, std::memory_order_acquire))
         {
-            // 避免因为极端情况导致的查询效果低下
-            if(!this->n || !compare(this->keys[0],key))
+            if(version & LOCKED)
             {
-                return 0;
+                std::this_thread::yield();
+                version = this->word.load(std::memory_order_relaxed);
             }
+        }
+    }
 
-            if(this->n && compare(this->keys[this->n-1],key))
-            {
-                return this->n;
-            } 
+    inline void readUnlockShared() noexcept
+    {
+        this->word.fetch_sub(SHARED, std::memory_order_release);
+    }
 
-            int i = 1, j = this->n - 1;
-            while(i <= j)
-            {
-                int mid = i + ((j - i) >> 1);
-                if(this->keys[mid] == key)
-                {
-                    return mid;
-                }
+    // 持有写锁时标记节点已被摘除，之后的读者和写者都会重试
+    inline void markObsolete() noexcept
+    {
+        this->word.fetch_or(OBSOLETE, std::memory_order_relaxed);
+    }
 
-                if(compare(this->keys[mid],key)) 
-                {
-                    i = mid + 1;
-                }
-                else
-                {
-                    j = mid - 1;
-                }
-            }
+private:
+    static constexpr uint64_t OBSOLETE = 0b01;
+    static constexpr uint64_t LOCKED = 0b10;
+    static constexpr uint64_t SHARED = uint64_t(1) << 48; // 高16位为共享读者计数，版本号占第2至47位
+
+    std::atomic<uint64_t> word{0b100};
+};
+
+template<int order, typename Key, typename Value, typename Compare = std::less<Key>, typename Allocator = NodePool>
+
+class BPlusTree
+{
+private:
+    struct LeafNode;
+    struct InnerNode;
 
-            return i;
+    // 叶子节点和非叶子节点的公共头部，版本锁和关键字个数位于节点起始的缓存行，键数组紧随其后
+    struct Node
+    {
+        OptLock latch; // 乐观版本锁
+        int n; // 节点的关键字个数
+        bool IS_LEAF; // 是否是叶子节点
+        bool dirty; // 上一次增量检查点之后是否被修改过
+        uint64_t pageId; // 在检查点文件中的页号，从未写入时为0
+
+        explicit Node(bool isLeaf) : n(0), IS_LEAF(isLeaf), dirty(true), pageId(0) {}
+
+        inline LeafNode* leaf() noexcept
+        {
+            assert(this->isLeaf());
+            return static_cast<LeafNode*>(this);
         }
 
-        // 判断节点是否含有key
-        inline bool hasKey(Key key,const Compare& compare) const noexcept
+        inline InnerNode* inner() noexcept
         {
-            int arg = this->search(key, compare);
-            return this->keys[arg] == key;
-        }
-
-        // inline Value search_recursive(Node* node, Key key) const 
-        // {
-        //     if (!node) return -1;
-
-        //     if (node->isLeaf())
-        //     {
-        //         // 在叶子节点中线性查找（也可以用二分）
-        //         for (int i = 0; i < node->n; ++i)
-        //         {
-        //             if (node->keys[i] == key)
-        //             {
-        //                 return node->values[i];
-        //             }
-        //         }
-        //         return -1;
-        //     }
-    
+            assert(!this->isLeaf());
+            return static_cast<InnerNode*>(this);
+        }
 
-        // // 非叶子节点：找到子树范围
-        // int i = 0;
-        // while (i < node->n && key > node->keys[i]) {
-        //     ++i;
-        // }
-        // // 递归进入第 i 棵子树
-        // return search_recursive(node->ptr[i], key);
-        // }
+        // 两种节点的键数组，叶子须为数组布局（页格式要求键和值都能按位拷贝）
+        inline Key* keyArray() noexcept
+        {
+            return this->isLeaf() ? this->leaf()->keys : this->inner()->keys;
+        }
 
+        // 非叶子节点中确定key所在的孩子下标：与分隔键相等的key位于右子树
+        inline int childIndex(const Key& key,const Compare& compare) const noexcept
+        {
+            assert(!this->isLeaf());
+            const InnerNode* node = static_cast<const InnerNode*>(this);
+            int arg = node->search(key,compare);
+            if(arg < node->n && node->keys[arg] == key) arg++;
+            return arg;
+        }
 
         // 是否上溢出：节点 key 树 >= order -> 需要分裂
         inline bool isUpOver() const noexcept
@@ -158,123 +188,180 @@ private:
         {
             return this->IS_LEAF;
         }
-        
-        // 在叶子节点插入一个键值对
-        inline void insert(Key key,Value value,const Compare& compare)
+
+        // 删除key（非叶子节点同时删除其右子树）
+        inline void remove(Key key,const Compare& compare)
         {
-            assert(this->isLeaf());
-            int arg = this->search(key,compare);
+            if(this->isLeaf()) this->leaf()->remove(key,compare);
+            else this->inner()->remove(key,compare);
+        }
+    };
 
-            // 后移数据腾出空间
-            for(int i = this->n; i > arg; i--)
-            {
-                this->keys[i] = this->keys[i - 1];
-                this->values[i] = this->values[i - 1];
-            }
-            this->keys[arg] = key;
-            this->values[arg] = value;
-            this->n++; 
+    /**
+     * 叶子节点：键值存储和前后叶子指针一次分配、按缓存行对齐，键值的存放方式见LeafStorage.h。
+     * ptr为双向链表中指向前后节点的指针，ptr[0]表示前一个节点，ptr[1]表示后一个节点
+     **/
+    struct alignas(64) LeafNode : Node, leafstore::Storage<order, Key, Value, Compare>
+    {
+        LeafNode* ptr[2];
+        uint64_t cowEpoch; // 上一次为快照保存修改前内容时的快照纪元，持有写锁时读写
+        int appendRun; // 最近连续追加到末尾的键数，其他位置的插入和删除清零，持有写锁时读写
+
+        LeafNode() : Node(true), ptr{nullptr, nullptr}, cowEpoch(0), appendRun(0) {}
+
+        // 返回第一个大于等于key的下标
+        inline int search(const Key& key,const Compare& compare) const
+        {
+            return this->lowerBound(this->n, key, compare);
         }
 
-        // 在非叶子节点插入key和右子树
-        inline void insert(Key key, Node* rightChild,const Compare& compare)
+        // 判断节点是否含有key
+        inline bool hasKey(const Key& key,const Compare& compare) const
         {
-            assert(!this->isLeaf());
+            int arg = this->search(key, compare);
+            return arg < this->n && this->keyEquals(arg, key);
+        }
+
+        // 在叶子节点插入一个键值对
+        inline void insert(Key key,Value value,const Compare& compare)
+        {
+            this->dirty = true;
             int arg = this->search(key,compare);
+            this->appendRun = arg == this->n ? this->appendRun + 1 : 0;
+            this->admit(key, this->n);
+
+            // 后移数据腾出空间
             for(int i = this->n; i > arg; i--)
             {
-                this->keys[i] = this->keys[i-1];
-				this->ptr[i+1] = this->ptr[i];
+                this->move(i, i - 1);
             }
-            this->keys[arg] = key;
-            this->ptr[arg+1] = rightChild;
+            this->put(arg, std::move(key), std::move(value));
             this->n++; 
         }
 
         // 更新节点
         inline void update(Key key,Value value,const Compare& compare)
         {
-            assert(this->isLeaf());
+            this->dirty = true;
             int arg = this->search(key,compare);
-            this->values[arg] = value;
+            this->setValue(arg, std::move(value));
+            this->tidy(this->n);
         }
 
-        // 删除节点及其右子树
+        // 删除键值对
         inline void remove(Key key,const Compare& compare)
         {
+            this->dirty = true;
+            this->appendRun = 0;
             int arg = this->search(key,compare);
+            this->release(arg);
             for(int i=arg;i<this->n-1;i++){
-                this->keys[i] = this->keys[i+1];
-                if(!this->isLeaf()) this->ptr[i+1] = this->ptr[i+2];
-                else this->values[i] = this->values[i+1];
+                this->move(i, i + 1);
             }
-            if(!this->isLeaf()) this->ptr[this->n] = nullptr;
             this->n--;
+            this->tidy(this->n);
         }
 
-        // 上溢出(n >= order)的时候调用，分裂成左右子树，自身变成左子树，返回右子树
-        inline Node* split()
+        // 一次后移把count个有序、互不相同且节点中都不存在的键值对并入叶子，调用方保证n + count < order
+        inline void insertSorted(std::pair<Key,Value>* const* items,int count,const Compare& compare)
         {
-            Node* newNode = new Node(this->isLeaf());
-            int mid = (order>>1);
-            if(this->isLeaf())
+            this->dirty = true;
+            if(count > 0)
+            {
+                bool append = this->n == 0 || this->keyBefore(this->n - 1, items[0]->first, compare);
+                this->appendRun = append ? this->appendRun + count : 0;
+                // 有序的键中首尾两个的公共前缀也是中间各键的前缀
+                this->admit(items[0]->first, this->n);
+                this->admit(items[count - 1]->first, this->n);
+            }
+            int i = this->n - 1;
+            for(int j = count - 1, w = this->n + count - 1; j >= 0; w--)
             {
-                for(int i=0,j=mid;j<this->n;i++,j++)
+                if(i >= 0 && this->keyAfter(i, items[j]->first, compare))
+                {
+                    this->move(w, i);
+                    i--;
+                }
+                else
                 {
-                    newNode->keys[i] = this->keys[j];
-                    newNode->values[i] = this->values[j];
-                    newNode->n++;
+                    this->put(w, items[j]->first, std::move(items[j]->second));
+                    j--;
                 }
-                this->insertNextNode(newNode);
             }
-            else
+            this->n += count;
+        }
+
+        // 一次前移删除count个有序、互不相同且都在节点中的键
+        inline void removeSorted(const Key* const* keys,int count)
+        {
+            this->dirty = true;
+            this->appendRun = 0;
+            int w = 0;
+            for(int r = 0, j = 0; r < this->n; r++)
             {
-                newNode->ptr[0] = this->ptr[mid+1];
-                this->ptr[mid+1] = nullptr;
-                for(int i=0,j=mid+1; j<this->n;i++,j++)
+                if(j < count && this->keyEquals(r, *keys[j]))
+                {
+                    this->release(r);
+                    j++;
+                    continue;
+                }
+                if(w != r)
                 {
-                    newNode->keys[i] = this->keys[j];
-                    newNode->ptr[i+1] = this->ptr[j+1];
-                    newNode->n++;
-                    this->ptr[j+1] = nullptr;
+                    this->move(w, r);
                 }
+                w++;
             }
-			this->n = mid;
-            return newNode;
+            this->n = w;
+            this->tidy(this->n);
         }
 
-        // 非叶子节点下溢出(n < (order>>1))且兄弟无法借出节点时调用，和右兄弟合并
-        inline void merge(Key key,Node *rightSibling) 
+        // 上溢出(n >= order)的时候调用，把[mid, n)移入空叶子newNode，自身变成左叶子；末尾的追加计数随后半部分移入newNode
+        inline void split(LeafNode* newNode,int mid)
         {
-            assert(!this->isLeaf());
-            this->keys[this->n] = key;
-            this->ptr[this->n+1] = rightSibling->ptr[0];
-            this->n++;
-            for(int i=0;i<rightSibling->n;i++){
-                this->keys[this->n] = rightSibling->keys[i];
-                this->ptr[this->n+1] = rightSibling->ptr[i+1];
-                this->n++;
+            this->dirty = true;
+            newNode->admitFrom(*this, newNode->n);
+            for(int i=0,j=mid;j<this->n;i++,j++)
+            {
+                newNode->copy(i, *this, j);
+                newNode->n++;
+                this->release(j);
             }
-            delete rightSibling;
+            newNode->appendRun = this->appendRun;
+            this->appendRun = 0;
+            this->insertNextNode(newNode);
+			this->n = mid;
+            this->compact(this->n);
         }
 
-        // 叶子节点下溢出(n < (order>>1))且兄弟无法借出节点时调用，和右兄弟合并
-        inline void merge(Node *rightSibling)
+        // 下溢出(n < (order>>1))且兄弟无法借出节点时调用，和右兄弟合并，右兄弟由调用方回收
+        inline void merge(LeafNode *rightSibling)
         {
-            assert(this->isLeaf());
+            this->dirty = true;
+            this->admitFrom(*rightSibling, this->n);
             for(int i=0;i<rightSibling->n;i++){
-                this->keys[this->n] = rightSibling->keys[i];
-                this->values[this->n] = rightSibling->values[i];
+                this->copy(this->n, *rightSibling, i);
                 this->n++;
             }
             this->removeNextNode();
-            delete rightSibling;
+            this->compact(this->n);
+        }
+
+        // 按键序把键值拷贝到keys和values
+        inline void copyTo(std::vector<Key>& keys,std::vector<Value>& values) const
+        {
+            keys.clear();
+            values.clear();
+            for(int i = 0; i < this->n; i++)
+            {
+                keys.push_back(this->key(i));
+                values.push_back(this->value(i));
+            }
         }
 
         // 双向链表中插入下一个叶子节点
-        inline void insertNextNode(Node *nextNode)
+        inline void insertNextNode(LeafNode *nextNode)
         {
-            assert(this->isLeaf() && nextNode);
+            assert(nextNode);
             nextNode->ptr[1] = this->ptr[1];
             if(this->ptr[1]) this->ptr[1]->ptr[0] = nextNode;
             this->ptr[1] = nextNode;
@@ -284,25 +371,326 @@ private:
         // 双向链表中删除下一个叶子节点
         inline void removeNextNode()
         {
-            assert(this->isLeaf());
             if(this->ptr[1]->ptr[1]) this->ptr[1]->ptr[1]->ptr[0] = this;
             if(this->ptr[1]) this->ptr[1] = this->ptr[1]->ptr[1];
         }
     };
 
+    /**
+     * 非叶子节点：键和孩子指针一次分配、按缓存行对齐。
+     * keys[i]的左子树是ptr[i]，右子树是ptr[i+1]
+     **/
+    struct alignas(64) InnerNode : Node
+    {
+        Key keys[order]; // 分隔键的数组，具有唯一性和可排序性
+        Node* ptr[order + 1];
+
+        InnerNode() : Node(false)
+        {
+            for(int i = 0; i < order + 1; i++)
+            {
+                this->ptr[i] = nullptr;
+            }
+        }
+
+        // 返回第一个大于等于key的下标：算术键用向量化比较，其余键二分查找
+        inline int search(const Key& key,const Compare& compare) const noexcept
+        {
+            return keysearch::lowerBound(this->keys, this->n, key, compare);
+        }
+
+        // 插入key和右子树
+        inline void insert(Key key, Node* rightChild,const Compare& compare)
+        {
+            this->dirty = true;
+            int arg = this->search(key,compare);
+            for(int i = this->n; i > arg; i--)
+            {
+                this->keys[i] = this->keys[i-1];
+				this->ptr[i+1] = this->ptr[i];
+            }
+            this->keys[arg] = key;
+            this->ptr[arg+1] = rightChild;
+            this->n++; 
+        }
+
+        // 删除key及其右子树
+        inline void remove(Key key,const Compare& compare)
+        {
+            this->dirty = true;
+            int arg = this->search(key,compare);
+            for(int i=arg;i<this->n-1;i++){
+                this->keys[i] = this->keys[i+1];
+                this->ptr[i+1] = this->ptr[i+2];
+            }
+            this->ptr[this->n] = nullptr;
+            this->n--;
+        }
+
+        // 上溢出(n >= order)的时候调用，keys[mid]上移给父亲，自身保留左边mid个键，其余移入空节点newNode
+        inline void split(InnerNode* newNode,int mid)
+        {
+            this->dirty = true;
+            newNode->ptr[0] = this->ptr[mid+1];
+            this->ptr[mid+1] = nullptr;
+            for(int i=0,j=mid+1; j<this->n;i++,j++)
+            {
+                newNode->keys[i] = this->keys[j];
+                newNode->ptr[i+1] = this->ptr[j+1];
+                newNode->n++;
+                this->ptr[j+1] = nullptr;
+            }
+			this->n = mid;
+        }
+
+        // 下溢出(n < (order>>1))且兄弟无法借出节点时调用，和右兄弟合并，右兄弟由调用方回收
+        inline void merge(Key key,InnerNode *rightSibling) 
+        {
+            this->dirty = true;
+            this->keys[this->n] = key;
+            this->ptr[this->n+1] = rightSibling->ptr[0];
+            this->n++;
+            for(int i=0;i<rightSibling->n;i++){
+                this->keys[this->n] = rightSibling->keys[i];
+                this->ptr[this->n+1] = rightSibling->ptr[i+1];
+                this->n++;
+            }
+        }
+    };
+
 public:
-    Compare compare;
-    int size;
-    Node *root; // B+树的根结点
-    Node *head; // 叶子节点的头结点
+    // 每个非叶子节点至少有两个孩子，64层足以容纳任意规模的树
+    static constexpr int MAX_HEIGHT = 64;
+
+    // 两种节点实际占用的字节数（含头部和对齐填充，不含槽页叶子的堆），NodeOrder.h中的策略据此推导阶数
+    static constexpr std::size_t LEAF_BYTES = sizeof(LeafNode);
+    static constexpr std::size_t INNER_BYTES = sizeof(InnerNode);
+
+    // 有不能按位拷贝的键或值时叶子按槽页存放（见LeafStorage.h），键值按需从叶子堆中解码，
+    // 迭代器和find返回拷贝而不是指向节点内部的引用
+    static constexpr bool SLOTTED_LEAVES = leafstore::Slotted<Key,Value>::value;
+    using KeyRef = typename leafstore::Storage<order,Key,Value,Compare>::KeyRef;
+    using ValueRef = typename leafstore::Storage<order,Key,Value,Compare>::ValueRef;
+    using FindResult = std::conditional_t<SLOTTED_LEAVES, std::optional<Value>, const Value*>;
+
+    // 键和值都能按位拷贝时，读者不加锁读取节点、读完校验版本；
+    // 否则读到写了一半的std::string等对象是未定义行为，读者逐层加共享锁、写者逐层加写锁下降
+    static constexpr bool OPTIMISTIC_READ = std::is_trivially_copyable<Key>::value && std::is_trivially_copyable<Value>::value;
+
+    // 根到叶子的路径：nodes[0]为根结点，nodes[depth-1]为叶子，nodes[i+1]为nodes[i]->ptr[slots[i]]
+    struct NodePath
+    {
+        Node* nodes[MAX_HEIGHT];
+        int slots[MAX_HEIGHT];
+        int depth;
+    };
 
-    std::stack<Node*> findNodeByKey(Key key);
-    void adjustNodeForUpOver(Node *node,Node* parent);
-    void adjustNodeForDownOver(Node *node,Node* parent);
-    void maintainAfterInsert(std::stack<Node*>& nodePathStack);
-    void maintainAfterRemove(std::stack<Node*>& nodePathStack);
+    // 批量操作在相邻的有序键之间复用的根到叶子路径：nodes[depth-1]为当前叶子，
+    // uppers[i]为nodes[i]键范围的上界（bounded[i]为false时无上界），键小于上界的后续键无需从根结点重新下降
+    struct BatchCursor
+    {
+        Node* nodes[MAX_HEIGHT];
+        uint64_t versions[MAX_HEIGHT];
+        Key uppers[MAX_HEIGHT];
+        bool bounded[MAX_HEIGHT];
+        int depth = 0;
+
+        // 第level层节点的键范围是否覆盖key（下界由批内键有序保证）
+        bool covers(int level,const Key& key,const Compare& compare) const
+        {
+            return !this->bounded[level] || compare(key, this->uppers[level]);
+        }
+    };
+
+    // 结构修改期间持有的写锁集合，修改完成后统一释放
+    struct LatchSet
+    {
+        Node* nodes[3 * MAX_HEIGHT + 1]; // 路径、路径上每层的左右兄弟以及后继叶子
+        int count = 0;
+        OptLock* rootLatch = nullptr;
+
+        void lockRoot(OptLock& latch)
+        {
+            latch.writeLock();
+            this->rootLatch = &latch;
+        }
+
+        void lock(Node* node)
+        {
+            for(int i = 0; i < this->count; i++)
+            {
+                if(this->nodes[i] == node) return;
+            }
+            if(node == nullptr) return;
+            node->latch.writeLock();
+            this->nodes[this->count++] = node;
+        }
+
+        void releaseAll()
+        {
+            for(int i = 0; i < this->count; i++)
+            {
+                this->nodes[i]->latch.writeUnlock();
+            }
+            this->count = 0;
+            if(this->rootLatch)
+            {
+                this->rootLatch->writeUnlock();
+                this->rootLatch = nullptr;
+            }
+        }
+    };
+
+    Compare compare;
+    Allocator allocator; // 节点内存的分配器
+    std::atomic<int> size;
+    std::atomic<Node*> root; // B+树的根结点
+    LeafNode *head; // 叶子节点的头结点
+    mutable OptLock rootLatch; // 保护root和head
+    std::mutex smoMutex; // 结构修改（分裂、借位、合并、换根）的互斥量，非叶子节点只在持有它时被修改
+    mutable epoch::Domain readers; // 乐观读者登记的纪元
+    std::vector<std::pair<uint64_t, Node*>> retiredNodes; // 已从树中摘除、尚未释放的节点及其摘除时的纪元，由smoMutex保护
+    std::vector<uint64_t> freedPages; // 被摘除节点在检查点文件中的页，下一次检查点时释放
+    bool checkpointed; // 节点是否可能在检查点文件中占有页（写入过或加载自检查点）
+    std::atomic<bool> lazyRemove; // 为true时删除只保证叶子非空，下溢出的叶子留给compact合并
+    std::atomic<LeafNode*> appendHint; // 最近一次见到的最右叶子，顺序追加的插入先尝试直接写入它
+    mutable treestats::Counters<treestats::ENABLED> counters; // 未定义BPLUSTREE_STATS时为空操作
+
+    void descendPath(const Key& key, NodePath& path) const;
+    void adjustNodeForUpOver(Node *node,InnerNode* parent,bool append,int split = 0);
+    void adjustNodeForDownOver(Node *node,InnerNode* parent,int arg);
+    void maintainAfterInsert(NodePath& path,bool append,int leafSplit = 0);
+    void maintainAfterRemove(NodePath& path);
+    bool descendOptimistic(const Key& key, LeafNode*& leaf, uint64_t& version, bool& isRoot) const;
+    LeafNode* lockLeafExclusive(const Key& key, bool& isRoot, BatchCursor* cursor = nullptr) const;
+    LeafNode* lockLeafShared(const Key& key) const;
+    LeafNode* lockLeafForWrite(const Key& key, bool& isRoot);
+    bool tryAppend(const Key& key, const Value& value);
+    bool descendCursor(const Key& key, BatchCursor& cursor) const;
+    LeafNode* lockBatchLeaf(const Key& key, BatchCursor& cursor, bool& isRoot);
+    template<typename Fn>
+    void readLeaf(const Key& key, Fn&& fn) const;
+    int insertWithSplit(Key key, Value value);
+    size_t insertRunWithSplit(std::vector<std::pair<Key,Value>>& items, size_t i, int& inserted);
+    int removeWithRebalance(Key key);
+    int rebalanceLeaf(const Key& key, bool erase);
+    int minLeafKeys(bool isRoot) const;
+    std::unique_lock<std::mutex> lockSmo();
+    void preserve(LeafNode* leaf);
+    void retire(Node* node);
+    void reclaim();
+    epoch::Domain::Guard pin() const { return epoch::Domain::Guard(OPTIMISTIC_READ ? &this->readers : nullptr); }
+    LeafNode* newLeaf();
+    InnerNode* newInner();
+    void freeNode(Node* node);
+    void freeSubtree(Node* node);
+    LeafNode* lastLeaf() const;
+    static long bulkLoadNodeCount(long total, long target, long minCount, long maxCount);
+    void bulkLoadInner(std::vector<Node*>& level, std::vector<Key>& lowKeys, double fillFactor, ThreadPool* pool);
+    std::vector<LeafNode*> collectLeaves(ThreadPool& pool) const;
+    template<typename Each>
+    static void writeStream(std::ostream& out, long count, bool compressKeys, Each&& each);
+    static BPlusTree* readStream(std::istream& in);
+    uint64_t writeDirtyPages(Node* node, CheckpointFile& file, std::vector<char>& page, bool& ok);
+    Node* readPages(uint64_t id, CheckpointFile& file, std::vector<char>& page, std::vector<LeafNode*>& leaves, int depth);
 
 public:
+    /**
+     * 沿叶子双向链表移动的只读双向迭代器，位置由(叶子节点, 下标)确定，node为nullptr表示end()。
+     * 迭代器不持有锁，迭代期间不能有并发的插入和删除
+     **/
+    class const_iterator
+    {
+    public:
+        using iterator_category = std::bidirectional_iterator_tag;
+        using value_type = std::pair<Key, Value>;
+        using difference_type = std::ptrdiff_t;
+        using reference = std::pair<KeyRef, ValueRef>;
+        using pointer = void;
+
+        const_iterator() : tree(nullptr), node(nullptr), idx(0) {}
+
+        KeyRef key() const { return this->node->key(this->idx); }
+        ValueRef value() const { return this->node->value(this->idx); }
+        reference operator*() const { return reference(this->key(), this->value()); }
+
+        const_iterator& operator++()
+        {
+            this->idx++;
+            this->skipForward();
+            return *this;
+        }
+
+        const_iterator operator++(int)
+        {
+            const_iterator old = *this;
+            ++*this;
+            return old;
+        }
+
+        const_iterator& operator--()
+        {
+            // end()的前一个位置是最后一个叶子的最后一个键
+            if(this->node == nullptr)
+            {
+                this->node = this->tree->lastLeaf();
+                this->idx = this->node ? this->node->n : 0;
+            }
+            while(this->node && this->idx == 0)
+            {
+                this->node = this->node->ptr[0];
+                this->idx = this->node ? this->node->n : 0;
+            }
+            this->idx--;
+            return *this;
+        }
+
+        const_iterator operator--(int)
+        {
+            const_iterator old = *this;
+            --*this;
+            return old;
+        }
+
+        bool operator==(const const_iterator& other) const { return this->node == other.node && this->idx == other.idx; }
+        bool operator!=(const const_iterator& other) const { return !(*this == other); }
+
+    private:
+        friend class BPlusTree;
+
+        const_iterator(const BPlusTree* tree, LeafNode* node, int idx) : tree(tree), node(node), idx(idx)
+        {
+            this->skipForward();
+        }
+
+        // 下标越过当前叶子时跳到后继叶子的开头，走到链表末尾即为end()
+        void skipForward()
+        {
+            while(this->node && this->idx >= this->node->n)
+            {
+                this->node = this->node->ptr[1];
+                this->idx = 0;
+            }
+        }
+
+        const BPlusTree* tree;
+        LeafNode* node;
+        int idx;
+    };
+
+    using iterator = const_iterator;
+    using const_reverse_iterator = std::reverse_iterator<const_iterator>;
+
+    // 半开区间[first, last)，可直接用于范围for
+    struct Range
+    {
+        const_iterator first;
+        const_iterator last;
+
+        const_iterator begin() const { return first; }
+        const_iterator end() const { return last; }
+    };
+
     BPlusTree()
     {
         assert(order>=3);
@@ -310,235 +698,2242 @@ public:
         this->root = nullptr;
         this->head = nullptr;
         this->compare = Compare();
-        
+        this->lazyRemove = false;
+        this->appendHint = nullptr;
+        this->snapshotEpoch = 0;
+        this->checkpointed = false;
     }
+    ~BPlusTree();
+    // 释放所有节点，树恢复为空，检查点文件中的页在下一次检查点时释放；调用时不能有并发操作，快照须已销毁
+    void clear();
     int insert(Key key,Value value);
     int remove(Key key);
+    template<typename Iterator>
+    int bulkLoad(Iterator first, Iterator last, double fillFactor = 1.0);
+    // 并行构建：叶子和各层非叶子节点按下标划分给线程池，要求随机访问迭代器
+    template<typename Iterator>
+    int bulkLoad(Iterator first, Iterator last, ThreadPool& pool, double fillFactor = 1.0);
+
+    // 并行遍历：持有smoMutex时按叶子划分给线程池，fn(const Key&, const Value&)须可并发调用，不同叶子之间的调用顺序不确定
+    template<typename Fn>
+    void parallelForEach(ThreadPool& pool, Fn&& fn);
+    // 并行归约：每段连续的叶子从identity开始按键升序累积accumulate(T, const Key&, const Value&)，各段结果再按键序两两combine
+    template<typename T, typename Accumulate, typename Combine>
+    T parallelReduce(ThreadPool& pool, T identity, Accumulate&& accumulate, Combine&& combine);
+
+    FindResult find(const Key& key) const;
+    std::optional<Value> get(const Key& key) const;
+    bool contains(const Key& key) const;
+
+    // 批量接口：先排序，落在同一叶子的键一次处理，相邻键复用公共的路径前缀
+    int insertBatch(std::vector<std::pair<Key,Value>> items);
+    std::vector<std::optional<Value>> findBatch(const std::vector<Key>& keys) const;
+    int eraseBatch(std::vector<Key> keys);
+
+    // 延迟合并：开启后删除不再借位、合并（叶子删空时除外），由compact集中调整下溢出的叶子
+    void setLazyRemove(bool enabled) { this->lazyRemove = enabled; }
+    int compact();
+
+    // 运行统计：结构信息遍历树得到，事件计数需要编译时定义BPLUSTREE_STATS
+    treestats::Snapshot stats();
+
+    /**
+     * 某一时刻的只读视图。创建时短暂锁住所有叶子记下叶子序列（不复制数据），
+     * 之后写者第一次修改其中的叶子前先把修改前的内容交给视图保存（写时复制），
+     * 因此扫描和序列化看到一致的时间点，也不阻塞写者。视图须在树之前销毁
+     **/
+    class Snapshot
+    {
+    public:
+        Snapshot(const Snapshot&) = delete;
+        Snapshot& operator=(const Snapshot&) = delete;
+        ~Snapshot();
 
-    // int find(Key key);
-    void leafTraversal();
-    void levelOrderTraversal();
+        long size() const { return this->count; }
+        std::optional<Value> get(const Key& key) const;
+
+        // 按键升序对每个键值对调用fn(const Key&, const Value&)
+        template<typename Fn>
+        void forEach(Fn&& fn) const;
+
+        // 对[lo, hi)内的键值对按升序调用fn(const Key&, const Value&)
+        template<typename Fn>
+        void range(const Key& lo, const Key& hi, Fn&& fn) const;
+
+        // 与BPlusTree::serialize格式相同，可由deserialize读回
+        void serialize(std::ostream& out, bool compressKeys = true) const;
+
+    private:
+        friend class BPlusTree;
+
+        struct LeafImage
+        {
+            std::vector<Key> keys;
+            std::vector<Value> values;
+        };
+
+        BPlusTree* tree;
+        uint64_t epoch;
+        uint64_t pin; // 创建时的回收纪元，此后摘除的节点在快照销毁前不能释放
+        long count;
+        std::vector<LeafNode*> leaves; // 创建时的叶子序列
+        std::vector<Key> lowKeys; // 创建时每个叶子的最小键
+        std::unordered_map<LeafNode*, LeafImage> preserved; // 创建后被修改过的叶子的原内容，由tree->snapshotMutex保护
+
+        explicit Snapshot(BPlusTree* tree) : tree(tree), epoch(0), pin(0), count(0) {}
+
+        const LeafImage& image(size_t i, LeafImage& scratch) const;
+        size_t leafIndex(const Key& key) const;
+    };
+
+    Snapshot* snapshot();
+
+private:
+    std::atomic<uint64_t> snapshotEpoch; // 每创建一个快照加一
+    std::mutex snapshotMutex; // 保护snapshots及各快照保存的叶子内容
+    std::vector<Snapshot*> snapshots; // 尚未销毁的快照
+
+public:
+    // 范围扫描接口：定位一次后沿叶子链表顺序遍历
+    const_iterator begin() const { return const_iterator(this, this->head, 0); }
+    const_iterator end() const { return const_iterator(this, nullptr, 0); }
+    const_reverse_iterator rbegin() const { return const_reverse_iterator(this->end()); }
+    const_reverse_iterator rend() const { return const_reverse_iterator(this->begin()); }
+    const_iterator lower_bound(const Key& key) const;
+    const_iterator upper_bound(const Key& key) const;
+    Range range(const Key& lo, const Key& hi) const;
+
+    void leafTraversal();
+    void levelOrderTraversal();
 
     // 序列化接口
-    void serialize(std::ostream& out);
+    // 流式分块格式（见StreamFormat.h），compressKeys为true时有序键差分编码；deserialize也能读入旧的先序格式
+    void serialize(std::ostream& out, bool compressKeys = true);
     static BPlusTree* deserialize(std::istream& in);
+
+    // 定长页文件，可由MappedBPlusTree直接映射只读查询
+    int writePages(const std::string& path);
+
+    // 增量检查点：只写入上次检查点之后被修改过的节点
+    int writeCheckpoint(CheckpointFile& file);
+    static BPlusTree* loadCheckpoint(CheckpointFile& file);
 };
 
 /**
- * @brief  查找含有key的节点（需保证根节点存在）
+ * @brief  查找含有key的叶子并记录路径（需持有smoMutex且根结点存在）
  * @param  key 键值
- * @return 保存了查找路径的栈，栈顶即为含有key的节点
+ * @param  path 输出的根到叶子的路径
+ * @return void
  */
-template<int order,typename Key,typename Value,typename Compare>
-std::stack<typename BPlusTree<order,Key,Value,Compare>::Node*> BPlusTree<order,Key,Value,Compare>::findNodeByKey(Key key)
+template<int order,typename Key,typename Value,typename Compare,typename Allocator>
+void BPlusTree<order,Key,Value,Compare,Allocator>::descendPath(const Key& key, NodePath& path) const
 {
-    std::stack<Node*> nodePathStack;
+    // 非叶子节点只在持有smoMutex时被修改，这里可以不加锁直接下降
     Node* node = this->root;
-    // std::shared_mutex mtx;
-	nodePathStack.push(node);
+    path.depth = 0;
+    path.nodes[path.depth++] = node;
     while(!node->isLeaf())
     {
-        int arg = node->search(key,this->compare);
-        if(arg<node->n && node->keys[arg]==key) arg++;
-        node = node->ptr[arg];
-		nodePathStack.push(node);
+        int arg = node->childIndex(key,this->compare);
+        path.slots[path.depth-1] = arg;
+        node = node->inner()->ptr[arg];
+        path.nodes[path.depth++] = node;
     }
-    return nodePathStack;
 }
 
 /**
- * @brief  插入键值对
- * @param  key 新的键
- * @param  value 新的值
- * @return int  0表示插入成功，1表示节点已存在，更新value
+ * @brief  乐观地从根结点下降到可能含有key的叶子，沿途只读取版本号
+ * @param  key 键值
+ * @param  leaf 输出的叶子节点，树为空时为nullptr
+ * @param  version 输出的叶子版本号
+ * @param  isRoot 输出叶子是否为根结点
+ * @return bool  false表示下降期间遇到并发修改，需要重试
  */
-template<int order, typename Key, typename Value, typename Compare>
-int BPlusTree<order,Key,Value,Compare>::insert(Key key, Value value)
+template<int order,typename Key,typename Value,typename Compare,typename Allocator>
+bool BPlusTree<order,Key,Value,Compare,Allocator>::descendOptimistic(const Key& key, LeafNode*& leaf, uint64_t& version, bool& isRoot) const
 {
-    if(this->root == nullptr)
+    uint64_t rootVersion;
+    if(!this->rootLatch.readLockOrRestart(rootVersion))
+    {
+        return false;
+    }
+
+    Node* node = this->root;
+    if(node == nullptr)
     {
-	   this->root = new Node(true);
+        leaf = nullptr;
+        return this->rootLatch.validate(rootVersion);
+    }
+
+    uint64_t nodeVersion;
+    if(!node->latch.readLockOrRestart(nodeVersion) || !this->rootLatch.validate(rootVersion))
+    {
+        return false;
+    }
 
-       // 加上独占锁
-       std::unique_lock<std::shared_mutex> lock(this->root->mtx);
+    isRoot = true;
+    while(!node->isLeaf())
+    {
+        Node* child = node->inner()->ptr[node->childIndex(key,this->compare)];
+        // 先确认读到的孩子指针有效再访问孩子，拿到孩子版本后再确认父亲没有被修改
+        if(!node->latch.validate(nodeVersion))
+        {
+            return false;
+        }
 
-       this->root->insert(key,value,this->compare);
-       this->head = this->root;
-       return 0;
+        uint64_t childVersion;
+        if(!child->latch.readLockOrRestart(childVersion) || !node->latch.validate(nodeVersion))
+        {
+            return false;
+        }
+        node = child;
+        nodeVersion = childVersion;
+        isRoot = false;
     }
 
-    std::stack<Node*> nodePathStack = this->findNodeByKey(key);
-    Node *node = nodePathStack.top();
-    
-    // 加上独占锁
-    std::unique_lock<std::shared_mutex> lock(node->mtx);
+    leaf = node->leaf();
+    version = nodeVersion;
+    return true;
+}
 
-    if(node->hasKey(key, this->compare))
+/**
+ * @brief  从根结点下降到可能含有key的叶子，沿途逐层加写锁（锁耦合）
+ * @param  key 键值
+ * @param  isRoot 输出叶子是否为根结点
+ * @param  cursor 非空时记录叶子及其键范围的上界；祖先已解锁不能复用，cursor只含叶子一层
+ * @return Node* 已加写锁的叶子节点，由调用方负责解锁；树为空时返回nullptr
+ */
+template<int order,typename Key,typename Value,typename Compare,typename Allocator>
+typename BPlusTree<order,Key,Value,Compare,Allocator>::LeafNode* BPlusTree<order,Key,Value,Compare,Allocator>::lockLeafExclusive(const Key& key, bool& isRoot, BatchCursor* cursor) const
+{
+    this->rootLatch.writeLock();
+    Node* node = this->root;
+    if(node == nullptr)
     {
-        node->update(key, value, this->compare);
-        return 1;
+        this->rootLatch.writeUnlock();
+        if(cursor) cursor->depth = 0;
+        return nullptr;
     }
-    node->insert(key, value,this->compare);
-    this->maintainAfterInsert(nodePathStack);
-    this->size++;
-    return 0;
+
+    node->latch.writeLock();
+    this->rootLatch.writeUnlock();
+    isRoot = true;
+    if(cursor) cursor->bounded[0] = false;
+    while(!node->isLeaf())
+    {
+        int arg = node->childIndex(key,this->compare);
+        if(cursor && arg < node->n)
+        {
+            cursor->uppers[0] = node->inner()->keys[arg];
+            cursor->bounded[0] = true;
+        }
+        Node* child = node->inner()->ptr[arg];
+        // 先锁孩子再释放父亲，保证下降过程中路径不被拆散
+        child->latch.writeLock();
+        node->latch.writeUnlock();
+        node = child;
+        isRoot = false;
+    }
+    if(cursor)
+    {
+        cursor->nodes[0] = node;
+        cursor->depth = 1;
+    }
+    return node->leaf();
+}
+
+/**
+ * @brief  从根结点下降到可能含有key的叶子，沿途逐层加共享锁（锁耦合），只读的查找之间互不阻塞
+ * @param  key 键值
+ * @return Node* 已加共享锁的叶子节点，由调用方负责解锁；树为空时返回nullptr
+ */
+template<int order,typename Key,typename Value,typename Compare,typename Allocator>
+typename BPlusTree<order,Key,Value,Compare,Allocator>::LeafNode* BPlusTree<order,Key,Value,Compare,Allocator>::lockLeafShared(const Key& key) const
+{
+    this->rootLatch.readLockShared();
+    Node* node = this->root;
+    if(node == nullptr)
+    {
+        this->rootLatch.readUnlockShared();
+        return nullptr;
+    }
+
+    node->latch.readLockShared();
+    this->rootLatch.readUnlockShared();
+    while(!node->isLeaf())
+    {
+        Node* child = node->inner()->ptr[node->childIndex(key,this->compare)];
+        child->latch.readLockShared();
+        node->latch.readUnlockShared();
+        node = child;
+    }
+    return node->leaf();
+}
+
+/**
+ * @brief  找到可能含有key的叶子并加写锁
+ * @param  key 键值
+ * @param  isRoot 输出叶子是否为根结点
+ * @return Node* 已加写锁的叶子节点，由调用方负责解锁；树为空时返回nullptr
+ */
+template<int order,typename Key,typename Value,typename Compare,typename Allocator>
+typename BPlusTree<order,Key,Value,Compare,Allocator>::LeafNode* BPlusTree<order,Key,Value,Compare,Allocator>::lockLeafForWrite(const Key& key, bool& isRoot)
+{
+    if constexpr(OPTIMISTIC_READ)
+    {
+        for(;;)
+        {
+            LeafNode* leaf;
+            uint64_t version;
+            if(!this->descendOptimistic(key, leaf, version, isRoot))
+            {
+                this->counters.add(treestats::OPTIMISTIC_RESTART);
+                continue;
+            }
+            if(leaf == nullptr || leaf->latch.upgradeToWriteLockOrRestart(version))
+            {
+                return leaf;
+            }
+            this->counters.add(treestats::OPTIMISTIC_RESTART);
+        }
+    }
+    else
+    {
+        return this->lockLeafExclusive(key, isRoot);
+    }
+}
+
+/**
+ * @brief  乐观模式下沿cursor复用路径：弹出键范围不覆盖key的层，从仍覆盖key的最深祖先继续下降到叶子，
+ *         祖先的键范围只在它自身被修改时改变，因此版本号未变即可直接复用
+ * @param  key 键值，须不小于cursor上一次定位的键
+ * @param  cursor 复用并更新的路径，树为空时depth为0
+ * @return bool  false表示遇到并发修改，cursor已清空，需要重试
+ */
+template<int order,typename Key,typename Value,typename Compare,typename Allocator>
+bool BPlusTree<order,Key,Value,Compare,Allocator>::descendCursor(const Key& key, BatchCursor& cursor) const
+{
+    while(cursor.depth > 0 && !cursor.covers(cursor.depth - 1, key, this->compare))
+    {
+        cursor.depth--;
+    }
+
+    Node* node;
+    uint64_t nodeVersion;
+    if(cursor.depth == 0)
+    {
+        uint64_t rootVersion;
+        if(!this->rootLatch.readLockOrRestart(rootVersion))
+        {
+            return false;
+        }
+        node = this->root;
+        if(node == nullptr)
+        {
+            return this->rootLatch.validate(rootVersion);
+        }
+        if(!node->latch.readLockOrRestart(nodeVersion) || !this->rootLatch.validate(rootVersion))
+        {
+            return false;
+        }
+        cursor.nodes[0] = node;
+        cursor.versions[0] = nodeVersion;
+        cursor.bounded[0] = false;
+        cursor.depth = 1;
+    }
+    else
+    {
+        node = cursor.nodes[cursor.depth - 1];
+        nodeVersion = cursor.versions[cursor.depth - 1];
+    }
+
+    while(!node->isLeaf())
+    {
+        int arg = node->childIndex(key,this->compare);
+        Node* child = node->inner()->ptr[arg];
+        int level = cursor.depth;
+        cursor.bounded[level] = arg < node->n || cursor.bounded[level - 1];
+        cursor.uppers[level] = arg < node->n ? node->inner()->keys[arg] : cursor.uppers[level - 1];
+        if(!node->latch.validate(nodeVersion))
+        {
+            cursor.depth = 0;
+            return false;
+        }
+
+        uint64_t childVersion;
+        if(!child->latch.readLockOrRestart(childVersion) || !node->latch.validate(nodeVersion))
+        {
+            cursor.depth = 0;
+            return false;
+        }
+        cursor.nodes[level] = child;
+        cursor.versions[level] = childVersion;
+        cursor.depth++;
+        node = child;
+        nodeVersion = childVersion;
+    }
+
+    // 从叶子本身复用时也要确认它没有被修改
+    if(!node->latch.validate(nodeVersion))
+    {
+        cursor.depth = 0;
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief  找到可能含有key的叶子并加写锁，同时在cursor中记录路径供下一个键复用
+ * @param  key 键值，须不小于cursor上一次定位的键
+ * @param  cursor 复用并更新的路径，解锁叶子后调用方应弹出叶子层（depth减一）
+ * @param  isRoot 输出叶子是否为根结点
+ * @return LeafNode* 已加写锁的叶子节点；树为空时返回nullptr
+ */
+template<int order,typename Key,typename Value,typename Compare,typename Allocator>
+typename BPlusTree<order,Key,Value,Compare,Allocator>::LeafNode* BPlusTree<order,Key,Value,Compare,Allocator>::lockBatchLeaf(const Key& key, BatchCursor& cursor, bool& isRoot)
+{
+    if constexpr(OPTIMISTIC_READ)
+    {
+        for(;;)
+        {
+            if(!this->descendCursor(key, cursor))
+            {
+                this->counters.add(treestats::OPTIMISTIC_RESTART);
+                continue;
+            }
+            if(cursor.depth == 0)
+            {
+                return nullptr;
+            }
+            LeafNode* leaf = cursor.nodes[cursor.depth - 1]->leaf();
+            if(leaf->latch.upgradeToWriteLockOrRestart(cursor.versions[cursor.depth - 1]))
+            {
+                isRoot = cursor.depth == 1;
+                return leaf;
+            }
+            this->counters.add(treestats::OPTIMISTIC_RESTART);
+            cursor.depth = 0;
+        }
+    }
+    else
+    {
+        return this->lockLeafExclusive(key, isRoot, &cursor);
+    }
+}
+
+/**
+ * @brief  在可能含有key的叶子上执行只读操作
+ * @param  key 键值
+ * @param  fn 形如void(LeafNode* leaf)的回调，树为空时leaf为nullptr；乐观模式下可能因并发修改被重复调用
+ * @return void
+ */
+template<int order,typename Key,typename Value,typename Compare,typename Allocator>
+template<typename Fn>
+void BPlusTree<order,Key,Value,Compare,Allocator>::readLeaf(const Key& key, Fn&& fn) const
+{
+    epoch::Domain::Guard guard = this->pin();
+    bool isRoot;
+    if constexpr(OPTIMISTIC_READ)
+    {
+        for(;;)
+        {
+            LeafNode* leaf;
+            uint64_t version;
+            if(!this->descendOptimistic(key, leaf, version, isRoot))
+            {
+                this->counters.add(treestats::OPTIMISTIC_RESTART);
+                continue;
+            }
+            fn(leaf);
+            if(leaf == nullptr || leaf->latch.validate(version))
+            {
+                return;
+            }
+            this->counters.add(treestats::OPTIMISTIC_RESTART);
+        }
+    }
+    else
+    {
+        LeafNode* leaf = this->lockLeafShared(key);
+        fn(leaf);
+        if(leaf)
+        {
+            leaf->latch.readUnlockShared();
+        }
+    }
+}
+
+/**
+ * @brief  把已从树中摘除的节点标记为废弃（需持有该节点的写锁和smoMutex）
+ * @param  node 被摘除的节点
+ * @return void
+ */
+template<int order,typename Key,typename Value,typename Compare,typename Allocator>
+void BPlusTree<order,Key,Value,Compare,Allocator>::retire(Node* node)
+{
+    if(node->isLeaf())
+    {
+        this->preserve(node->leaf());
+        // 之后的顺序追加不再拿到被摘除的叶子，已经拿到的追加者仍在登记的纪元内
+        LeafNode* hint = node->leaf();
+        this->appendHint.compare_exchange_strong(hint, nullptr);
+    }
+    node->latch.markObsolete();
+    this->retiredNodes.emplace_back(this->readers.advance(), node);
+    if(node->pageId != CheckpointFile::NO_PAGE)
+    {
+        this->freedPages.push_back(node->pageId);
+    }
+}
+
+/**
+ * @brief  释放所有在场读者开始之前摘除、且不被任何快照引用的节点（需持有smoMutex）
+ * @return void
+ */
+template<int order,typename Key,typename Value,typename Compare,typename Allocator>
+void BPlusTree<order,Key,Value,Compare,Allocator>::reclaim()
+{
+    if(this->retiredNodes.empty())
+    {
+        return;
+    }
+    uint64_t bound = this->readers.oldestActive();
+    {
+        std::lock_guard<std::mutex> registry(this->snapshotMutex);
+        for(Snapshot* snapshot : this->snapshots)
+        {
+            bound = std::min(bound, snapshot->pin);
+        }
+    }
+
+    // 摘除纪元随摘除顺序递增，可释放的节点是一段前缀
+    size_t freed = 0;
+    while(freed < this->retiredNodes.size() && this->retiredNodes[freed].first < bound)
+    {
+        this->freeNode(this->retiredNodes[freed++].second);
+    }
+    this->retiredNodes.erase(this->retiredNodes.begin(), this->retiredNodes.begin() + freed);
+}
+
+/**
+ * @brief  从分配器申请并构造一个空叶子节点
+ * @return LeafNode*
+ */
+template<int order,typename Key,typename Value,typename Compare,typename Allocator>
+typename BPlusTree<order,Key,Value,Compare,Allocator>::LeafNode* BPlusTree<order,Key,Value,Compare,Allocator>::newLeaf()
+{
+    void* p = this->allocator.allocate(sizeof(LeafNode), alignof(LeafNode));
+    LeafNode* leaf = new(p) LeafNode();
+    // 之后创建的叶子不属于任何已有快照
+    leaf->cowEpoch = this->snapshotEpoch.load(std::memory_order_relaxed);
+    return leaf;
+}
+
+/**
+ * @brief  从分配器申请并构造一个空的非叶子节点
+ * @return InnerNode*
+ */
+template<int order,typename Key,typename Value,typename Compare,typename Allocator>
+typename BPlusTree<order,Key,Value,Compare,Allocator>::InnerNode* BPlusTree<order,Key,Value,Compare,Allocator>::newInner()
+{
+    void* p = this->allocator.allocate(sizeof(InnerNode), alignof(InnerNode));
+    return new(p) InnerNode();
+}
+
+/**
+ * @brief  析构节点并把内存还给分配器，不递归释放子树
+ * @param  node 要释放的节点
+ * @return void
+ */
+template<int order,typename Key,typename Value,typename Compare,typename Allocator>
+void BPlusTree<order,Key,Value,Compare,Allocator>::freeNode(Node* node)
+{
+    if(node->isLeaf())
+    {
+        LeafNode* leaf = node->leaf();
+        leaf->~LeafNode();
+        this->allocator.deallocate(leaf, sizeof(LeafNode), alignof(LeafNode));
+    }
+    else
+    {
+        InnerNode* inner = node->inner();
+        inner->~InnerNode();
+        this->allocator.deallocate(inner, sizeof(InnerNode), alignof(InnerNode));
+    }
+}
+
+/**
+ * @brief  释放以node为根的子树：沿根到叶子的路径下降，路径记在定长数组中，
+ *         非叶子节点的孩子都释放后再释放它本身，不递归也不申请内存（需持有smoMutex或没有并发操作）
+ * @param  node 子树的根，可以为nullptr；读取失败时残缺节点的孩子指针也可以为nullptr
+ * @return void
+ */
+template<int order,typename Key,typename Value,typename Compare,typename Allocator>
+void BPlusTree<order,Key,Value,Compare,Allocator>::freeSubtree(Node* node)
+{
+    auto release = [this](Node* node)
+    {
+        if(this->checkpointed && node->pageId != CheckpointFile::NO_PAGE)
+        {
+            this->freedPages.push_back(node->pageId);
+        }
+        this->freeNode(node);
+    };
+
+    InnerNode* path[MAX_HEIGHT];
+    int next[MAX_HEIGHT]; // path[i]下一个要释放的孩子下标
+    int depth = 0;
+    while(node || depth > 0)
+    {
+        if(node && node->isLeaf())
+        {
+            release(node);
+        }
+        else if(node)
+        {
+            assert(depth < MAX_HEIGHT);
+            path[depth] = node->inner();
+            next[depth++] = 0;
+        }
+
+        // 取路径末端节点的下一个孩子，孩子都已释放的节点出栈并释放
+        node = nullptr;
+        while(node == nullptr && depth > 0)
+        {
+            InnerNode* top = path[depth-1];
+            if(next[depth-1] <= top->n)
+            {
+                node = top->ptr[next[depth-1]++];
+            }
+            else
+            {
+                depth--;
+                release(top);
+            }
+        }
+    }
+}
+
+/**
+ * @brief  析构时释放所有节点，快照须已销毁
+ */
+template<int order,typename Key,typename Value,typename Compare,typename Allocator>
+BPlusTree<order,Key,Value,Compare,Allocator>::~BPlusTree()
+{
+    this->clear();
+}
+
+/**
+ * @brief  释放所有节点（包括已摘除、尚未回收的节点），树恢复为空。
+ *         键和值都无需析构、分配器支持release且节点不在检查点文件中占页时，直接丢弃分配器的全部大块，
+ *         否则用freeSubtree逐个释放。调用时不能有并发操作，快照须已销毁。
+ *         清空不解除与检查点文件的对应关系：checkpointed保持不变，被释放节点的页记入freedPages，
+ *         下一次writeCheckpoint在同一文件中释放这些页并写入空树（或清空后新插入的数据）
+ * @return void
+ */
+template<int order,typename Key,typename Value,typename Compare,typename Allocator>
+void BPlusTree<order,Key,Value,Compare,Allocator>::clear()
+{
+    std::unique_lock<std::mutex> smo = this->lockSmo();
+    assert(this->snapshots.empty());
+
+    bool dropped = false;
+    if constexpr(ReleasesAll<Allocator>::value && std::is_trivially_destructible<Key>::value && std::is_trivially_destructible<Value>::value)
+    {
+        // 在检查点文件中占页的节点要逐个访问，把页号记入freedPages，否则这些页在文件中永远不会被释放
+        if(!this->checkpointed)
+        {
+            this->allocator.release();
+            dropped = true;
+        }
+    }
+    if(!dropped)
+    {
+        this->freeSubtree(this->root.load());
+        // 摘除时已经记录了页号
+        for(auto& retired : this->retiredNodes)
+        {
+            this->freeNode(retired.second);
+        }
+    }
+
+    this->retiredNodes.clear();
+    this->root = nullptr;
+    this->head = nullptr;
+    this->appendHint = nullptr;
+    this->size = 0;
+}
+
+/**
+ * @brief  插入键值对
+ * @param  key 新的键
+ * @param  value 新的值
+ * @return int  0表示插入成功，1表示节点已存在，更新value
+ */
+template<int order, typename Key, typename Value, typename Compare, typename Allocator>
+int BPlusTree<order,Key,Value,Compare,Allocator>::insert(Key key, Value value)
+{
+    {
+        // 快速路径不持有smoMutex，经过的节点可能被并发摘除，需要登记纪元
+        epoch::Domain::Guard guard = this->pin();
+        if(this->tryAppend(key, value))
+        {
+            return 0;
+        }
+
+        bool isRoot;
+        LeafNode *node = this->lockLeafForWrite(key, isRoot);
+        if(node != nullptr)
+        {
+            if(node->ptr[1] == nullptr && this->appendHint.load(std::memory_order_relaxed) != node)
+            {
+                this->appendHint.store(node, std::memory_order_release);
+            }
+
+            this->preserve(node);
+            if(node->hasKey(key, this->compare))
+            {
+                node->update(key, value, this->compare);
+                node->latch.writeUnlock();
+                return 1;
+            }
+
+            // 插入后不会上溢出，只需修改叶子本身
+            if(node->n + 1 < order)
+            {
+                node->insert(key, value, this->compare);
+                node->latch.writeUnlock();
+                this->size++;
+                return 0;
+            }
+            node->latch.writeUnlock();
+        }
+    }
+    return this->insertWithSplit(key, value);
+}
+
+/**
+ * @brief  顺序追加的快速路径：key大于最右叶子的所有键且叶子不会上溢出时直接写入，不从根结点下降。
+ *         最右叶子没有上界，被摘除的叶子带有obsolete标记，因此加锁成功后无需再校验路径；
+ *         调用者已登记纪元，拿到的叶子即使被并发摘除也不会被释放；逐层加锁模式下读者不登记纪元，不使用缓存的叶子
+ * @param  key 新的键
+ * @param  value 新的值
+ * @return bool  true表示已插入
+ */
+template<int order, typename Key, typename Value, typename Compare, typename Allocator>
+bool BPlusTree<order,Key,Value,Compare,Allocator>::tryAppend(const Key& key, const Value& value)
+{
+    if constexpr(OPTIMISTIC_READ)
+    {
+        LeafNode* tail = this->appendHint.load(std::memory_order_acquire);
+        uint64_t version;
+        if(tail == nullptr || !tail->latch.readLockOrRestart(version))
+        {
+            return false;
+        }
+        int n = tail->n;
+        bool fits = tail->ptr[1] == nullptr && n > 0 && n + 1 < order && tail->keyBefore(n-1, key, this->compare);
+        if(!fits || !tail->latch.upgradeToWriteLockOrRestart(version))
+        {
+            return false;
+        }
+        this->preserve(tail);
+        tail->insert(key, value, this->compare);
+        tail->latch.writeUnlock();
+        this->size++;
+        this->counters.add(treestats::APPEND_FAST_PATH);
+        return true;
+    }
+    else
+    {
+        return false;
+    }
+}
+
+/**
+ * @brief  插入可能引起分裂的键值对：锁住会被分裂波及的整段路径后再插入
+ * @param  key 新的键
+ * @param  value 新的值
+ * @return int  0表示插入成功，1表示节点已存在，更新value
+ */
+template<int order, typename Key, typename Value, typename Compare, typename Allocator>
+int BPlusTree<order,Key,Value,Compare,Allocator>::insertWithSplit(Key key, Value value)
+{
+    std::unique_lock<std::mutex> guard = this->lockSmo();
+    LatchSet latches;
+
+    if(this->root == nullptr)
+    {
+        latches.lockRoot(this->rootLatch);
+        LeafNode* leaf = this->newLeaf();
+        leaf->put(0, std::move(key), std::move(value));
+        leaf->n = 1;
+        this->head = leaf;
+        this->root = leaf;
+        latches.releaseAll();
+        this->size++;
+        return 0;
+    }
+
+    NodePath path;
+    this->descendPath(key, path);
+
+    // 自下而上找到收到分隔键后不会上溢出的祖先，只需锁住它及其以下的节点；找不到则根结点会分裂
+    int top = path.depth - 2;
+    while(top >= 0 && path.nodes[top]->n + 1 >= order)
+    {
+        top--;
+    }
+    if(top < 0)
+    {
+        latches.lockRoot(this->rootLatch);
+    }
+    for(int i = std::max(top, 0); i < path.depth; i++)
+    {
+        latches.lock(path.nodes[i]);
+    }
+
+    // 加锁前叶子可能已被其他写者修改，以加锁后的状态为准
+    LeafNode *node = path.nodes[path.depth - 1]->leaf();
+    this->preserve(node);
+    if(node->hasKey(key, this->compare))
+    {
+        node->update(key, value, this->compare);
+        latches.releaseAll();
+        return 1;
+    }
+
+    // 最右叶子连续收到至少半个节点的追加时按偏斜比例分裂，并把分裂出的新最右叶子记为追加入口；
+    // 单次追加不足以说明插入是顺序的，仍然对半分裂
+    node->insert(key, value,this->compare);
+    bool append = node->ptr[1] == nullptr && node->appendRun >= (order >> 1);
+    if(node->isUpOver())
+    {
+        // 叶子分裂会修改后继叶子的ptr[0]
+        latches.lock(node->ptr[1]);
+    }
+    this->maintainAfterInsert(path, append);
+    if(append)
+    {
+        this->appendHint.store(node->ptr[1] ? node->ptr[1] : node, std::memory_order_release);
+    }
+    latches.releaseAll();
+    this->size++;
+    return 0;
+}
+
+/**
+ * @brief  批量插入遇到满叶子时的分裂路径：持有smoMutex处理落在该叶子键范围内的一段键，叶子满时插入一个键分裂一次，
+ *         其后的键直接并入仍加着锁的左右两个叶子；右叶子再满时只需在持有smoMutex的情况下无锁地重新下降
+ * @param  items 按键排序的批
+ * @param  i 第一个未处理的键的下标，它所在的叶子已满
+ * @param  inserted 累加新插入的键数
+ * @return size_t  这段键之后的下标；树已被删空时原样返回i，由调用方走空树的插入路径
+ */
+template<int order, typename Key, typename Value, typename Compare, typename Allocator>
+size_t BPlusTree<order,Key,Value,Compare,Allocator>::insertRunWithSplit(std::vector<std::pair<Key,Value>>& items, size_t i, int& inserted)
+{
+    std::unique_lock<std::mutex> guard = this->lockSmo();
+    if(this->root == nullptr)
+    {
+        return i;
+    }
+
+    // 叶子键范围的上界是最近一个不沿最右孩子下降的祖先处的分隔键，没有这样的祖先时无上界
+    NodePath path;
+    auto upperOf = [this](const NodePath& path, Key& upper) -> bool
+    {
+        for(int level = path.depth - 2; level >= 0; level--)
+        {
+            if(path.slots[level] < path.nodes[level]->n)
+            {
+                upper = path.nodes[level]->inner()->keys[path.slots[level]];
+                return true;
+            }
+        }
+        return false;
+    };
+    this->descendPath(items[i].first, path);
+    Key runUpper;
+    bool runBounded = upperOf(path, runUpper);
+    size_t end = i;
+    while(end < items.size() && (!runBounded || this->compare(items[end].first, runUpper)))
+    {
+        end++;
+    }
+
+    // 把从j开始、小于limit的键并入leaf直到装满（批内重复的键以最后一个为准），返回第一个未处理的下标
+    const int minKeys = (order-1)>>1;
+    std::vector<Key> underfull;
+    std::pair<Key,Value>* pending[order];
+    auto fill = [&](LeafNode* leaf, size_t j, bool limited, const Key& limit) -> size_t
+    {
+        this->preserve(leaf);
+        int count = 0;
+        for(; j < end && (!limited || this->compare(items[j].first, limit)); j++)
+        {
+            if(j + 1 < items.size() && !this->compare(items[j].first, items[j+1].first))
+            {
+                continue;
+            }
+            if(leaf->hasKey(items[j].first, this->compare))
+            {
+                leaf->update(items[j].first, std::move(items[j].second), this->compare);
+                continue;
+            }
+            if(leaf->n + count + 1 >= order)
+            {
+                break;
+            }
+            pending[count++] = &items[j];
+        }
+        leaf->insertSorted(pending, count, this->compare);
+        this->size += count;
+        inserted += count;
+        return j;
+    };
+
+    bool first = true;
+    while(i < end)
+    {
+        if(!first)
+        {
+            this->descendPath(items[i].first, path);
+        }
+        first = false;
+
+        // 与insertWithSplit相同，只锁住分裂会波及的一段路径
+        LatchSet latches;
+        int top = path.depth - 2;
+        while(top >= 0 && path.nodes[top]->n + 1 >= order)
+        {
+            top--;
+        }
+        if(top < 0)
+        {
+            latches.lockRoot(this->rootLatch);
+        }
+        for(int level = std::max(top, 0); level < path.depth; level++)
+        {
+            latches.lock(path.nodes[level]);
+        }
+
+        LeafNode* leaf = path.nodes[path.depth - 1]->leaf();
+        Key leafUpper;
+        bool leafBounded = upperOf(path, leafUpper);
+        i = fill(leaf, i, leafBounded, leafUpper);
+        if(i < end && (!leafBounded || this->compare(items[i].first, leafUpper)))
+        {
+            // 叶子已满：插入下一个键使它上溢出并分裂，之后的键按分隔键并入左右两个叶子。
+            // 后面还有足够多的键落在同一个空隙时在插入位置分裂（至多装到约90%），左叶子由这些键填满，
+            // 而不是对半分裂后每个叶子只收到半个节点的键；原叶子空隙后的键因此可能低于下溢出界限，处理完这段键后再调整
+            int position = leaf->search(items[i].first, this->compare);
+            bool gapBounded = position < leaf->n || leafBounded;
+            const Key& gapUpper = position < leaf->n ? leaf->key(position) : leafUpper;
+            int gap = 0;
+            for(size_t j = i + 1; j < end && gap < order && (!gapBounded || this->compare(items[j].first, gapUpper)); j++)
+            {
+                gap++;
+            }
+            int split = 0;
+            if(position + 1 + gap >= order - 1)
+            {
+                split = std::min(position + 1, std::max(order >> 1, (order-1)*9/10));
+            }
+
+            leaf->insert(items[i].first, std::move(items[i].second), this->compare);
+            this->size++;
+            inserted++;
+            i++;
+            if(split > 0 && split < minKeys)
+            {
+                underfull.push_back(leaf->key(0));
+            }
+            if(split > 0 && order - split < minKeys)
+            {
+                underfull.push_back(leaf->key(order - 1));
+            }
+            bool append = leaf->ptr[1] == nullptr && leaf->appendRun >= (order >> 1);
+            latches.lock(leaf->ptr[1]);
+            this->maintainAfterInsert(path, append, split);
+            LeafNode* right = leaf->ptr[1];
+            latches.lock(right);
+            Key separator = keycompress::Separator<Key,Compare>::between(leaf->key(leaf->n-1), right->key(0));
+            i = fill(leaf, i, true, separator);
+            if(i < end && !this->compare(items[i].first, separator))
+            {
+                i = fill(right, i, leafBounded, leafUpper);
+            }
+            if(append)
+            {
+                this->appendHint.store(right->ptr[1] ? right->ptr[1] : right, std::memory_order_release);
+            }
+        }
+        latches.releaseAll();
+    }
+
+    // 与compact相同，重复借位或合并直到这些叶子不再下溢出
+    for(const Key& key : underfull)
+    {
+        for(;;)
+        {
+            Node* root = this->root;
+            if(root == nullptr || root->isLeaf() || this->rebalanceLeaf(key, false) != 0)
+            {
+                break;
+            }
+        }
+    }
+    return end;
+}
+
+/**
+ * @brief  批量插入键值对：排序后把落在同一叶子的键一次并入，只有叶子装不下时才走分裂路径。
+ *         收益取决于批内键的聚集程度：均匀随机的键几乎各落一个叶子，耗时与逐个insert相当；
+ *         键集中在少数叶子时省去重复的下降和加锁，装满的叶子在插入位置分裂一次后直接并入后续的键
+ *         （pref_test中每批4096个连续键约快4倍，整数键的排序用基数排序，否则排序本身占去大部分耗时）
+ * @param  items 要插入的键值对，批内重复的键以最后一个为准
+ * @return int  新插入的键数，其余为更新
+ */
+template<int order, typename Key, typename Value, typename Compare, typename Allocator>
+int BPlusTree<order,Key,Value,Compare,Allocator>::insertBatch(std::vector<std::pair<Key,Value>> items)
+{
+    KeySort<Key,Compare>::stableSort(items, [](const std::pair<Key,Value>& item) -> const Key& { return item.first; }, this->compare);
+
+    epoch::Domain::Guard guard = this->pin();
+    BatchCursor cursor;
+    std::pair<Key,Value>* pending[order];
+    int inserted = 0;
+    size_t i = 0;
+    while(i < items.size())
+    {
+        bool isRoot;
+        LeafNode* node = this->lockBatchLeaf(items[i].first, cursor, isRoot);
+        if(node == nullptr)
+        {
+            inserted += this->insertWithSplit(items[i].first, std::move(items[i].second)) == 0;
+            i++;
+            continue;
+        }
+        this->preserve(node);
+
+        int count = 0;
+        bool full = false;
+        size_t j = i;
+        for(; j < items.size() && cursor.covers(cursor.depth - 1, items[j].first, this->compare); j++)
+        {
+            if(j + 1 < items.size() && !this->compare(items[j].first, items[j+1].first))
+            {
+                continue;
+            }
+            if(node->hasKey(items[j].first, this->compare))
+            {
+                node->update(items[j].first, std::move(items[j].second), this->compare);
+                continue;
+            }
+            if(node->n + count + 1 >= order)
+            {
+                full = true;
+                break;
+            }
+            pending[count++] = &items[j];
+        }
+        node->insertSorted(pending, count, this->compare);
+        node->latch.writeUnlock();
+        cursor.depth--;
+        this->size += count;
+        inserted += count;
+
+        // 叶子已满，落在它键范围内的剩余键由分裂路径一并处理；祖先已被修改，下一段从根结点重新定位
+        if(full)
+        {
+            j = this->insertRunWithSplit(items, j, inserted);
+            cursor.depth = 0;
+        }
+        i = j;
+    }
+    return inserted;
+}
+
+/**
+ * @brief  批量查找：排序后同一叶子中的键共用一次定位和一次版本校验
+ * @param  keys 要查找的键
+ * @return std::vector<std::optional<Value>>  与keys一一对应的查找结果，键不存在时为空
+ */
+template<int order, typename Key, typename Value, typename Compare, typename Allocator>
+std::vector<std::optional<Value>> BPlusTree<order,Key,Value,Compare,Allocator>::findBatch(const std::vector<Key>& keys) const
+{
+    std::vector<size_t> sorted(keys.size());
+    std::iota(sorted.begin(), sorted.end(), 0);
+    KeySort<Key,Compare>::stableSort(sorted, [&keys](size_t i) -> const Key& { return keys[i]; }, this->compare);
+
+    std::vector<std::optional<Value>> results(keys.size());
+    // 读出cursor当前叶子覆盖的一段键，返回下一段的起点
+    auto readLeafRange = [&](LeafNode* leaf, size_t i, const BatchCursor& cursor) -> size_t
+    {
+        size_t j = i;
+        for(; j < sorted.size() && (leaf == nullptr || cursor.covers(cursor.depth - 1, keys[sorted[j]], this->compare)); j++)
+        {
+            std::optional<Value>& result = results[sorted[j]];
+            result.reset();
+            if(leaf == nullptr)
+            {
+                continue;
+            }
+            int arg = leaf->search(keys[sorted[j]], this->compare);
+            if(arg < leaf->n && leaf->keyEquals(arg, keys[sorted[j]]))
+            {
+                result = leaf->value(arg);
+            }
+        }
+        return j;
+    };
+
+    // cursor在相邻的键之间保留节点指针，整批查找都需要登记纪元
+    epoch::Domain::Guard guard = this->pin();
+    BatchCursor cursor;
+    size_t i = 0;
+    while(i < sorted.size())
+    {
+        const Key& key = keys[sorted[i]];
+        if constexpr(OPTIMISTIC_READ)
+        {
+            for(;;)
+            {
+                if(!this->descendCursor(key, cursor))
+                {
+                    this->counters.add(treestats::OPTIMISTIC_RESTART);
+                    continue;
+                }
+                LeafNode* leaf = cursor.depth == 0 ? nullptr : cursor.nodes[cursor.depth - 1]->leaf();
+                size_t next = readLeafRange(leaf, i, cursor);
+                if(leaf == nullptr || leaf->latch.validate(cursor.versions[cursor.depth - 1]))
+                {
+                    i = next;
+                    break;
+                }
+                this->counters.add(treestats::OPTIMISTIC_RESTART);
+                cursor.depth = 0;
+            }
+        }
+        else
+        {
+            bool isRoot;
+            LeafNode* leaf = this->lockLeafExclusive(key, isRoot, &cursor);
+            i = readLeafRange(leaf, i, cursor);
+            if(leaf)
+            {
+                leaf->latch.writeUnlock();
+            }
+            cursor.depth = 0;
+        }
+    }
+    return results;
+}
+
+/**
+ * @brief  批量删除：排序后把同一叶子中的键一次删除，只有叶子会下溢出时才走借位、合并路径
+ * @param  keys 要删除的键
+ * @return int  实际删除的键数
+ */
+template<int order, typename Key, typename Value, typename Compare, typename Allocator>
+int BPlusTree<order,Key,Value,Compare,Allocator>::eraseBatch(std::vector<Key> keys)
+{
+    std::sort(keys.begin(), keys.end(), this->compare);
+
+    epoch::Domain::Guard guard = this->pin();
+    BatchCursor cursor;
+    const Key* pending[order];
+    int removed = 0;
+    size_t i = 0;
+    while(i < keys.size())
+    {
+        bool isRoot;
+        LeafNode* node = this->lockBatchLeaf(keys[i], cursor, isRoot);
+        if(node == nullptr)
+        {
+            break;
+        }
+        this->preserve(node);
+
+        int minKeys = this->minLeafKeys(isRoot);
+        int count = 0;
+        bool full = false;
+        size_t j = i;
+        for(; j < keys.size() && cursor.covers(cursor.depth - 1, keys[j], this->compare); j++)
+        {
+            if((j + 1 < keys.size() && !this->compare(keys[j], keys[j+1])) || !node->hasKey(keys[j], this->compare))
+            {
+                continue;
+            }
+            if(node->n - count - 1 < minKeys)
+            {
+                full = true;
+                break;
+            }
+            pending[count++] = &keys[j];
+        }
+        node->removeSorted(pending, count);
+        node->latch.writeUnlock();
+        cursor.depth--;
+        this->size -= count;
+        removed += count;
+
+        if(full)
+        {
+            removed += this->removeWithRebalance(keys[j]) == 0;
+            j++;
+        }
+        i = j;
+    }
+    return removed;
+}
+
+/**
+ * @brief  计算把total个元素均分到一层节点时的节点数，使每个节点的元素数落在[minCount, maxCount]内
+ * @param  total 该层的元素总数
+ * @param  target 按填充因子期望的每个节点元素数
+ * @param  minCount 每个节点至少的元素数
+ * @param  maxCount 每个节点至多的元素数
+ * @return long 节点数
+ */
+template<int order, typename Key, typename Value, typename Compare, typename Allocator>
+long BPlusTree<order,Key,Value,Compare,Allocator>::bulkLoadNodeCount(long total, long target, long minCount, long maxCount)
+{
+    long count = (total + target - 1) / target;
+    long lo = (total + maxCount - 1) / maxCount;
+    long hi = std::max(1L, total / minCount);
+    return std::max(lo, std::min(count, hi));
+}
+
+/**
+ * @brief  从已排序的键值对序列自底向上构建B+树（要求树为空）
+ * @param  first 键值对序列的起始迭代器，元素需提供first/second
+ * @param  last 键值对序列的结束迭代器
+ * @param  fillFactor 节点的填充因子，取值(0, 1]，1表示叶子装满
+ * @return int  0表示构建成功，1表示树非空或序列未严格递增
+ */
+template<int order, typename Key, typename Value, typename Compare, typename Allocator>
+template<typename Iterator>
+int BPlusTree<order,Key,Value,Compare,Allocator>::bulkLoad(Iterator first, Iterator last, double fillFactor)
+{
+    if(this->root != nullptr)
+    {
+        return 1;
+    }
+
+    // 先检查序列严格递增，避免构建到一半才发现无序
+    long total = 0;
+    for(Iterator it = first, prev = first; it != last; prev = it, ++it, ++total)
+    {
+        if(total && !this->compare(prev->first, it->first))
+        {
+            return 1;
+        }
+    }
+    if(total == 0)
+    {
+        return 0;
+    }
+
+    fillFactor = std::min(1.0, std::max(fillFactor, 0.0));
+    const long maxKeys = order - 1;
+    const long minKeys = std::max(1, (order - 1) >> 1);
+
+    // 构建叶子层：每个叶子装入target个左右的键值对，并串成双向链表
+    long target = std::max(minKeys, std::min(maxKeys, std::lround(fillFactor * maxKeys)));
+    long count = bulkLoadNodeCount(total, target, minKeys, maxKeys);
+    std::vector<Node*> level;
+    std::vector<Key> lowKeys; // 每个节点子树的下界（截断后的分隔键），作为上一层的分隔键
+    level.reserve(count);
+    lowKeys.reserve(count);
+
+    Iterator it = first;
+    LeafNode* prev = nullptr;
+    for(long i = 0; i < count; i++)
+    {
+        LeafNode* leaf = this->newLeaf();
+        long n = total / count + (i < total % count ? 1 : 0);
+        for(; leaf->n < n; ++it)
+        {
+            leaf->put(leaf->n, it->first, it->second);
+            leaf->n++;
+        }
+        leaf->compact(leaf->n);
+        if(prev)
+        {
+            prev->insertNextNode(leaf);
+        }
+        lowKeys.push_back(prev ? keycompress::Separator<Key,Compare>::between(prev->key(prev->n-1), leaf->key(0))
+                               : leaf->key(0));
+        prev = leaf;
+        level.push_back(leaf);
+    }
+    this->head = level.front()->leaf();
+    this->bulkLoadInner(level, lowKeys, fillFactor, nullptr);
+
+    this->root = level.front();
+    this->size = total;
+    return 0;
+}
+
+/**
+ * @brief  从已排序的键值对序列并行构建B+树（要求树为空）：每个叶子装入的区间可由下标直接算出，
+ *         检查有序、填充叶子、串联链表和构建各层非叶子节点都按下标划分给线程池
+ * @param  first 键值对序列的起始迭代器，须为随机访问迭代器
+ * @param  last 键值对序列的结束迭代器
+ * @param  pool 线程池
+ * @param  fillFactor 节点的填充因子，取值(0, 1]，1表示叶子装满
+ * @return int  0表示构建成功，1表示树非空或序列未严格递增
+ */
+template<int order, typename Key, typename Value, typename Compare, typename Allocator>
+template<typename Iterator>
+int BPlusTree<order,Key,Value,Compare,Allocator>::bulkLoad(Iterator first, Iterator last, ThreadPool& pool, double fillFactor)
+{
+    static_assert(std::is_base_of<std::random_access_iterator_tag, typename std::iterator_traits<Iterator>::iterator_category>::value,
+                  "parallel bulkLoad needs random access iterators");
+    if(this->root != nullptr)
+    {
+        return 1;
+    }
+    const long total = last - first;
+    if(total == 0)
+    {
+        return 0;
+    }
+
+    constexpr size_t GRAIN = 1 << 14;
+    std::atomic<bool> sorted{true};
+    pool.parallelFor(1, total, GRAIN, [&](size_t i)
+    {
+        if(!this->compare(first[i-1].first, first[i].first))
+        {
+            sorted.store(false, std::memory_order_relaxed);
+        }
+    });
+    if(!sorted)
+    {
+        return 1;
+    }
+
+    fillFactor = std::min(1.0, std::max(fillFactor, 0.0));
+    const long maxKeys = order - 1;
+    const long minKeys = std::max(1, (order - 1) >> 1);
+    long target = std::max(minKeys, std::min(maxKeys, std::lround(fillFactor * maxKeys)));
+    long count = bulkLoadNodeCount(total, target, minKeys, maxKeys);
+    std::vector<Node*> level(count);
+    std::vector<Key> lowKeys(count);
+
+    // 第i个叶子装入[start, start + n)，与顺序构建的划分相同
+    pool.parallelFor(0, count, GRAIN / order, [&](size_t i)
+    {
+        long start = i * (total / count) + std::min<long>(i, total % count);
+        long n = total / count + (static_cast<long>(i) < total % count ? 1 : 0);
+        LeafNode* leaf = this->newLeaf();
+        for(; leaf->n < n; leaf->n++)
+        {
+            leaf->put(leaf->n, first[start + leaf->n].first, first[start + leaf->n].second);
+        }
+        leaf->compact(leaf->n);
+        lowKeys[i] = i ? keycompress::Separator<Key,Compare>::between(first[start-1].first, first[start].first)
+                       : first[start].first;
+        level[i] = leaf;
+    });
+    pool.parallelFor(0, count, GRAIN, [&](size_t i)
+    {
+        LeafNode* leaf = level[i]->leaf();
+        leaf->ptr[0] = i > 0 ? level[i-1]->leaf() : nullptr;
+        leaf->ptr[1] = i + 1 < level.size() ? level[i+1]->leaf() : nullptr;
+    });
+    this->head = level.front()->leaf();
+    this->bulkLoadInner(level, lowKeys, fillFactor, &pool);
+
+    this->root = level.front();
+    this->size = total;
+    return 0;
+}
+
+/**
+ * @brief  在已构建的一层节点之上自底向上逐层构建非叶子节点，直到只剩一个根结点
+ * @param  level 最下面一层的节点，返回时只剩根结点
+ * @param  lowKeys 每个节点子树的下界（截断后的分隔键），作为上一层的分隔键
+ * @param  fillFactor 节点的填充因子
+ * @param  pool 不为nullptr时同一层的节点并行构建
+ * @return void
+ */
+template<int order, typename Key, typename Value, typename Compare, typename Allocator>
+void BPlusTree<order,Key,Value,Compare,Allocator>::bulkLoadInner(std::vector<Node*>& level, std::vector<Key>& lowKeys, double fillFactor, ThreadPool* pool)
+{
+    const long maxChildren = order;
+    const long minChildren = std::max(1, (order - 1) >> 1) + 1;
+    const long target = std::max(minChildren, std::min(maxChildren, std::lround(fillFactor * maxChildren)));
+    while(level.size() > 1)
+    {
+        long children = level.size();
+        long count = bulkLoadNodeCount(children, target, minChildren, maxChildren);
+        std::vector<Node*> upper(count);
+        std::vector<Key> upperLowKeys(count);
+
+        // 第i个节点的孩子是level[j, j + c)
+        auto build = [&](size_t i)
+        {
+            long j = i * (children / count) + std::min<long>(i, children % count);
+            long c = children / count + (static_cast<long>(i) < children % count ? 1 : 0);
+            InnerNode* node = this->newInner();
+            upperLowKeys[i] = lowKeys[j];
+            node->ptr[0] = level[j];
+            for(long k = 1; k < c; k++)
+            {
+                node->keys[node->n] = lowKeys[j + k];
+                node->ptr[node->n + 1] = level[j + k];
+                node->n++;
+            }
+            upper[i] = node;
+        };
+        if(pool)
+        {
+            pool->parallelFor(0, count, 1024, build);
+        }
+        else
+        {
+            for(long i = 0; i < count; i++)
+            {
+                build(i);
+            }
+        }
+        level.swap(upper);
+        lowKeys.swap(upperLowKeys);
+    }
+}
+
+/**
+ * @brief  按键序收集所有叶子（需持有smoMutex）：逐层展开非叶子节点，同一层并行复制孩子指针
+ * @param  pool 线程池
+ * @return std::vector<LeafNode*>
+ */
+template<int order, typename Key, typename Value, typename Compare, typename Allocator>
+std::vector<typename BPlusTree<order,Key,Value,Compare,Allocator>::LeafNode*> BPlusTree<order,Key,Value,Compare,Allocator>::collectLeaves(ThreadPool& pool) const
+{
+    std::vector<Node*> level;
+    if(this->root != nullptr)
+    {
+        level.push_back(this->root);
+    }
+    while(!level.empty() && !level.front()->isLeaf())
+    {
+        std::vector<size_t> offsets(level.size() + 1, 0);
+        for(size_t i = 0; i < level.size(); i++)
+        {
+            offsets[i + 1] = offsets[i] + level[i]->n + 1;
+        }
+        std::vector<Node*> next(offsets.back());
+        pool.parallelFor(0, level.size(), 1024, [&](size_t i)
+        {
+            InnerNode* node = level[i]->inner();
+            std::copy(node->ptr, node->ptr + node->n + 1, next.begin() + offsets[i]);
+        });
+        level.swap(next);
+    }
+
+    std::vector<LeafNode*> leaves(level.size());
+    std::transform(level.begin(), level.end(), leaves.begin(), [](Node* node) { return node->leaf(); });
+    return leaves;
+}
+
+/**
+ * @brief  并行遍历所有键值对：持有smoMutex使叶子集合不变，逐个叶子加锁后调用fn
+ * @param  pool 线程池
+ * @param  fn 形如void(const Key&, const Value&)的回调
+ * @return void
+ */
+template<int order, typename Key, typename Value, typename Compare, typename Allocator>
+template<typename Fn>
+void BPlusTree<order,Key,Value,Compare,Allocator>::parallelForEach(ThreadPool& pool, Fn&& fn)
+{
+    std::unique_lock<std::mutex> guard = this->lockSmo();
+    std::vector<LeafNode*> leaves = this->collectLeaves(pool);
+    pool.parallelFor(0, leaves.size(), 64, [&](size_t i)
+    {
+        LeafNode* leaf = leaves[i];
+        leaf->latch.writeLock();
+        for(int j = 0; j < leaf->n; j++)
+        {
+            fn(leaf->key(j), leaf->value(j));
+        }
+        leaf->latch.writeUnlock();
+    });
+}
+
+/**
+ * @brief  并行归约：叶子分成若干段，每段按键序从identity开始累积，段的结果再按键序合并，
+ *         combine只需满足结合律，不要求交换律
+ * @param  pool 线程池
+ * @param  identity 累积的初值
+ * @param  accumulate 形如T(T, const Key&, const Value&)的累积函数
+ * @param  combine 形如T(T, T)的合并函数
+ * @return T
+ */
+template<int order, typename Key, typename Value, typename Compare, typename Allocator>
+template<typename T, typename Accumulate, typename Combine>
+T BPlusTree<order,Key,Value,Compare,Allocator>::parallelReduce(ThreadPool& pool, T identity, Accumulate&& accumulate, Combine&& combine)
+{
+    std::unique_lock<std::mutex> guard = this->lockSmo();
+    std::vector<LeafNode*> leaves = this->collectLeaves(pool);
+    // 段数取线程数的若干倍，线程之间可以窃取剩下的段
+    size_t chunks = std::min(leaves.size(), static_cast<size_t>(pool.size() + 1) * 8);
+    std::vector<T> partial(chunks, identity);
+    pool.parallelFor(0, chunks, 1, [&](size_t c)
+    {
+        size_t begin = leaves.size() * c / chunks;
+        size_t end = leaves.size() * (c + 1) / chunks;
+        T acc = identity;
+        for(size_t i = begin; i < end; i++)
+        {
+            LeafNode* leaf = leaves[i];
+            leaf->latch.writeLock();
+            for(int j = 0; j < leaf->n; j++)
+            {
+                acc = accumulate(std::move(acc), leaf->key(j), leaf->value(j));
+            }
+            leaf->latch.writeUnlock();
+        }
+        partial[c] = std::move(acc);
+    });
+
+    T result = std::move(identity);
+    for(T& part : partial)
+    {
+        result = combine(std::move(result), std::move(part));
+    }
+    return result;
+}
+
+/**
+ * @brief  插入新数据后的维护
+ * @param  path 插入位置的根到叶子路径，路径上受影响的节点均已加写锁
+ * @param  append 最右叶子是否处于连续追加中，此时路径上的节点都在树的最右侧
+ * @param  leafSplit 非零时叶子在该位置分裂，见adjustNodeForUpOver
+ * @return void
+ */
+template<int order,typename Key,typename Value,typename Compare,typename Allocator>
+void BPlusTree<order,Key,Value,Compare,Allocator>::maintainAfterInsert(NodePath& path,bool append,int leafSplit)
+{
+    for(int i = path.depth - 1; i > 0; i--)
+    {
+        Node* node = path.nodes[i];
+        if(!node->isUpOver()) return ;
+        this->adjustNodeForUpOver(node,path.nodes[i-1]->inner(),append,i == path.depth - 1 ? leafSplit : 0);
+    }
+
+    Node* node = path.nodes[0];
+    if(!node->isUpOver()) return ;
+    InnerNode* parent = this->newInner();
+    parent->ptr[0] = node;
+    this->adjustNodeForUpOver(node, parent, append, path.depth == 1 ? leafSplit : 0);
+    // 新根构造完成后再发布
+    this->root = parent;
+    this->counters.add(treestats::ROOT_SPLIT);
+}
+
+/**
+ * @brief  调整上溢出节点
+ * @param  node 上溢出节点
+ * @param  parent 上溢出节点的父亲
+ * @param  append 为true时偏斜分裂：顺序追加时左节点不会再收到新键，装到约90%，右节点留给后续追加；
+ *         此时最右节点可以暂时低于下溢出界限，后续追加会补足它，删除其中的键时由借位或合并调整
+ * @param  split 非零时直接作为左节点保留的键数，批量插入据此在一段连续键的插入位置分裂叶子
+ * @return void
+ */
+template<int order,typename Key,typename Value,typename Compare,typename Allocator>
+void BPlusTree<order,Key,Value,Compare,Allocator>::adjustNodeForUpOver(Node *node,InnerNode* parent,bool append,int split){
+    // For node As LeafNode
+    // parent:        ...  ...                   ... mid ...
+    //                   /           =====>         /   | 
+    // node:      [left] mid [right]           [left] mid:[right]
+    // For node As Node
+    // parent:        ...  ...                   ... mid ...
+    //                   /           =====>         /   | 
+    // node:      [left] mid [right]           [left] [right]
+    //
+    // 叶子右半边保留order-mid个键，非叶子节点上移keys[mid]后右半边保留order-mid-1个键；
+    // 偏斜分裂时mid不超过order-2，两种节点的右半边都至少有一个键
+    int mid = order>>1;
+    if(split > 0)
+    {
+        mid = split;
+    }
+    else if(append)
+    {
+        mid = std::max(mid, (order-1)*9/10);
+    }
+    Key key;
+    Node *rightChild;
+    if(node->isLeaf())
+    {
+        LeafNode* right = this->newLeaf();
+        this->preserve(node->leaf());
+        node->leaf()->split(right,mid);
+        rightChild = right;
+        this->counters.add(treestats::LEAF_SPLIT);
+        // 叶子的分隔键截断为能区分左右两半的最短键
+        key = keycompress::Separator<Key,Compare>::between(node->leaf()->key(node->n-1), right->key(0));
+    }
+    else
+    {
+        InnerNode* right = this->newInner();
+        key = node->inner()->keys[mid];
+        node->inner()->split(right,mid);
+        rightChild = right;
+        this->counters.add(treestats::INNER_SPLIT);
+    }
+    parent->insert(key,rightChild,this->compare);
+}
+
+/**
+ * @brief  根据键删除数据
+ * @param  key 要被删除的数据的键
+ * @return int  0表示删除成功，1表示键不存在，删除失败
+ */
+template<int order,typename Key,typename Value,typename Compare,typename Allocator>
+int BPlusTree<order,Key,Value,Compare,Allocator>::remove(Key key)
+{
+    {
+        // 快速路径不持有smoMutex，经过的节点可能被并发摘除，需要登记纪元
+        epoch::Domain::Guard guard = this->pin();
+        bool isRoot;
+        LeafNode *node = this->lockLeafForWrite(key, isRoot);
+        if(node == nullptr)
+        {
+            return 1;
+        }
+
+        if(!node->hasKey(key,this->compare))
+        {
+            node->latch.writeUnlock();
+            return 1;
+        }
+
+        // 删除后不会下溢出，只需修改叶子本身；根叶子被删空时需要换根
+        if(node->n - 1 >= this->minLeafKeys(isRoot))
+        {
+            this->preserve(node);
+            node->remove(key,this->compare);
+            node->latch.writeUnlock();
+            this->size--;
+            return 0;
+        }
+        node->latch.writeUnlock();
+    }
+    return this->removeWithRebalance(key);
+}
+
+/**
+ * @brief  删除可能引起借位或合并的数据：锁住会被波及的路径及兄弟节点后再删除
+ * @param  key 要被删除的数据的键
+ * @return int  0表示删除成功，1表示键不存在，删除失败
+ */
+template<int order,typename Key,typename Value,typename Compare,typename Allocator>
+int BPlusTree<order,Key,Value,Compare,Allocator>::removeWithRebalance(Key key)
+{
+    std::unique_lock<std::mutex> guard = this->lockSmo();
+    if(this->root == nullptr)
+    {
+        return 1;
+    }
+    return this->rebalanceLeaf(key, true);
+}
+
+/**
+ * @brief  锁住含有key的叶子被借位、合并时会波及的路径及兄弟节点，然后调整下溢出的叶子（需持有smoMutex且根结点存在）
+ * @param  key 定位叶子的键
+ * @param  erase true时先删除key；false时只在叶子已下溢出时调整
+ * @return int  0表示完成，1表示key不存在或叶子没有下溢出
+ */
+template<int order,typename Key,typename Value,typename Compare,typename Allocator>
+int BPlusTree<order,Key,Value,Compare,Allocator>::rebalanceLeaf(const Key& key, bool erase)
+{
+    NodePath path;
+    this->descendPath(key, path);
+
+    // 自下而上找到少一个键后不会下溢出的祖先（根结点只在被删空时换根），它以下的节点都可能借位或合并
+    int top = path.depth - 2;
+    while(top >= 0 && (top == 0 ? path.nodes[top]->n <= 1 : path.nodes[top]->n - 1 < ((order-1)>>1)))
+    {
+        top--;
+    }
+
+    LatchSet latches;
+    if(top < 0)
+    {
+        latches.lockRoot(this->rootLatch);
+    }
+    for(int i = std::max(top, 0); i < path.depth; i++)
+    {
+        latches.lock(path.nodes[i]);
+    }
+    for(int i = std::max(top + 1, 1); i < path.depth; i++)
+    {
+        InnerNode* parent = path.nodes[i-1]->inner();
+        int arg = path.slots[i-1];
+        latches.lock(arg > 0 ? parent->ptr[arg-1] : nullptr);
+        latches.lock(arg < parent->n ? parent->ptr[arg+1] : nullptr);
+    }
+
+    LeafNode *node = path.nodes[path.depth - 1]->leaf();
+    if(path.depth > 1)
+    {
+        // 叶子合并会修改被合并节点的后继叶子的ptr[0]
+        InnerNode* parent = path.nodes[path.depth - 2]->inner();
+        int arg = path.slots[path.depth - 2];
+        if(arg > 0)
+        {
+            latches.lock(node->ptr[1]);
+        }
+        else if(arg < parent->n)
+        {
+            latches.lock(parent->ptr[arg+1]->leaf()->ptr[1]);
+        }
+    }
+
+    // 加锁前叶子可能已被其他写者修改，以加锁后的状态为准
+    if(erase ? !node->hasKey(key,this->compare) : !node->isDownOver())
+    {
+        latches.releaseAll();
+        return 1;
+    }
+
+    if(erase)
+    {
+        this->preserve(node);
+        node->remove(key,this->compare);
+    }
+    this->maintainAfterRemove(path);
+    latches.releaseAll();
+    if(erase)
+    {
+        this->size--;
+    }
+
+    // 逐层加锁模式下没有无锁读者，只有快照会推迟回收
+    this->reclaim();
+    return 0;
+}
+
+/**
+ * @brief  删除后叶子至少保留的键数：根叶子和延迟合并模式下为1，否则为下溢出的界限
+ * @param  isRoot 叶子是否为根结点
+ * @return int
+ */
+template<int order,typename Key,typename Value,typename Compare,typename Allocator>
+int BPlusTree<order,Key,Value,Compare,Allocator>::minLeafKeys(bool isRoot) const
+{
+    return isRoot || this->lazyRemove ? 1 : ((order-1)>>1);
+}
+
+/**
+ * @brief  合并延迟删除留下的下溢出叶子：先沿叶子链表收集它们的首键，再逐个定位并借位或合并，
+ *         每个叶子单独持有smoMutex，期间不阻塞叶子内的插入和删除
+ * @return int  借位、合并的次数
+ */
+template<int order,typename Key,typename Value,typename Compare,typename Allocator>
+int BPlusTree<order,Key,Value,Compare,Allocator>::compact()
+{
+    std::vector<Key> underfull;
+    {
+        // 持有smoMutex时叶子链表不会变化，每个叶子加锁读取
+        std::unique_lock<std::mutex> guard = this->lockSmo();
+        Node* root = this->root;
+        if(root == nullptr || root->isLeaf())
+        {
+            return 0;
+        }
+        for(LeafNode* leaf = this->head; leaf != nullptr; )
+        {
+            leaf->latch.writeLock();
+            if(leaf->isDownOver())
+            {
+                underfull.push_back(leaf->key(0));
+            }
+            LeafNode* next = leaf->ptr[1];
+            leaf->latch.writeUnlock();
+            leaf = next;
+        }
+    }
+
+    // 之前的合并可能已经补足后面的叶子，rebalanceLeaf会按加锁后的状态跳过它们；
+    // 和同样稀疏的兄弟合并后可能仍然下溢出，重复调整直到含有key的叶子不再下溢出
+    int repaired = 0;
+    for(const Key& key : underfull)
+    {
+        for(;;)
+        {
+            std::unique_lock<std::mutex> guard = this->lockSmo();
+            Node* root = this->root;
+            if(root == nullptr || root->isLeaf() || this->rebalanceLeaf(key, false) != 0)
+            {
+                break;
+            }
+            repaired++;
+        }
+    }
+    return repaired;
+}
+
+/**
+ * @brief  加锁smoMutex，开启统计时记录锁已被其他线程持有、需要等待的次数
+ * @return std::unique_lock<std::mutex>
+ */
+template<int order,typename Key,typename Value,typename Compare,typename Allocator>
+std::unique_lock<std::mutex> BPlusTree<order,Key,Value,Compare,Allocator>::lockSmo()
+{
+    if constexpr(treestats::ENABLED)
+    {
+        std::unique_lock<std::mutex> lock(this->smoMutex, std::try_to_lock);
+        if(!lock.owns_lock())
+        {
+            this->counters.add(treestats::SMO_WAIT);
+            lock.lock();
+        }
+        return lock;
+    }
+    else
+    {
+        return std::unique_lock<std::mutex>(this->smoMutex);
+    }
+}
+
+/**
+ * @brief  统计快照：持有smoMutex逐层遍历树（期间没有结构修改），逐个加锁读取叶子的键数
+ * @return treestats::Snapshot
+ */
+template<int order,typename Key,typename Value,typename Compare,typename Allocator>
+treestats::Snapshot BPlusTree<order,Key,Value,Compare,Allocator>::stats()
+{
+    treestats::Snapshot snapshot;
+    std::unique_lock<std::mutex> guard = this->lockSmo();
+
+    std::vector<Node*> level;
+    std::size_t heapBytes = 0;
+    if(this->root != nullptr)
+    {
+        level.push_back(this->root);
+    }
+    while(!level.empty())
+    {
+        std::vector<Node*> next;
+        snapshot.nodesPerLevel.push_back(level.size());
+        for(Node* node : level)
+        {
+            if(node->isLeaf())
+            {
+                node->latch.writeLock();
+                int n = node->n;
+                heapBytes += node->leaf()->heapBytes();
+                node->latch.writeUnlock();
+                snapshot.leafNodes++;
+                snapshot.leafFill[treestats::fillBucket(n, order - 1)]++;
+                snapshot.leafFillSum += static_cast<double>(n) / (order - 1);
+            }
+            else
+            {
+                snapshot.innerNodes++;
+                snapshot.innerFill[treestats::fillBucket(node->n, order - 1)]++;
+                snapshot.innerFillSum += static_cast<double>(node->n) / (order - 1);
+                for(int i = 0; i <= node->n; i++)
+                {
+                    next.push_back(node->inner()->ptr[i]);
+                }
+            }
+        }
+        level.swap(next);
+    }
+
+    snapshot.height = snapshot.nodesPerLevel.size();
+    snapshot.size = this->size;
+    snapshot.retiredNodes = this->retiredNodes.size();
+    snapshot.memoryBytes = snapshot.leafNodes * sizeof(LeafNode) + snapshot.innerNodes * sizeof(InnerNode) + heapBytes;
+    for(auto& retired : this->retiredNodes)
+    {
+        Node* node = retired.second;
+        snapshot.memoryBytes += node->isLeaf() ? sizeof(LeafNode) : sizeof(InnerNode);
+    }
+    for(int i = 0; i < treestats::EVENT_COUNT; i++)
+    {
+        snapshot.events[i] = this->counters.get(i);
+    }
+    return snapshot;
+}
+
+/**
+ * @brief  写者第一次修改创建快照前就存在的叶子之前，把叶子原来的内容交给需要它的快照保存（需持有叶子的写锁）
+ * @param  leaf 将被修改、分裂、合并或摘除的叶子
+ * @return void
+ */
+template<int order,typename Key,typename Value,typename Compare,typename Allocator>
+void BPlusTree<order,Key,Value,Compare,Allocator>::preserve(LeafNode* leaf)
+{
+    uint64_t current = this->snapshotEpoch.load(std::memory_order_acquire);
+    if(leaf->cowEpoch >= current)
+    {
+        return;
+    }
+    std::lock_guard<std::mutex> registry(this->snapshotMutex);
+    for(Snapshot* snapshot : this->snapshots)
+    {
+        // 叶子上次保存之后创建的快照还看着它修改前的内容
+        if(snapshot->epoch > leaf->cowEpoch)
+        {
+            typename Snapshot::LeafImage& image = snapshot->preserved[leaf];
+            leaf->copyTo(image.keys, image.values);
+        }
+    }
+    leaf->cowEpoch = current;
+}
+
+/**
+ * @brief  创建当前时刻的只读快照：持有smoMutex并锁住所有叶子，只记录叶子序列和各叶子的最小键
+ * @return Snapshot*  由调用者delete，须在树之前销毁
+ */
+template<int order,typename Key,typename Value,typename Compare,typename Allocator>
+typename BPlusTree<order,Key,Value,Compare,Allocator>::Snapshot* BPlusTree<order,Key,Value,Compare,Allocator>::snapshot()
+{
+    Snapshot* snapshot = new Snapshot(this);
+    std::unique_lock<std::mutex> guard = this->lockSmo();
+
+    // 没有结构修改时叶子链表不变；全部叶子锁住后没有写者能修改其中任何一个
+    std::vector<LeafNode*> locked;
+    for(LeafNode* leaf = this->root ? this->head : nullptr; leaf != nullptr; leaf = leaf->ptr[1])
+    {
+        leaf->latch.writeLock();
+        locked.push_back(leaf);
+        if(leaf->n > 0)
+        {
+            snapshot->leaves.push_back(leaf);
+            snapshot->lowKeys.push_back(leaf->key(0));
+            snapshot->count += leaf->n;
+        }
+    }
+    {
+        std::lock_guard<std::mutex> registry(this->snapshotMutex);
+        snapshot->epoch = this->snapshotEpoch.load(std::memory_order_relaxed) + 1;
+        snapshot->pin = this->readers.current();
+        this->snapshotEpoch.store(snapshot->epoch, std::memory_order_release);
+        this->snapshots.push_back(snapshot);
+    }
+    for(LeafNode* leaf : locked)
+    {
+        leaf->latch.writeUnlock();
+    }
+    return snapshot;
+}
+
+template<int order,typename Key,typename Value,typename Compare,typename Allocator>
+BPlusTree<order,Key,Value,Compare,Allocator>::Snapshot::~Snapshot()
+{
+    std::lock_guard<std::mutex> registry(this->tree->snapshotMutex);
+    auto& snapshots = this->tree->snapshots;
+    snapshots.erase(std::find(snapshots.begin(), snapshots.end(), this));
+}
+
+/**
+ * @brief  第i个叶子在快照时刻的内容
+ * @param  i 叶子在快照叶子序列中的下标
+ * @param  scratch 叶子未被修改时复制到这里
+ * @return const LeafImage&  scratch或快照保存的原内容
+ */
+template<int order,typename Key,typename Value,typename Compare,typename Allocator>
+const typename BPlusTree<order,Key,Value,Compare,Allocator>::Snapshot::LeafImage&
+BPlusTree<order,Key,Value,Compare,Allocator>::Snapshot::image(size_t i, LeafImage& scratch) const
+{
+    LeafNode* leaf = this->leaves[i];
+    leaf->latch.readLockShared();
+    if(leaf->cowEpoch < this->epoch)
+    {
+        leaf->copyTo(scratch.keys, scratch.values);
+        leaf->latch.readUnlockShared();
+        return scratch;
+    }
+    leaf->latch.readUnlockShared();
+
+    // 叶子已被修改过，修改前写者已把原内容存入preserved；元素插入后不再变化，引用在快照销毁前有效
+    std::lock_guard<std::mutex> registry(this->tree->snapshotMutex);
+    return this->preserved.find(leaf)->second;
+}
+
+/**
+ * @brief  可能含有key的叶子在快照叶子序列中的下标（快照非空）
+ * @param  key 键值
+ * @return size_t
+ */
+template<int order,typename Key,typename Value,typename Compare,typename Allocator>
+size_t BPlusTree<order,Key,Value,Compare,Allocator>::Snapshot::leafIndex(const Key& key) const
+{
+    auto it = std::upper_bound(this->lowKeys.begin(), this->lowKeys.end(), key, this->tree->compare);
+    return it == this->lowKeys.begin() ? 0 : it - this->lowKeys.begin() - 1;
+}
+
+/**
+ * @brief  在快照中查找数据
+ * @param  key 要查找的键
+ * @return std::optional<Value>  快照时刻键对应的值，键不存在时为空
+ */
+template<int order,typename Key,typename Value,typename Compare,typename Allocator>
+std::optional<Value> BPlusTree<order,Key,Value,Compare,Allocator>::Snapshot::get(const Key& key) const
+{
+    if(this->leaves.empty())
+    {
+        return std::nullopt;
+    }
+    LeafImage scratch;
+    const LeafImage& leaf = this->image(this->leafIndex(key), scratch);
+    auto it = std::lower_bound(leaf.keys.begin(), leaf.keys.end(), key, this->tree->compare);
+    if(it == leaf.keys.end() || this->tree->compare(key, *it))
+    {
+        return std::nullopt;
+    }
+    return leaf.values[it - leaf.keys.begin()];
+}
+
+template<int order,typename Key,typename Value,typename Compare,typename Allocator>
+template<typename Fn>
+void BPlusTree<order,Key,Value,Compare,Allocator>::Snapshot::forEach(Fn&& fn) const
+{
+    LeafImage scratch;
+    for(size_t i = 0; i < this->leaves.size(); i++)
+    {
+        const LeafImage& leaf = this->image(i, scratch);
+        for(size_t j = 0; j < leaf.keys.size(); j++)
+        {
+            fn(leaf.keys[j], leaf.values[j]);
+        }
+    }
+}
+
+template<int order,typename Key,typename Value,typename Compare,typename Allocator>
+template<typename Fn>
+void BPlusTree<order,Key,Value,Compare,Allocator>::Snapshot::range(const Key& lo, const Key& hi, Fn&& fn) const
+{
+    if(this->leaves.empty())
+    {
+        return;
+    }
+    LeafImage scratch;
+    for(size_t i = this->leafIndex(lo); i < this->leaves.size(); i++)
+    {
+        const LeafImage& leaf = this->image(i, scratch);
+        auto it = std::lower_bound(leaf.keys.begin(), leaf.keys.end(), lo, this->tree->compare);
+        for(size_t j = it - leaf.keys.begin(); j < leaf.keys.size(); j++)
+        {
+            if(!this->tree->compare(leaf.keys[j], hi))
+            {
+                return;
+            }
+            fn(leaf.keys[j], leaf.values[j]);
+        }
+    }
+}
+
+/**
+ * @brief  按BPlusTree::serialize的格式写出快照时刻的全部键值对
+ * @param  out 输出流
+ * @param  compressKeys 是否差分编码有序的键
+ * @return void
+ */
+template<int order,typename Key,typename Value,typename Compare,typename Allocator>
+void BPlusTree<order,Key,Value,Compare,Allocator>::Snapshot::serialize(std::ostream& out, bool compressKeys) const
+{
+    writeStream(out, this->count, compressKeys, [this](auto&& fn) { this->forEach(fn); });
+}
+
+/**
+ * @brief  根据键查找数据
+ * @param  key 要查找的键
+ * @return FindResult  指向叶子节点中值的指针，键不存在时返回nullptr；
+ *         指针只在下一次修改树之前有效，并发场景请使用get。槽页叶子中没有值对象，返回值的拷贝（std::optional）
+ */
+template<int order,typename Key,typename Value,typename Compare,typename Allocator>
+typename BPlusTree<order,Key,Value,Compare,Allocator>::FindResult BPlusTree<order,Key,Value,Compare,Allocator>::find(const Key& key) const
+{
+    FindResult result{};
+    this->readLeaf(key, [&](LeafNode* leaf)
+    {
+        result = FindResult{};
+        if(leaf == nullptr)
+        {
+            return;
+        }
+
+        int arg = leaf->search(key,this->compare);
+        if(arg < leaf->n && leaf->keyEquals(arg, key))
+        {
+            if constexpr(SLOTTED_LEAVES)
+            {
+                result = leaf->value(arg);
+            }
+            else
+            {
+                result = &leaf->values[arg];
+            }
+        }
+    });
+    return result;
+}
+
+/**
+ * @brief  根据键查找数据，拷贝出的值经过版本校验，可在并发修改下使用
+ * @param  key 要查找的键
+ * @return std::optional<Value>  键不存在时为空
+ */
+template<int order,typename Key,typename Value,typename Compare,typename Allocator>
+std::optional<Value> BPlusTree<order,Key,Value,Compare,Allocator>::get(const Key& key) const
+{
+    std::optional<Value> result;
+    this->readLeaf(key, [&](LeafNode* leaf)
+    {
+        result.reset();
+        if(leaf == nullptr)
+        {
+            return;
+        }
+
+        int arg = leaf->search(key,this->compare);
+        if(arg < leaf->n && leaf->keyEquals(arg, key))
+        {
+            result = leaf->value(arg);
+        }
+    });
+    return result;
 }
 
 /**
- * @brief  插入新数据后的维护
- * @param  nodePathStack 保存了因为插入而受到影响的节点的栈
- * @return void
+ * @brief  判断树中是否含有key
+ * @param  key 要查找的键
+ * @return bool
  */
-template<int order,typename Key,typename Value,typename Compare>
-void BPlusTree<order,Key,Value,Compare>::maintainAfterInsert(std::stack<Node*>& nodePathStack)
+template<int order,typename Key,typename Value,typename Compare,typename Allocator>
+bool BPlusTree<order,Key,Value,Compare,Allocator>::contains(const Key& key) const
 {
-    Node *node,*parent;
-    node = nodePathStack.top();nodePathStack.pop();
-    while(!nodePathStack.empty()){
-        parent = nodePathStack.top();nodePathStack.pop();
-        if(!node->isUpOver()) return ;
-        this->adjustNodeForUpOver(node,parent);
-        node = parent;
-    }
-    if(!node->isUpOver()) return ;
-    this->root = new Node(false);
-    parent = this->root;
-    parent->ptr[0] = node;
-    this->adjustNodeForUpOver(node, parent);
+    bool found = false;
+    this->readLeaf(key, [&](LeafNode* leaf)
+    {
+        found = leaf != nullptr && leaf->hasKey(key,this->compare);
+    });
+    return found;
 }
 
 /**
- * @brief  调整上溢出节点
- * @param  node 上溢出节点
- * @param  parent 上溢出节点的父亲
- * @return void
+ * @brief  沿最右孩子下降找到最后一个叶子节点
+ * @return Node* 最后一个叶子节点，树为空时返回nullptr
  */
-template<int order,typename Key,typename Value,typename Compare>
-void BPlusTree<order,Key,Value,Compare>::adjustNodeForUpOver(Node *node,Node* parent){
-    // For node As LeafNode
-    // parent:        ...  ...                   ... mid ...
-    //                   /           =====>         /   | 
-    // node:      [left] mid [right]           [left] mid:[right]
-    // For node As Node
-    // parent:        ...  ...                   ... mid ...
-    //                   /           =====>         /   | 
-    // node:      [left] mid [right]           [left] [right]
-    //
-    int mid = (order>>1);
-    Key key = node->keys[mid];
-    Node *rightChild = node->split();
-    parent->insert(key,rightChild,this->compare);
+template<int order,typename Key,typename Value,typename Compare,typename Allocator>
+typename BPlusTree<order,Key,Value,Compare,Allocator>::LeafNode* BPlusTree<order,Key,Value,Compare,Allocator>::lastLeaf() const
+{
+    Node* node = this->root;
+    while(node && !node->isLeaf())
+    {
+        node = node->inner()->ptr[node->n];
+    }
+    return node ? node->leaf() : nullptr;
 }
 
 /**
- * @brief  根据键删除数据
- * @param  key 要被删除的数据的键
- * @return int  0表示删除成功，1表示键不存在，删除失败
+ * @brief  定位第一个大于等于key的位置
+ * @param  key 键值
+ * @return const_iterator 不存在时返回end()
  */
-template<int order,typename Key,typename Value,typename Compare>
-int BPlusTree<order,Key,Value,Compare>::remove(Key key)
+template<int order,typename Key,typename Value,typename Compare,typename Allocator>
+typename BPlusTree<order,Key,Value,Compare,Allocator>::const_iterator BPlusTree<order,Key,Value,Compare,Allocator>::lower_bound(const Key& key) const
 {
-    if(this->root == nullptr)
+    LeafNode* node = nullptr;
+    int arg = 0;
+    this->readLeaf(key, [&](LeafNode* leaf)
     {
-        return 1;
-    }
-
-    std::stack<Node*> nodePathStack = this->findNodeByKey(key);
-    Node *node =nodePathStack.top();
+        node = leaf;
+        arg = leaf ? leaf->search(key,this->compare) : 0;
+    });
+    return const_iterator(this, node, arg);
+}
 
-    // 加上独占锁
-    std::unique_lock<std::shared_mutex> lock(node->mtx);
-    if(!node->hasKey(key,this->compare))
+/**
+ * @brief  定位第一个大于key的位置
+ * @param  key 键值
+ * @return const_iterator 不存在时返回end()
+ */
+template<int order,typename Key,typename Value,typename Compare,typename Allocator>
+typename BPlusTree<order,Key,Value,Compare,Allocator>::const_iterator BPlusTree<order,Key,Value,Compare,Allocator>::upper_bound(const Key& key) const
+{
+    const_iterator it = this->lower_bound(key);
+    if(it != this->end() && !this->compare(key, it.key()))
     {
-        return 1;
+        ++it;
     }
-
-    node->remove(key,this->compare);
-    this->maintainAfterRemove(nodePathStack);
-    this->size--;
-
-    return 0;
+    return it;
 }
 
-
-
-
-
-
-
-
-
-
 /**
- * @brief  根据键删除数据
- * @param  key 要被删除的数据的键
- * @return int  0表示删除成功，1表示键不存在，删除失败
+ * @brief  区间扫描
+ * @param  lo 区间下界（包含）
+ * @param  hi 区间上界（不包含）
+ * @return Range 覆盖[lo, hi)内所有键的迭代器区间
  */
-// template<int order,typename Key,typename Value,typename Compare>
-// int BPlusTree<order,Key,Value,Compare>::find(Key key)
-// {
-//     return search_recursive(root, key);
-// }
-
-
-
-
-
-
+template<int order,typename Key,typename Value,typename Compare,typename Allocator>
+typename BPlusTree<order,Key,Value,Compare,Allocator>::Range BPlusTree<order,Key,Value,Compare,Allocator>::range(const Key& lo, const Key& hi) const
+{
+    if(!this->compare(lo, hi))
+    {
+        return Range{this->end(), this->end()};
+    }
+    return Range{this->lower_bound(lo), this->lower_bound(hi)};
+}
 
 /**
  * @brief  删除数据后的维护
- * @param  nodePathStack 保存了因为删除而受到影响的节点的栈
+ * @param  path 删除位置的根到叶子路径，路径上受影响的节点及其兄弟均已加写锁
  * @return void
  */
-template<int order,typename Key,typename Value,typename Compare>
-void BPlusTree<order,Key,Value,Compare>::maintainAfterRemove(std::stack<Node*>& nodePathStack){
-    Node *node,*parent;
-    node = nodePathStack.top();nodePathStack.pop();
-    while(!nodePathStack.empty())
+template<int order,typename Key,typename Value,typename Compare,typename Allocator>
+void BPlusTree<order,Key,Value,Compare,Allocator>::maintainAfterRemove(NodePath& path){
+    for(int i = path.depth - 1; i > 0; i--)
     {
-        parent = nodePathStack.top();nodePathStack.pop();
+        Node* node = path.nodes[i];
         if(!node->isDownOver())
         {
             return;
         }
 
-        this->adjustNodeForDownOver(node,parent);
-        node = parent;   
+        this->adjustNodeForDownOver(node,path.nodes[i-1]->inner(),path.slots[i-1]);
     }
-    if(this->root->n)
+
+    Node* node = path.nodes[0];
+    if(node->n)
     {
         return;
     }
 
-    if(!this->root->isLeaf())
+    if(!node->isLeaf())
     {
-        this->root = node->ptr[0];
+        this->root = node->inner()->ptr[0];
+        this->counters.add(treestats::ROOT_COLLAPSE);
     }
 	else
     {
 		this->root = nullptr;
 		this->head = nullptr;
     }
-    delete node;
+    this->retire(node);
 }
 
 /**
  * @brief  调整下溢出节点
  * @param  node 下溢出的节点
  * @param  parent 下溢出节点的父亲
+ * @param  arg node在parent中的孩子下标
  * @return void
  */
-template<int order,typename Key,typename Value,typename Compare>
-void BPlusTree<order,Key,Value,Compare>::adjustNodeForDownOver(Node *node,Node* parent)
+template<int order,typename Key,typename Value,typename Compare,typename Allocator>
+void BPlusTree<order,Key,Value,Compare,Allocator>::adjustNodeForDownOver(Node *node,InnerNode* parent,int arg)
 {
     int mid = ((order-1)>>1);
-	int arg = -1;
-	if(node->n) 
-    {
-        arg = parent->search(node->keys[0],this->compare);
-    }
-	else while(parent->ptr[++arg]!=node);	
     Node* left = arg > 0 ? parent->ptr[arg-1] : nullptr;
     Node* right = arg < parent->n ? parent->ptr[arg+1] : nullptr;
     // case 1: 左兄弟或右兄弟可以借出一个数据
@@ -557,15 +2952,21 @@ void BPlusTree<order,Key,Value,Compare>::adjustNodeForDownOver(Node *node,Node*
         {
             if(node->isLeaf())
             {
-                node->insert(left->keys[left->n-1],left->values[left->n-1],this->compare);
+                this->preserve(node->leaf());
+                this->preserve(left->leaf());
+                LeafNode* from = left->leaf();
+                node->leaf()->insert(from->key(from->n-1),from->value(from->n-1),this->compare);
+                from->remove(from->key(from->n-1), this->compare);
+                parent->keys[arg-1] = keycompress::Separator<Key,Compare>::between(from->key(from->n-1), node->leaf()->key(0));
             }
             else
             {
-                node->insert(parent->keys[arg-1],node->ptr[0],this->compare);
-                node->ptr[0] = left->ptr[left->n];
+                node->inner()->insert(parent->keys[arg-1],node->inner()->ptr[0],this->compare);
+                node->inner()->ptr[0] = left->inner()->ptr[left->n];
+                parent->keys[arg-1] = left->inner()->keys[left->n-1];
+                left->remove(left->inner()->keys[left->n-1], this->compare);
             }
-            parent->keys[arg-1] = left->keys[left->n-1];
-            left->remove(left->keys[left->n-1], this->compare);
+            parent->dirty = true;
         }
 
         // 右兄弟借出一个数据
@@ -581,18 +2982,24 @@ void BPlusTree<order,Key,Value,Compare>::adjustNodeForDownOver(Node *node,Node*
         {
             if(node->isLeaf())
             {
-                node->insert(right->keys[0],right->values[0],this->compare);
-				right->remove(right->keys[0],this->compare);
-				parent->keys[arg] = right->keys[0];
+                this->preserve(node->leaf());
+                this->preserve(right->leaf());
+                LeafNode* from = right->leaf();
+                node->leaf()->insert(from->key(0),from->value(0),this->compare);
+				from->remove(from->key(0),this->compare);
+				parent->keys[arg] = keycompress::Separator<Key,Compare>::between(node->leaf()->key(node->n-1), from->key(0));
+                parent->dirty = true;
             }
             else
             {
-                node->insert(parent->keys[arg],right->ptr[0],this->compare);
-                right->ptr[0] = right->ptr[1];
-				parent->keys[arg] = right->keys[0];
-				right->remove(right->keys[0],this->compare);
+                node->inner()->insert(parent->keys[arg],right->inner()->ptr[0],this->compare);
+                right->inner()->ptr[0] = right->inner()->ptr[1];
+				parent->keys[arg] = right->inner()->keys[0];
+                parent->dirty = true;
+				right->remove(right->inner()->keys[0],this->compare);
             }            
         }
+        this->counters.add(node->isLeaf() ? treestats::LEAF_BORROW : treestats::INNER_BORROW);
         return;
     }
 
@@ -611,14 +3018,18 @@ void BPlusTree<order,Key,Value,Compare>::adjustNodeForDownOver(Node *node,Node*
         Key key = parent->keys[arg-1];
         if(left->isLeaf())
         {
-            left->merge(node);
+            this->preserve(left->leaf());
+            left->leaf()->merge(node->leaf());
+            this->counters.add(treestats::LEAF_MERGE);
         }
         else 
         {
-            left->merge(key,node);
+            left->inner()->merge(key,node->inner());
+            this->counters.add(treestats::INNER_MERGE);
         }
 
         parent->remove(key,this->compare);
+        this->retire(node);
     }
     else if(right)
     {
@@ -634,14 +3045,18 @@ void BPlusTree<order,Key,Value,Compare>::adjustNodeForDownOver(Node *node,Node*
         Key key = parent->keys[arg];
         if(node->isLeaf())
         {
-            node->merge(right);
+            this->preserve(node->leaf());
+            node->leaf()->merge(right->leaf());
+            this->counters.add(treestats::LEAF_MERGE);
         }
         else
         {
-            node->merge(key,right);
+            node->inner()->merge(key,right->inner());
+            this->counters.add(treestats::INNER_MERGE);
         }
 
         parent->remove(key,this->compare);
+        this->retire(right);
     }
 }
 
@@ -649,17 +3064,15 @@ void BPlusTree<order,Key,Value,Compare>::adjustNodeForDownOver(Node *node,Node*
  * @brief  B+树的叶子节点层的遍历
  * @return void
  */
-template<int order, typename Key, typename Value, typename Compare>
-void BPlusTree<order, Key, Value, Compare>::leafTraversal()
+template<int order, typename Key, typename Value, typename Compare, typename Allocator>
+void BPlusTree<order, Key, Value, Compare, Allocator>::leafTraversal()
 {
-    Node* p = this->head;
+    LeafNode* p = this->head;
     while(p)
     {
-        // 加上共享锁
-        std::shared_lock<std::shared_mutex> lock(p->mtx);
         for(int i = 0;i < p->n; i++)
         {
-            std::cout << p->keys[i] << ' ';
+            std::cout << p->key(i) << ' ';
         }
         std::cout << "| ";
 
@@ -675,8 +3088,8 @@ void BPlusTree<order, Key, Value, Compare>::leafTraversal()
  * @brief  B+树的层序遍历
  * @return void
  */
-template<int order,typename Key,typename Value,typename Compare>
-void BPlusTree<order, Key, Value, Compare>::levelOrderTraversal()
+template<int order,typename Key,typename Value,typename Compare,typename Allocator>
+void BPlusTree<order, Key, Value, Compare, Allocator>::levelOrderTraversal()
 {
     std::queue<Node*> q;
     q.push(this->root);
@@ -690,9 +3103,6 @@ void BPlusTree<order, Key, Value, Compare>::levelOrderTraversal()
         {
             Node *node = q.front();
 
-            // 加上共享锁
-            std::shared_lock<std::shared_mutex> lock(node->mtx);
-
             q.pop();
             if(!node)
             {
@@ -704,17 +3114,18 @@ void BPlusTree<order, Key, Value, Compare>::levelOrderTraversal()
             // 打印该节点的关键字
             for(i = 0; i< node->n; i++)
             {
-                std::cout << node->keys[i] << " ";
+                if(node->isLeaf()) std::cout << node->leaf()->key(i) << " ";
+                else std::cout << node->inner()->keys[i] << " ";
                 if(!node->isLeaf()) 
                 {
-                    q.push(node->ptr[i]);
+                    q.push(node->inner()->ptr[i]);
                 }
             }
 			std::cout << "| ";
 
             if(!node->isLeaf())
             {
-                q.push(node->ptr[i]);
+                q.push(node->inner()->ptr[i]);
             }
         }
 
@@ -724,66 +3135,194 @@ void BPlusTree<order, Key, Value, Compare>::levelOrderTraversal()
 }
 
 /**
- * @brief 序列化整个B+树到输出流
+ * @brief 序列化整个B+树到输出流：按键序写出所有键值对，读入时直接装满叶子并自底向上构建
  * @param out 输出流（可以是文件、内存等）
+ * @param compressKeys 是否差分编码有序的键
  */
-template<int order, typename Key, typename Value, typename Compare>
-void BPlusTree<order, Key, Value, Compare>::serialize(std::ostream& out)
+template<int order, typename Key, typename Value, typename Compare, typename Allocator>
+void BPlusTree<order, Key, Value, Compare, Allocator>::serialize(std::ostream& out, bool compressKeys)
 {
-    // 这里简化处理：只保存数据，不保存 head 指针关系（重建时重新链接叶子）
-    int tree_order = order;
-
-    // 先写入树的order和size, 构成头部信息
-    out.write(reinterpret_cast<const char*>(&tree_order), sizeof(tree_order));
-    out.write(reinterpret_cast<const char*>(&size), sizeof(size));
-
-    // 按先序遍历存储节点结构
-    std::function<void(Node*)> serialize_node = [&](Node* node)
+    writeStream(out, this->size, compressKeys, [this](auto&& fn)
     {
-        // 序列化空节点
-        if (!node)
+        for (LeafNode* leaf = this->root ? this->head : nullptr; leaf != nullptr; leaf = leaf->ptr[1])
         {
-            bool is_null = true;
-            out.write(reinterpret_cast<const char*>(&is_null), sizeof(is_null));
-            return;
+            for (int i = 0; i < leaf->n; i++)
+            {
+                fn(leaf->key(i), leaf->value(i));
+            }
         }
+    });
+}
 
-        bool is_null = false;
-        out.write(reinterpret_cast<const char*>(&is_null), sizeof(is_null));  // Not null
-        out.write(reinterpret_cast<const char*>(&node->n), sizeof(node->n));
-        out.write(reinterpret_cast<const char*>(&node->IS_LEAF), sizeof(node->IS_LEAF));
-
-        // Write keys
-        out.write(reinterpret_cast<const char*>(node->keys), node->n * sizeof(Key));
-
-        if (node->isLeaf())
+/**
+ * @brief 写出流式分块格式：头部为order、标志和键值对个数，之后按键序逐个写出键和值
+ * @param out 输出流
+ * @param count 键值对个数
+ * @param compressKeys 是否差分编码有序的键，键类型不支持时忽略
+ * @param each 形如void(Fn)的遍历函数，按键序对每个键值对调用fn(const Key&, const Value&)
+ */
+template<int order, typename Key, typename Value, typename Compare, typename Allocator>
+template<typename Each>
+void BPlusTree<order, Key, Value, Compare, Allocator>::writeStream(std::ostream& out, long count, bool compressKeys, Each&& each)
+{
+    streamfmt::BlockWriter writer(out);
+    std::string& buffer = writer.buffer();
+    int32_t tree_order = order;
+    uint32_t flags = compressKeys && keycompress::Delta<Key>::SUPPORTED ? streamfmt::FLAG_KEY_DELTA : 0;
+    uint64_t tree_size = count;
+    buffer.append(reinterpret_cast<const char*>(&tree_order), sizeof(tree_order));
+    buffer.append(reinterpret_cast<const char*>(&flags), sizeof(flags));
+    buffer.append(reinterpret_cast<const char*>(&tree_size), sizeof(tree_size));
+
+    Key prev = Key();
+    each([&](const Key& key, const Value& value)
+    {
+        if constexpr (keycompress::Delta<Key>::SUPPORTED)
         {
-            // Write values
-            out.write(reinterpret_cast<const char*>(node->values), node->n * sizeof(Value));
+            if (flags & streamfmt::FLAG_KEY_DELTA)
+            {
+                keycompress::Delta<Key>::encode(prev, key, buffer);
+                prev = key;
+            }
+            else
+            {
+                codec::appendElement(buffer, key);
+            }
         }
         else
         {
-            // Recursively write children
-            for (int i = 0; i <= node->n; i++)
+            codec::appendElement(buffer, key);
+        }
+        codec::appendElement(buffer, value);
+        writer.flush();
+    });
+    writer.finish();
+}
+
+/**
+ * @brief 读入流式分块格式（MAGIC已被读取）：逐块校验，按与bulkLoad相同的划分边读边装满叶子，
+ *        再自底向上构建非叶子节点；键必须严格递增且个数与头部一致
+ * @param in 输入流
+ * @return BPlusTree* 版本或order不匹配、数据被截断或损坏时返回nullptr
+ */
+template<int order, typename Key, typename Value, typename Compare, typename Allocator>
+BPlusTree<order, Key, Value, Compare, Allocator>* BPlusTree<order, Key, Value, Compare, Allocator>::readStream(std::istream& in)
+{
+    uint32_t version = 0;
+    in.read(reinterpret_cast<char*>(&version), sizeof(version));
+    if (!in || version != streamfmt::VERSION)
+    {
+        std::cerr << "Error: Unsupported serialized format version (" << version << ")" << std::endl;
+        return nullptr;
+    }
+
+    streamfmt::BlockReader reader(in);
+    int32_t saved_order = 0;
+    uint32_t flags = 0;
+    uint64_t total = 0;
+    bool ok = reader.read(&saved_order, sizeof(saved_order)) && reader.read(&flags, sizeof(flags)) && reader.read(&total, sizeof(total));
+    if (ok && saved_order != order)
+    {
+        std::cerr << "Error: Serialized tree order (" << saved_order
+                  << ") does not match current template order (" << order << ")" << std::endl;
+        return nullptr;
+    }
+    bool delta = flags & streamfmt::FLAG_KEY_DELTA;
+    ok = ok && (flags & ~streamfmt::FLAG_KEY_DELTA) == 0 && (!delta || keycompress::Delta<Key>::SUPPORTED)
+         && total <= static_cast<uint64_t>(std::numeric_limits<int>::max());
+
+    auto tree = new BPlusTree();
+    std::vector<Node*> level;
+    std::vector<Key> lowKeys; // 每个叶子的下界，作为上一层的分隔键
+    if (ok && total > 0)
+    {
+        const long maxKeys = order - 1;
+        const long minKeys = std::max(1, (order - 1) >> 1);
+        // 头部的键数在读到对应的数据之前未经校验，level和lowKeys随读入的叶子增长，不按count预留
+        const long count = bulkLoadNodeCount(total, maxKeys, minKeys, maxKeys);
+
+        Key prev = Key();
+        Key key = Key();
+        Value value = Value();
+        std::vector<char> scratch;
+        LeafNode* last = nullptr;
+        for (long i = 0; ok && i < count; i++)
+        {
+            LeafNode* leaf = tree->newLeaf();
+            level.push_back(leaf);
+            if (last)
+            {
+                last->insertNextNode(leaf);
+            }
+            last = leaf;
+
+            long n = total / count + (i < static_cast<long>(total % count) ? 1 : 0);
+            while (ok && leaf->n < n)
             {
-                serialize_node(node->ptr[i]);
+                if constexpr (keycompress::Delta<Key>::SUPPORTED)
+                {
+                    ok = delta ? keycompress::Delta<Key>::decode(prev, key, reader, scratch) : codec::readElement(reader, key, scratch);
+                }
+                else
+                {
+                    ok = codec::readElement(reader, key, scratch);
+                }
+                ok = ok && codec::readElement(reader, value, scratch);
+                // 键必须严格递增，否则即使校验和正确也是不合法的数据
+                ok = ok && ((level.size() == 1 && leaf->n == 0) || tree->compare(prev, key));
+                if (!ok)
+                {
+                    break;
+                }
+                if (leaf->n == 0)
+                {
+                    lowKeys.push_back(level.size() == 1 ? key : keycompress::Separator<Key,Compare>::between(prev, key));
+                }
+                leaf->put(leaf->n++, key, std::move(value));
+                prev = key;
             }
+            leaf->compact(leaf->n);
         }
-    };
+    }
+
+    ok = ok && reader.finish();
+    if (!ok)
+    {
+        std::cerr << "Error: Serialized tree is truncated or corrupted" << std::endl;
+        for (Node* node : level)
+        {
+            tree->freeNode(node);
+        }
+        delete tree;
+        return nullptr;
+    }
 
-    serialize_node(root);
+    if (!level.empty())
+    {
+        tree->head = level.front()->leaf();
+        tree->bulkLoadInner(level, lowKeys, 1.0, nullptr);
+        tree->root = level.front();
+    }
+    tree->size = total;
+    return tree;
 }
 
 /**
- * @brief 从输入流反序列化构建新的 B+ 树
+ * @brief 从输入流反序列化构建新的 B+ 树：serialize写出的流式分块格式，或旧版本写出的先序格式
  * @param in 输入流
- * @return BPlusTree* 新的 B+ 树实例
+ * @return BPlusTree* 新的 B+ 树实例，order不匹配或数据被截断、损坏时返回nullptr
  */
-template<int order, typename Key, typename Value, typename Compare>
-BPlusTree<order, Key, Value, Compare>* BPlusTree<order, Key, Value, Compare>::deserialize(std::istream& in)
+template<int order, typename Key, typename Value, typename Compare, typename Allocator>
+BPlusTree<order, Key, Value, Compare, Allocator>* BPlusTree<order, Key, Value, Compare, Allocator>::deserialize(std::istream& in)
 {
-    int saved_order;
+    int saved_order = 0;
     in.read(reinterpret_cast<char*>(&saved_order), sizeof(saved_order));
+    if (in && static_cast<uint32_t>(saved_order) == streamfmt::MAGIC)
+    {
+        return readStream(in);
+    }
+
+    // 以下为旧的先序格式：[order][size]之后先序写出每个节点
     if (saved_order != order)
     {
         std::cerr << "Error: Serialized tree order (" << saved_order
@@ -792,48 +3331,81 @@ BPlusTree<order, Key, Value, Compare>* BPlusTree<order, Key, Value, Compare>::de
     }
 
     auto tree = new BPlusTree();
-    in.read(reinterpret_cast<char*>(&tree->size), sizeof(tree->size));
+    int tree_size;
+    in.read(reinterpret_cast<char*>(&tree_size), sizeof(tree_size));
+    tree->size = tree_size;
 
-    std::function<Node*(void)> deserialize_node = [&]() -> Node* 
+    bool ok = true; // 流读取失败或数据不合法后不再继续读取
+    std::function<Node*(int)> deserialize_node = [&](int depth) -> Node* 
     {
-        bool is_null;
+        bool is_null = true;
         in.read(reinterpret_cast<char*>(&is_null), sizeof(is_null));
-        if (is_null) return nullptr;
+        ok = ok && static_cast<bool>(in);
+        if (!ok || is_null) return nullptr;
 
-        int n;
-        bool is_leaf;
+        int n = 0;
+        bool is_leaf = false;
         in.read(reinterpret_cast<char*>(&n), sizeof(n));
         in.read(reinterpret_cast<char*>(&is_leaf), sizeof(is_leaf));
+        if (!in || n < 0 || n >= order || depth >= MAX_HEIGHT)
+        {
+            ok = false;
+            return nullptr;
+        }
 
-        Node* node = new Node(is_leaf);
+        Node* node = is_leaf ? static_cast<Node*>(tree->newLeaf()) : tree->newInner();
         node->n = n;
 
-        // Read keys
-        in.read(reinterpret_cast<char*>(node->keys), n * sizeof(Key));
-
         if (is_leaf)
         {
-            // Read values
-            in.read(reinterpret_cast<char*>(node->values), n * sizeof(Value));
+            // Read keys and values
+            LeafNode* leaf = node->leaf();
+            if constexpr (SLOTTED_LEAVES)
+            {
+                std::vector<Key> keys(n);
+                std::vector<Value> values(n);
+                ok = codec::readArray(in, keys.data(), n) && codec::readArray(in, values.data(), n);
+                for (int i = 0; ok && i < n; i++)
+                {
+                    leaf->put(i, std::move(keys[i]), std::move(values[i]));
+                }
+                if (ok)
+                {
+                    leaf->compact(n);
+                }
+            }
+            else
+            {
+                ok = codec::readArray(in, leaf->keys, n) && codec::readArray(in, leaf->values, n);
+            }
         } 
         else
         {
+            // Read keys
+            ok = codec::readArray(in, node->inner()->keys, n);
+
             // Read children recursively
             for (int i = 0; i <= n; i++)
             {
-                node->ptr[i] = deserialize_node();
+                node->inner()->ptr[i] = deserialize_node(depth + 1);
             }
         }
 
         return node;
     };
 
-    tree->root = deserialize_node();
+    tree->root = deserialize_node(0);
+    if (!ok)
+    {
+        std::cerr << "Error: Serialized tree is truncated or corrupted" << std::endl;
+        delete tree;
+        return nullptr;
+    }
 
     // 反序列化后重建叶节点链接
     if (tree->root) 
     {
-        std::vector<Node*> leaves;
+        std::vector<LeafNode*> leaves;
         std::function<void(Node*)> collect_leaves = [&](Node* node)
         {
             if (!node) 
@@ -843,13 +3415,13 @@ BPlusTree<order, Key, Value, Compare>* BPlusTree<order, Key, Value, Compare>::de
 
             if (node->isLeaf()) 
             {
-                leaves.push_back(node);
+                leaves.push_back(node->leaf());
             } 
             else
             {
                 for (int i = 0; i <= node->n; i++)
                 {
-                    collect_leaves(node->ptr[i]);
+                    collect_leaves(node->inner()->ptr[i]);
                 }
             }
         };
@@ -874,4 +3446,296 @@ BPlusTree<order, Key, Value, Compare>* BPlusTree<order, Key, Value, Compare>::de
     return tree;
 }
 
-#endif 
\ No newline at end of file
+/**
+ * @brief  按层序把整棵树写成定长页文件，页号即文件内的页偏移，叶子在文件末尾连续存放
+ *         （写出期间不能有并发的插入和删除）
+ * @param  path 页文件路径
+ * @return int  0表示写入成功，1表示文件无法写入
+ */
+template<int order, typename Key, typename Value, typename Compare, typename Allocator>
+int BPlusTree<order, Key, Value, Compare, Allocator>::writePages(const std::string& path)
+{
+    using Layout = pagefile::Layout<order, Key, Value>;
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    if(!out)
+    {
+        return 1;
+    }
+
+    pagefile::Header header{};
+    header.magic = pagefile::MAGIC;
+    header.order = order;
+    header.keySize = sizeof(Key);
+    header.valueSize = sizeof(Value);
+    header.pageSize = Layout::PAGE_SIZE;
+    header.size = this->size;
+
+    // 先占住文件头所在的页，写完所有节点后再回填
+    std::vector<char> page(Layout::PAGE_SIZE);
+    out.write(page.data(), page.size());
+
+    // 孩子入队时分配页号，出队顺序与页号顺序一致
+    std::queue<Node*> q;
+    uint64_t pageId = 1;
+    uint64_t nextId = 2;
+    if(this->root)
+    {
+        q.push(this->root);
+        header.rootPage = 1;
+    }
+    while(!q.empty())
+    {
+        Node* node = q.front();
+        q.pop();
+        std::fill(page.begin(), page.end(), 0);
+
+        typename Layout::NodePage* nodePage = reinterpret_cast<typename Layout::NodePage*>(page.data());
+        nodePage->isLeaf = node->isLeaf();
+        nodePage->n = node->n;
+        std::copy(node->keyArray(), node->keyArray() + node->n, nodePage->keys);
+        if(node->isLeaf())
+        {
+            // 叶子全在最后一层，按从左到右的顺序连续编号
+            LeafNode* leaf = node->leaf();
+            typename Layout::LeafPage* leafPage = reinterpret_cast<typename Layout::LeafPage*>(page.data());
+            std::copy(leaf->values, leaf->values + leaf->n, leafPage->values);
+            leafPage->prev = leaf->ptr[0] ? pageId - 1 : pagefile::NO_PAGE;
+            leafPage->next = leaf->ptr[1] ? pageId + 1 : pagefile::NO_PAGE;
+            if(leaf->ptr[0] == nullptr)
+            {
+                header.headPage = pageId;
+            }
+            header.tailPage = pageId;
+        }
+        else
+        {
+            typename Layout::InnerPage* innerPage = reinterpret_cast<typename Layout::InnerPage*>(page.data());
+            for(int i = 0; i <= node->n; i++)
+            {
+                innerPage->children[i] = nextId++;
+                q.push(node->inner()->ptr[i]);
+            }
+        }
+        out.write(page.data(), page.size());
+        pageId++;
+    }
+
+    header.pageCount = pageId;
+    std::fill(page.begin(), page.end(), 0);
+    std::copy(reinterpret_cast<const char*>(&header), reinterpret_cast<const char*>(&header + 1), page.begin());
+    out.seekp(0);
+    out.write(page.data(), page.size());
+    return out ? 0 : 1;
+}
+
+/**
+ * @brief  把node子树中的脏节点写到新页（不覆盖旧页），孩子页号变化的非叶子节点也要重写。
+ *         写入失败后不再写新页，但孩子已经换页、自身没能重写的节点标记为脏：
+ *         它在文件中的旧页仍引用孩子的旧页，这些旧页下一次提交后会被复用，下一次检查点必须重写它
+ * @param  node 子树的根
+ * @param  file 检查点文件
+ * @param  page 页缓冲区
+ * @param  ok 写入失败时置为false
+ * @return uint64_t node当前的页号
+ */
+template<int order, typename Key, typename Value, typename Compare, typename Allocator>
+uint64_t BPlusTree<order, Key, Value, Compare, Allocator>::writeDirtyPages(Node* node, CheckpointFile& file, std::vector<char>& page, bool& ok)
+{
+    using Layout = pagefile::Layout<order, Key, Value>;
+    bool rewrite = node->dirty || node->pageId == CheckpointFile::NO_PAGE;
+    if(!node->isLeaf())
+    {
+        for(int i = 0; i <= node->n; i++)
+        {
+            Node* child = node->inner()->ptr[i];
+            uint64_t before = child->pageId;
+            if(this->writeDirtyPages(child, file, page, ok) != before)
+            {
+                rewrite = true;
+            }
+        }
+    }
+    if(!rewrite || !ok)
+    {
+        node->dirty = node->dirty || rewrite;
+        return node->pageId;
+    }
+
+    std::fill(page.begin(), page.end(), 0);
+    typename Layout::NodePage* nodePage = reinterpret_cast<typename Layout::NodePage*>(page.data());
+    nodePage->isLeaf = node->isLeaf();
+    nodePage->n = node->n;
+    std::copy(node->keyArray(), node->keyArray() + node->n, nodePage->keys);
+    if(node->isLeaf())
+    {
+        // 叶子之间的前后关系加载时按中序重建，页中不保存，避免一个叶子换页牵连整条链表
+        typename Layout::LeafPage* leafPage = reinterpret_cast<typename Layout::LeafPage*>(page.data());
+        std::copy(node->leaf()->values, node->leaf()->values + node->n, leafPage->values);
+    }
+    else
+    {
+        typename Layout::InnerPage* innerPage = reinterpret_cast<typename Layout::InnerPage*>(page.data());
+        for(int i = 0; i <= node->n; i++)
+        {
+            innerPage->children[i] = node->inner()->ptr[i]->pageId;
+        }
+    }
+
+    uint64_t id = file.allocatePage();
+    if(file.writePage(id, page.data()) != 0)
+    {
+        ok = false;
+        node->dirty = true;
+        file.releasePage(id);
+        return node->pageId;
+    }
+    if(node->pageId != CheckpointFile::NO_PAGE)
+    {
+        file.releasePage(node->pageId);
+    }
+    node->pageId = id;
+    node->dirty = false;
+    return id;
+}
+
+/**
+ * @brief  增量检查点：把脏节点及其祖先写到空闲页后提交新清单，IO量与两次检查点之间的修改量成正比
+ *         （期间不能有并发的插入和删除，一棵树只能对应一个检查点文件）
+ * @param  file 已打开的检查点文件
+ * @return int  0表示成功，1表示写入失败（文件中仍为上一次的检查点）
+ */
+template<int order, typename Key, typename Value, typename Compare, typename Allocator>
+int BPlusTree<order, Key, Value, Compare, Allocator>::writeCheckpoint(CheckpointFile& file)
+{
+    using Layout = pagefile::Layout<order, Key, Value>;
+    if(file.pageBytes() != Layout::PAGE_SIZE)
+    {
+        return 1;
+    }
+
+    for(uint64_t id : this->freedPages)
+    {
+        file.releasePage(id);
+    }
+    this->freedPages.clear();
+    this->checkpointed = true;
+
+    std::vector<char> page(Layout::PAGE_SIZE);
+    bool ok = true;
+    CheckpointFile::Manifest manifest{};
+    manifest.order = order;
+    manifest.keySize = sizeof(Key);
+    manifest.valueSize = sizeof(Value);
+    manifest.size = this->size;
+    manifest.rootPage = this->root ? this->writeDirtyPages(this->root, file, page, ok) : CheckpointFile::NO_PAGE;
+    if(!ok)
+    {
+        return 1;
+    }
+    return file.commit(manifest);
+}
+
+/**
+ * @brief  从检查点文件的page页递归读取子树，叶子按中序收集到leaves
+ * @param  id 页号
+ * @param  file 检查点文件
+ * @param  page 页缓冲区
+ * @param  leaves 输出的叶子序列
+ * @param  depth 该页在树中的深度，超过MAX_HEIGHT说明文件已损坏
+ * @return Node* 子树的根，读取失败或页内容不合法（页号越界或重复引用、关键字个数越界）时为nullptr，已读入的部分被释放
+ */
+template<int order, typename Key, typename Value, typename Compare, typename Allocator>
+typename BPlusTree<order, Key, Value, Compare, Allocator>::Node* BPlusTree<order, Key, Value, Compare, Allocator>::readPages(uint64_t id, CheckpointFile& file, std::vector<char>& page, std::vector<LeafNode*>& leaves, int depth)
+{
+    using Layout = pagefile::Layout<order, Key, Value>;
+    // 节点页没有校验和，页号和关键字个数都要先检查再使用；已读过的页再次出现说明有环
+    if(depth >= MAX_HEIGHT || id < CheckpointFile::FIRST_PAGE || id >= file.manifest().pageCount
+       || file.isLive(id) || file.readPage(id, page.data()) != 0)
+    {
+        return nullptr;
+    }
+    file.markLive(id);
+
+    const typename Layout::NodePage* nodePage = reinterpret_cast<const typename Layout::NodePage*>(page.data());
+    if(nodePage->isLeaf > 1 || nodePage->n < (nodePage->isLeaf ? 0 : 1) || nodePage->n >= order)
+    {
+        return nullptr;
+    }
+    Node* node = nodePage->isLeaf ? static_cast<Node*>(this->newLeaf()) : this->newInner();
+    node->n = nodePage->n;
+    std::copy(nodePage->keys, nodePage->keys + nodePage->n, node->keyArray());
+    node->pageId = id;
+    node->dirty = false;
+    if(node->isLeaf())
+    {
+        const typename Layout::LeafPage* leafPage = reinterpret_cast<const typename Layout::LeafPage*>(page.data());
+        std::copy(leafPage->values, leafPage->values + node->n, node->leaf()->values);
+        leaves.push_back(node->leaf());
+        return node;
+    }
+
+    // 递归会覆盖缓冲区，先取出孩子页号
+    const typename Layout::InnerPage* innerPage = reinterpret_cast<const typename Layout::InnerPage*>(page.data());
+    std::vector<uint64_t> children(innerPage->children, innerPage->children + node->n + 1);
+    for(int i = 0; i <= node->n; i++)
+    {
+        node->inner()->ptr[i] = this->readPages(children[i], file, page, leaves, depth + 1);
+        if(node->inner()->ptr[i] == nullptr)
+        {
+            // 只有前i个孩子已读入
+            node->n = i - 1;
+            this->freeSubtree(node);
+            return nullptr;
+        }
+    }
+    return node;
+}
+
+/**
+ * @brief  从检查点文件最新的清单加载整棵树
+ * @param  file 已打开且含有清单的检查点文件，加载后可继续用于writeCheckpoint
+ * @return BPlusTree*  清单与模板参数不匹配或读取失败时返回nullptr
+ */
+template<int order, typename Key, typename Value, typename Compare, typename Allocator>
+BPlusTree<order, Key, Value, Compare, Allocator>* BPlusTree<order, Key, Value, Compare, Allocator>::loadCheckpoint(CheckpointFile& file)
+{
+    using Layout = pagefile::Layout<order, Key, Value>;
+    const CheckpointFile::Manifest& manifest = file.manifest();
+    if(!file.hasManifest() || manifest.order != order || manifest.keySize != sizeof(Key)
+       || manifest.valueSize != sizeof(Value) || manifest.pageSize != Layout::PAGE_SIZE)
+    {
+        std::cerr << "Error: checkpoint does not match current template parameters" << std::endl;
+        return nullptr;
+    }
+
+    BPlusTree* tree = new BPlusTree();
+    tree->size = manifest.size;
+    tree->checkpointed = true;
+    if(manifest.rootPage != CheckpointFile::NO_PAGE)
+    {
+        std::vector<char> page(Layout::PAGE_SIZE);
+        std::vector<LeafNode*> leaves;
+        tree->root = tree->readPages(manifest.rootPage, file, page, leaves, 0);
+        // 读取失败时leaves中的叶子已被释放
+        long count = 0;
+        for(size_t i = 0; tree->root && i < leaves.size(); i++)
+        {
+            count += leaves[i]->n;
+        }
+        if(tree->root == nullptr || count != manifest.size)
+        {
+            std::cerr << "Error: checkpoint pages are corrupted" << std::endl;
+            delete tree;
+            return nullptr;
+        }
+        for(size_t i = 1; i < leaves.size(); i++)
+        {
+            leaves[i-1]->insertNextNode(leaves[i]);
+        }
+        tree->head = leaves.front();
+    }
+    file.rebuildFreeList();
+    return tree;
+}
+
+#endif
@@ -0,0 +1,273 @@
+#ifndef BUFFERPOOL_H
+#define BUFFERPOOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/**
+ * 定长页文件的缓冲池：最多缓存capacity个页帧，页号通过pin解析为内存地址。
+ * 被pin住的页不会被换出；未pin的页按CLOCK算法淘汰：指针扫过引用位为1的页时清零，
+ * 遇到引用位为0的页即换出，脏页换出前先写回文件。
+ * 所有页帧都被pin住时pin等待其他线程unpin，因此每个线程同时pin住的页数须小于capacity
+ **/
+class BufferPool
+{
+public:
+    BufferPool(std::size_t pageSize, std::size_t capacity)
+        : fd(-1), pageSize(pageSize), frames(capacity), data(pageSize * capacity), hand(0),
+          hits(0), misses(0), evictions(0), discarding(false) {}
+
+    BufferPool(const BufferPool&) = delete;
+    BufferPool& operator=(const BufferPool&) = delete;
+
+    ~BufferPool()
+    {
+        if(this->fd >= 0)
+        {
+            this->flush();
+            ::close(this->fd);
+        }
+    }
+
+    /**
+     * @brief  打开（不存在则创建）页文件
+     * @param  path 文件路径
+     * @return int  0表示成功，1表示文件无法打开
+     */
+    int open(const std::string& path)
+    {
+        this->fd = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+        return this->fd >= 0 ? 0 : 1;
+    }
+
+    // 文件当前的页数
+    uint64_t filePages() const
+    {
+        struct stat st;
+        return fstat(this->fd, &st) == 0 ? st.st_size / this->pageSize : 0;
+    }
+
+    /**
+     * @brief  把页固定在内存中，不在池中时读入（文件中还没有该页时为全零页）
+     * @param  id 页号
+     * @return char* 页内容，unpin之前一直有效；读入失败或换出的脏页写回失败时返回nullptr。
+     *         所有页帧都被pin住时等待其他线程unpin
+     */
+    char* pin(uint64_t id)
+    {
+        std::unique_lock<std::mutex> lock(this->mtx);
+        long slot = -1;
+        while(slot < 0)
+        {
+            auto it = this->table.find(id);
+            if(it != this->table.end())
+            {
+                Frame& frame = this->frames[it->second];
+                frame.pinCount++;
+                frame.referenced = true;
+                this->hits.fetch_add(1, std::memory_order_relaxed);
+                return this->frameData(it->second);
+            }
+
+            bool ioError = false;
+            slot = this->victim(ioError);
+            if(ioError)
+            {
+                return nullptr;
+            }
+            if(slot < 0)
+            {
+                this->unpinned.wait(lock);
+            }
+        }
+
+        this->misses.fetch_add(1, std::memory_order_relaxed);
+
+        char* buffer = this->frameData(slot);
+        ssize_t got = ::pread(this->fd, buffer, this->pageSize, id * this->pageSize);
+        if(got < 0)
+        {
+            return nullptr;
+        }
+        std::memset(buffer + got, 0, this->pageSize - got);
+
+        Frame& frame = this->frames[slot];
+        frame.id = id;
+        frame.used = true;
+        frame.pinCount = 1;
+        frame.referenced = true;
+        frame.dirty = false;
+        this->table[id] = slot;
+        return buffer;
+    }
+
+    /**
+     * @brief  解除pin，pin和unpin须成对调用
+     * @param  id 页号
+     * @param  dirty 本次pin期间是否修改了页内容
+     */
+    void unpin(uint64_t id, bool dirty)
+    {
+        std::lock_guard<std::mutex> guard(this->mtx);
+        Frame& frame = this->frames[this->table.at(id)];
+        frame.pinCount--;
+        frame.dirty = frame.dirty || dirty;
+        if(frame.pinCount == 0)
+        {
+            this->unpinned.notify_all();
+        }
+    }
+
+    /**
+     * @brief  放弃所有尚未写回的修改：之后换出和flush都不再写文件，文件保持已写回的内容
+     *         （在此之前换出时写回的页不会被撤销）。上层结构在一次修改中途失败、池中的页已不一致时调用
+     */
+    void discardWrites()
+    {
+        std::lock_guard<std::mutex> guard(this->mtx);
+        this->discarding = true;
+    }
+
+    /**
+     * @brief  把所有脏页写回文件并落盘
+     * @return int  0表示成功，1表示写入失败
+     */
+    int flush()
+    {
+        std::lock_guard<std::mutex> guard(this->mtx);
+        if(this->discarding)
+        {
+            return 1;
+        }
+        for(std::size_t slot = 0; slot < this->frames.size(); slot++)
+        {
+            if(this->frames[slot].used && this->frames[slot].dirty && this->writeBack(slot) != 0)
+            {
+                return 1;
+            }
+        }
+        return ::fdatasync(this->fd) == 0 ? 0 : 1;
+    }
+
+    std::size_t capacity() const { return this->frames.size(); }
+    uint64_t hitCount() const { return this->hits.load(std::memory_order_relaxed); }
+    uint64_t missCount() const { return this->misses.load(std::memory_order_relaxed); }
+    uint64_t evictionCount() const { return this->evictions.load(std::memory_order_relaxed); }
+
+private:
+    struct Frame
+    {
+        uint64_t id = 0;
+        int pinCount = 0;
+        bool used = false;
+        bool referenced = false; // CLOCK引用位
+        bool dirty = false;
+    };
+
+    int fd;
+    std::size_t pageSize;
+    std::mutex mtx; // 保护页表和页帧状态
+    std::condition_variable unpinned; // 有页帧的pin计数降为0
+    std::vector<Frame> frames;
+    std::vector<char> data;
+    std::unordered_map<uint64_t, std::size_t> table; // 页号 -> 页帧下标
+    std::size_t hand; // CLOCK指针
+    std::atomic<uint64_t> hits, misses, evictions;
+    bool discarding; // 调用过discardWrites
+
+    char* frameData(std::size_t slot)
+    {
+        return this->data.data() + slot * this->pageSize;
+    }
+
+    int writeBack(std::size_t slot)
+    {
+        Frame& frame = this->frames[slot];
+        if(!this->discarding && ::pwrite(this->fd, this->frameData(slot), this->pageSize, frame.id * this->pageSize) != static_cast<ssize_t>(this->pageSize))
+        {
+            return 1;
+        }
+        frame.dirty = false;
+        return 0;
+    }
+
+    // 找一个空闲或可以换出的页帧，所有页帧都被pin住时返回-1，脏页写回失败时还会置ioError
+    long victim(bool& ioError)
+    {
+        for(std::size_t step = 0; step < 2 * this->frames.size(); step++)
+        {
+            std::size_t slot = this->hand;
+            this->hand = (this->hand + 1) % this->frames.size();
+            Frame& frame = this->frames[slot];
+            if(!frame.used)
+            {
+                return slot;
+            }
+            if(frame.pinCount > 0)
+            {
+                continue;
+            }
+            if(frame.referenced)
+            {
+                frame.referenced = false;
+                continue;
+            }
+            if(frame.dirty && this->writeBack(slot) != 0)
+            {
+                ioError = true;
+                return -1;
+            }
+            this->table.erase(frame.id);
+            frame.used = false;
+            this->evictions.fetch_add(1, std::memory_order_relaxed);
+            return slot;
+        }
+        return -1;
+    }
+};
+
+/**
+ * pin住一个页并在析构时unpin的守卫
+ **/
+class PageGuard
+{
+public:
+    PageGuard(BufferPool& pool, uint64_t id) : pool(&pool), id(id), bytes(pool.pin(id)), dirty(false) {}
+
+    PageGuard(const PageGuard&) = delete;
+    PageGuard& operator=(const PageGuard&) = delete;
+
+    ~PageGuard()
+    {
+        if(this->bytes)
+        {
+            this->pool->unpin(this->id, this->dirty);
+        }
+    }
+
+    template<typename T>
+    T* as() { return reinterpret_cast<T*>(this->bytes); }
+
+    bool valid() const { return this->bytes != nullptr; }
+    uint64_t pageId() const { return this->id; }
+
+    // 修改页内容后调用，unpin时标记为脏页
+    void markDirty() { this->dirty = true; }
+
+private:
+    BufferPool* pool;
+    uint64_t id;
+    char* bytes;
+    bool dirty;
+};
+
+#endif
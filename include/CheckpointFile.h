@@ -0,0 +1,206 @@
+#ifndef CHECKPOINTFILE_H
+#define CHECKPOINTFILE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/**
+ * 增量检查点文件：第0、1页轮流保存清单（manifest），其余页保存节点。
+ * 检查点只把脏节点写到空闲页（影子分页，不覆盖仍被旧清单引用的页），落盘后再写入另一个清单槽位，
+ * 清单带序号和校验和，打开时取有效且序号最大的槽位，因此检查点中途崩溃时旧的检查点仍然完整。
+ * 被新检查点替换掉的页在清单提交后才回到空闲链表
+ **/
+class CheckpointFile
+{
+public:
+    static constexpr uint64_t MAGIC = 0x3154504B43545042ULL; // "BPTCKPT1"
+    static constexpr uint64_t NO_PAGE = 0;
+    static constexpr uint64_t FIRST_PAGE = 2; // 第0、1页为清单槽位
+
+    struct Manifest
+    {
+        uint64_t magic;
+        uint64_t sequence; // 每次提交加一
+        uint32_t order;
+        uint32_t keySize;
+        uint32_t valueSize;
+        uint32_t pageSize;
+        uint64_t rootPage;
+        uint64_t pageCount; // 文件中已使用的页数（高水位）
+        int64_t size; // 键值对个数
+        uint32_t checksum;
+    };
+
+    CheckpointFile() : fd(-1), pageSize(0), syncEnabled(true), nextPage(FIRST_PAGE), valid(false), current{} {}
+
+    CheckpointFile(const CheckpointFile&) = delete;
+    CheckpointFile& operator=(const CheckpointFile&) = delete;
+
+    ~CheckpointFile()
+    {
+        if(this->fd >= 0)
+        {
+            ::close(this->fd);
+        }
+    }
+
+    /**
+     * @brief  打开（不存在则创建）检查点文件并读取最新的有效清单
+     * @param  path 文件路径
+     * @param  pageSize 页大小，须能容纳清单
+     * @param  sync false时提交不fdatasync
+     * @return int  0表示成功，1表示文件无法打开或页大小不合法
+     */
+    int open(const std::string& path, uint32_t pageSize, bool sync = true)
+    {
+        if(pageSize < sizeof(Manifest))
+        {
+            return 1;
+        }
+        this->pageSize = pageSize;
+        this->syncEnabled = sync;
+        this->fd = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+        if(this->fd < 0)
+        {
+            return 1;
+        }
+
+        for(uint64_t slot = 0; slot < FIRST_PAGE; slot++)
+        {
+            Manifest m;
+            if(::pread(this->fd, &m, sizeof(m), slot * pageSize) == static_cast<ssize_t>(sizeof(m))
+               && m.magic == MAGIC && m.checksum == checksumOf(m) && (!this->valid || m.sequence > this->current.sequence))
+            {
+                this->current = m;
+                this->valid = true;
+            }
+        }
+        this->nextPage = this->valid ? this->current.pageCount : FIRST_PAGE;
+        return 0;
+    }
+
+    // 是否存在已提交的检查点
+    bool hasManifest() const { return this->valid; }
+    const Manifest& manifest() const { return this->current; }
+
+    // 分配一个当前清单没有引用的页
+    uint64_t allocatePage()
+    {
+        if(!this->freePages.empty())
+        {
+            uint64_t id = this->freePages.back();
+            this->freePages.pop_back();
+            return id;
+        }
+        return this->nextPage++;
+    }
+
+    // 释放页，下一次提交成功后才可以复用
+    void releasePage(uint64_t id)
+    {
+        this->pendingFree.push_back(id);
+    }
+
+    int writePage(uint64_t id, const void* data)
+    {
+        return ::pwrite(this->fd, data, this->pageSize, id * this->pageSize) == static_cast<ssize_t>(this->pageSize) ? 0 : 1;
+    }
+
+    int readPage(uint64_t id, void* data) const
+    {
+        return ::pread(this->fd, data, this->pageSize, id * this->pageSize) == static_cast<ssize_t>(this->pageSize) ? 0 : 1;
+    }
+
+    /**
+     * @brief  提交检查点：先让已写入的节点页落盘，再把清单写入另一个槽位并落盘
+     * @param  m 新清单，magic、sequence、pageCount和checksum由这里填写
+     * @return int  0表示成功，1表示写入或落盘失败（仍以旧清单为准）
+     */
+    int commit(Manifest m)
+    {
+        if(this->syncEnabled && ::fdatasync(this->fd) != 0)
+        {
+            return 1;
+        }
+
+        m.magic = MAGIC;
+        m.sequence = this->valid ? this->current.sequence + 1 : 1;
+        m.pageSize = this->pageSize;
+        m.pageCount = this->nextPage;
+        m.checksum = checksumOf(m);
+        std::vector<char> page(this->pageSize);
+        std::memcpy(page.data(), &m, sizeof(m));
+        if(this->writePage(m.sequence % FIRST_PAGE, page.data()) != 0
+           || (this->syncEnabled && ::fdatasync(this->fd) != 0))
+        {
+            return 1;
+        }
+
+        this->current = m;
+        this->valid = true;
+        this->freePages.insert(this->freePages.end(), this->pendingFree.begin(), this->pendingFree.end());
+        this->pendingFree.clear();
+        return 0;
+    }
+
+    // 加载检查点时标记被引用的页，加载完后调用rebuildFreeList把其余页放入空闲链表
+    void markLive(uint64_t id)
+    {
+        if(this->live.size() <= id)
+        {
+            this->live.resize(id + 1, false);
+        }
+        this->live[id] = true;
+    }
+
+    bool isLive(uint64_t id) const
+    {
+        return id < this->live.size() && this->live[id];
+    }
+
+    void rebuildFreeList()
+    {
+        this->freePages.clear();
+        for(uint64_t id = FIRST_PAGE; id < this->nextPage; id++)
+        {
+            if(id >= this->live.size() || !this->live[id])
+            {
+                this->freePages.push_back(id);
+            }
+        }
+        this->live.clear();
+    }
+
+    uint32_t pageBytes() const { return this->pageSize; }
+
+private:
+    int fd;
+    uint32_t pageSize;
+    bool syncEnabled;
+    uint64_t nextPage; // 文件末尾的下一个新页
+    bool valid;
+    Manifest current;
+    std::vector<uint64_t> freePages; // 可以立即复用的页
+    std::vector<uint64_t> pendingFree; // 本次检查点释放、提交后才能复用的页
+    std::vector<bool> live;
+
+    static uint32_t checksumOf(const Manifest& m)
+    {
+        const unsigned char* bytes = reinterpret_cast<const unsigned char*>(&m);
+        uint32_t hash = 2166136261u;
+        for(std::size_t i = 0; i < offsetof(Manifest, checksum); i++)
+        {
+            hash ^= bytes[i];
+            hash *= 16777619u;
+        }
+        return hash;
+    }
+};
+
+#endif
@@ -0,0 +1,208 @@
+#ifndef CODEC_H
+#define CODEC_H
+
+#include <cstdint>
+#include <cstring>
+#include <istream>
+#include <ostream>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+/**
+ * 序列化用的类型编解码器。可按位拷贝的类型是定长编码，整个数组直接按字节写出；
+ * std::string等变长类型写成槽页（slotted page）：
+ *   [heap字节数 uint32][偏移 uint32 x (n+1)][heap]
+ * 第i个元素是heap中[偏移i, 偏移i+1)的字节。整个槽页一次读入，再按偏移解码各个元素，
+ * 不需要逐个元素读流或为长度字段单独分配内存。
+ * 其他变长类型可以特化Codec，提供SUPPORTED = true、FIXED = false、size、encode和decode。
+ * 未特化且不能按位拷贝的类型SUPPORTED为false，不能序列化，内存中的叶子也只能按对象数组存放
+ **/
+namespace codec
+{
+
+template<typename T, typename Enable = void>
+struct Codec
+{
+    static constexpr bool SUPPORTED = std::is_trivially_copyable<T>::value;
+    static constexpr bool FIXED = true;
+};
+
+template<>
+struct Codec<std::string>
+{
+    static constexpr bool SUPPORTED = true;
+    static constexpr bool FIXED = false;
+
+    static std::size_t size(const std::string& value) { return value.size(); }
+
+    static void encode(const std::string& value, char* out) { std::memcpy(out, value.data(), value.size()); }
+
+    static void decode(const char* in, std::size_t length, std::string& value) { value.assign(in, length); }
+};
+
+/**
+ * @brief  写出items[0, n)
+ * @param  out 输出流
+ * @param  items 元素数组
+ * @param  n 元素个数
+ * @return bool 输出流是否仍然正常
+ */
+template<typename T>
+bool writeArray(std::ostream& out, const T* items, int n)
+{
+    static_assert(Codec<T>::SUPPORTED, "specialize codec::Codec for types that are not trivially copyable");
+
+    if constexpr(Codec<T>::FIXED)
+    {
+        out.write(reinterpret_cast<const char*>(items), n * sizeof(T));
+    }
+    else
+    {
+        std::vector<uint32_t> offsets(n + 1, 0);
+        for(int i = 0; i < n; i++)
+        {
+            offsets[i + 1] = offsets[i] + static_cast<uint32_t>(Codec<T>::size(items[i]));
+        }
+        std::vector<char> heap(offsets[n]);
+        for(int i = 0; i < n; i++)
+        {
+            Codec<T>::encode(items[i], heap.data() + offsets[i]);
+        }
+        uint32_t heapBytes = offsets[n];
+        out.write(reinterpret_cast<const char*>(&heapBytes), sizeof(heapBytes));
+        out.write(reinterpret_cast<const char*>(offsets.data()), offsets.size() * sizeof(uint32_t));
+        out.write(heap.data(), heap.size());
+    }
+    return static_cast<bool>(out);
+}
+
+/**
+ * @brief  读入n个元素到items[0, n)
+ * @param  in 输入流
+ * @param  items 元素数组，元素须已构造
+ * @param  n 元素个数
+ * @return bool 读入成功且槽页的偏移合法时返回true
+ */
+template<typename T>
+bool readArray(std::istream& in, T* items, int n)
+{
+    static_assert(Codec<T>::SUPPORTED, "specialize codec::Codec for types that are not trivially copyable");
+
+    if constexpr(Codec<T>::FIXED)
+    {
+        in.read(reinterpret_cast<char*>(items), n * sizeof(T));
+        return static_cast<bool>(in);
+    }
+    else
+    {
+        uint32_t heapBytes = 0;
+        std::vector<uint32_t> offsets(n + 1);
+        in.read(reinterpret_cast<char*>(&heapBytes), sizeof(heapBytes));
+        in.read(reinterpret_cast<char*>(offsets.data()), offsets.size() * sizeof(uint32_t));
+        if(!in || offsets[0] != 0 || offsets[n] != heapBytes)
+        {
+            return false;
+        }
+        std::vector<char> heap(heapBytes);
+        if(!in.read(heap.data(), heap.size()))
+        {
+            return false;
+        }
+        for(int i = 0; i < n; i++)
+        {
+            if(offsets[i] > offsets[i + 1])
+            {
+                return false;
+            }
+            Codec<T>::decode(heap.data() + offsets[i], offsets[i + 1] - offsets[i], items[i]);
+        }
+        return true;
+    }
+}
+
+/**
+ * 流式格式中按元素逐个编码：定长类型写原始字节，变长类型写varint长度和编码后的字节。
+ * Source需提供bool read(void* dst, std::size_t n)
+ **/
+
+// 7位一组的无符号变长整数，小的数占的字节少
+inline void putVarint(std::string& out, uint64_t value)
+{
+    while(value >= 0x80)
+    {
+        out.push_back(static_cast<char>(value | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<char>(value));
+}
+
+template<typename Source>
+bool getVarint(Source& in, uint64_t& value)
+{
+    value = 0;
+    for(int shift = 0; shift < 64; shift += 7)
+    {
+        unsigned char byte;
+        if(!in.read(&byte, 1))
+        {
+            return false;
+        }
+        value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+        if(!(byte & 0x80))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+template<typename T>
+void appendElement(std::string& out, const T& item)
+{
+    static_assert(Codec<T>::SUPPORTED, "specialize codec::Codec for types that are not trivially copyable");
+
+    if constexpr(Codec<T>::FIXED)
+    {
+        out.append(reinterpret_cast<const char*>(&item), sizeof(T));
+    }
+    else
+    {
+        std::size_t size = Codec<T>::size(item);
+        putVarint(out, size);
+        std::size_t offset = out.size();
+        out.resize(offset + size);
+        Codec<T>::encode(item, &out[offset]);
+    }
+}
+
+template<typename T, typename Source>
+bool readElement(Source& in, T& item, std::vector<char>& scratch)
+{
+    static_assert(Codec<T>::SUPPORTED, "specialize codec::Codec for types that are not trivially copyable");
+
+    if constexpr(Codec<T>::FIXED)
+    {
+        return in.read(&item, sizeof(T));
+    }
+    else
+    {
+        uint64_t size;
+        // 长度只可能来自损坏的数据时不分配内存
+        if(!getVarint(in, size) || size > UINT32_MAX)
+        {
+            return false;
+        }
+        scratch.resize(size);
+        if(!in.read(scratch.data(), size))
+        {
+            return false;
+        }
+        Codec<T>::decode(scratch.data(), size, item);
+        return true;
+    }
+}
+
+} // namespace codec
+
+#endif
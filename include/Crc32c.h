@@ -0,0 +1,89 @@
+#ifndef CRC32C_H
+#define CRC32C_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__SSE4_2__)
+#include <nmmintrin.h>
+#elif defined(__ARM_FEATURE_CRC32)
+#include <arm_acle.h>
+#endif
+
+/**
+ * CRC32C（Castagnoli多项式）。编译目标支持SSE4.2或ARMv8 CRC扩展时使用硬件指令每次处理8字节，
+ * 否则查表逐字节计算；两种实现的结果相同
+ **/
+namespace crc32c
+{
+
+constexpr uint32_t POLY = 0x82F63B78; // 反射形式的多项式
+
+struct Table
+{
+    uint32_t entries[256];
+
+    constexpr Table() : entries()
+    {
+        for(uint32_t i = 0; i < 256; i++)
+        {
+            uint32_t crc = i;
+            for(int bit = 0; bit < 8; bit++)
+            {
+                crc = (crc >> 1) ^ ((crc & 1) ? POLY : 0);
+            }
+            this->entries[i] = crc;
+        }
+    }
+};
+
+inline uint32_t extendSoftware(uint32_t crc, const unsigned char* p, std::size_t n)
+{
+    static constexpr Table TABLE;
+    for(std::size_t i = 0; i < n; i++)
+    {
+        crc = TABLE.entries[(crc ^ p[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return crc;
+}
+
+/**
+ * @brief  在已有的校验值上继续计算n字节
+ * @param  crc 之前数据的校验值，从头计算时为0
+ * @param  data 数据
+ * @param  n 字节数
+ * @return uint32_t
+ */
+inline uint32_t extend(uint32_t crc, const void* data, std::size_t n)
+{
+    const unsigned char* p = static_cast<const unsigned char*>(data);
+    crc = ~crc;
+#if defined(__SSE4_2__) && defined(__x86_64__)
+    uint64_t wide = crc;
+    for(; n >= 8; p += 8, n -= 8)
+    {
+        uint64_t word;
+        std::memcpy(&word, p, sizeof(word));
+        wide = _mm_crc32_u64(wide, word);
+    }
+    crc = static_cast<uint32_t>(wide);
+#elif defined(__ARM_FEATURE_CRC32)
+    for(; n >= 8; p += 8, n -= 8)
+    {
+        uint64_t word;
+        std::memcpy(&word, p, sizeof(word));
+        crc = __crc32cd(crc, word);
+    }
+#endif
+    return ~extendSoftware(crc, p, n);
+}
+
+inline uint32_t value(const void* data, std::size_t n)
+{
+    return extend(0, data, n);
+}
+
+} // namespace crc32c
+
+#endif
@@ -0,0 +1,240 @@
+#ifndef DURABLEBPLUSTREE_H
+#define DURABLEBPLUSTREE_H
+
+#include <atomic>
+#include <cstring>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
+#include <string>
+#include <type_traits>
+#include "BPlusTree.h"
+#include "CheckpointFile.h"
+#include "WriteAheadLog.h"
+
+/**
+ * 带预写日志的B+树：每次insert/remove先写日志并等待落盘（组提交），落盘后才修改内存中的树，
+ * 日志写入失败时树保持不变，之后的检查点也不会写入调用者被告知失败的修改。
+ * 日志超过checkpointBytes时做增量检查点（只写入脏节点）并清空日志；打开时先加载检查点再回放日志。
+ * 文件为 path.ckpt 和 path.wal。读操作直接访问内存中的树，只能读到已落盘的修改。
+ * 日志一旦写入失败就不再接受修改，之后的insert/remove都返回-1，需要重新打开。
+ * 自动检查点失败不影响已经落盘并生效的修改：insert/remove照常返回结果，失败记录在checkpointFailed中，
+ * 日志保留全部记录，之后的检查点会重写上次没能写入的节点
+ **/
+template<int order, typename Key, typename Value, typename Compare = std::less<Key>>
+class DurableBPlusTree
+{
+public:
+    using Tree = BPlusTree<order, Key, Value, Compare>;
+
+    struct Options
+    {
+        bool sync = true; // false时日志只写入操作系统缓存，不fdatasync
+        std::size_t checkpointBytes = 64 << 20; // 日志超过该大小时自动做检查点，0表示不自动做
+    };
+
+    DurableBPlusTree(const DurableBPlusTree&) = delete;
+    DurableBPlusTree& operator=(const DurableBPlusTree&) = delete;
+
+    ~DurableBPlusTree()
+    {
+        delete this->tree;
+    }
+
+    static DurableBPlusTree* open(const std::string& path, Options options);
+    static DurableBPlusTree* open(const std::string& path) { return open(path, Options()); }
+
+    int insert(Key key, Value value);
+    int remove(Key key);
+    int checkpoint();
+
+    std::optional<Value> get(const Key& key) const { return this->tree->get(key); }
+    bool contains(const Key& key) const { return this->tree->contains(key); }
+    int size() const { return this->tree->size; }
+
+    // 最近一次检查点（自动或手动）是否失败，之后成功的检查点会清除该标记
+    bool checkpointFailed() const { return this->lastCheckpointFailed; }
+
+    // 只读访问内存中的树，用于范围扫描等
+    const Tree& data() const { return *this->tree; }
+
+private:
+    static_assert(std::is_trivially_copyable<Key>::value && std::is_trivially_copyable<Value>::value,
+                  "log records store keys and values by their bytes");
+
+    static constexpr uint8_t LOG_INSERT = 1;
+    static constexpr uint8_t LOG_REMOVE = 2;
+    static constexpr int STRIPES = 64;
+
+    std::string path;
+    Options options;
+    Tree* tree;
+    CheckpointFile checkpointFile;
+    WriteAheadLog wal;
+    std::shared_mutex checkpointMutex; // 写者共享持有，检查点独占持有
+    std::mutex stripes[STRIPES]; // 同一个键的日志和修改按相同顺序进行，持有到修改完成
+    std::atomic<bool> checkpointing{false};
+    std::atomic<bool> lastCheckpointFailed{false};
+
+    DurableBPlusTree(const std::string& path, Options options) : path(path), options(options), tree(nullptr) {}
+
+    // 按键的字节做FNV-1a散列选择分段锁
+    std::mutex& stripeOf(const Key& key)
+    {
+        const unsigned char* bytes = reinterpret_cast<const unsigned char*>(&key);
+        uint32_t hash = 2166136261u;
+        for(std::size_t i = 0; i < sizeof(Key); i++)
+        {
+            hash ^= bytes[i];
+            hash *= 16777619u;
+        }
+        return this->stripes[hash % STRIPES];
+    }
+
+    int maybeCheckpoint();
+};
+
+/**
+ * @brief  打开持久化的树：加载检查点（不存在则为空树）后回放日志中的全部完整记录
+ * @param  path 文件路径前缀
+ * @param  options 刷盘和检查点选项
+ * @return DurableBPlusTree*  检查点无法读取或日志无法打开时返回nullptr
+ */
+template<int order, typename Key, typename Value, typename Compare>
+DurableBPlusTree<order, Key, Value, Compare>* DurableBPlusTree<order, Key, Value, Compare>::open(const std::string& path, Options options)
+{
+    DurableBPlusTree* durable = new DurableBPlusTree(path, options);
+    if(durable->checkpointFile.open(path + ".ckpt", pagefile::Layout<order, Key, Value>::PAGE_SIZE, options.sync) != 0)
+    {
+        delete durable;
+        return nullptr;
+    }
+    durable->tree = durable->checkpointFile.hasManifest() ? Tree::loadCheckpoint(durable->checkpointFile) : new Tree();
+    if(durable->tree == nullptr)
+    {
+        delete durable;
+        return nullptr;
+    }
+
+    Tree* tree = durable->tree;
+    int status = durable->wal.open(path + ".wal", [tree](uint8_t type, const char* payload, uint32_t length)
+    {
+        // 先核对长度再读取载荷，长度不符的记录跳过
+        Key key;
+        if(type == LOG_INSERT && length == sizeof(Key) + sizeof(Value))
+        {
+            Value value;
+            std::memcpy(&key, payload, sizeof(Key));
+            std::memcpy(&value, payload + sizeof(Key), sizeof(Value));
+            tree->insert(key, value);
+        }
+        else if(type == LOG_REMOVE && length == sizeof(Key))
+        {
+            std::memcpy(&key, payload, sizeof(Key));
+            tree->remove(key);
+        }
+    }, options.sync);
+    if(status != 0)
+    {
+        delete durable;
+        return nullptr;
+    }
+    return durable;
+}
+
+/**
+ * @brief  插入键值对：日志落盘后再修改树，之后可能触发自动检查点（失败见checkpointFailed）
+ * @param  key 新的键
+ * @param  value 新的值
+ * @return int  0表示插入成功，1表示节点已存在，更新value，-1表示日志写入失败（树未被修改）
+ */
+template<int order, typename Key, typename Value, typename Compare>
+int DurableBPlusTree<order, Key, Value, Compare>::insert(Key key, Value value)
+{
+    std::shared_lock<std::shared_mutex> guard(this->checkpointMutex);
+    char payload[sizeof(Key) + sizeof(Value)];
+    std::memcpy(payload, &key, sizeof(Key));
+    std::memcpy(payload + sizeof(Key), &value, sizeof(Value));
+
+    int result;
+    {
+        // 持有分段锁直到修改完成，同一个键的修改顺序与日志顺序一致
+        std::lock_guard<std::mutex> stripe(this->stripeOf(key));
+        uint64_t lsn = this->wal.append(LOG_INSERT, payload, sizeof(payload));
+        if(this->wal.sync(lsn) != 0)
+        {
+            return -1;
+        }
+        result = this->tree->insert(key, value);
+    }
+    guard.unlock();
+    this->maybeCheckpoint();
+    return result;
+}
+
+/**
+ * @brief  删除键：日志落盘后再修改树，之后可能触发自动检查点（失败见checkpointFailed）
+ * @param  key 要被删除的数据的键
+ * @return int  0表示删除成功，1表示键不存在，-1表示日志写入失败（树未被修改）
+ */
+template<int order, typename Key, typename Value, typename Compare>
+int DurableBPlusTree<order, Key, Value, Compare>::remove(Key key)
+{
+    std::shared_lock<std::shared_mutex> guard(this->checkpointMutex);
+    int result;
+    {
+        // 其他线程不会修改同一分段的键，先判断键是否存在，不存在时不写日志
+        std::lock_guard<std::mutex> stripe(this->stripeOf(key));
+        if(!this->tree->contains(key))
+        {
+            return 1;
+        }
+        uint64_t lsn = this->wal.append(LOG_REMOVE, &key, sizeof(Key));
+        if(this->wal.sync(lsn) != 0)
+        {
+            return -1;
+        }
+        result = this->tree->remove(key);
+    }
+    guard.unlock();
+    this->maybeCheckpoint();
+    return result;
+}
+
+/**
+ * @brief  写操作落盘后检查日志大小，超过阈值时由一个写者负责做检查点
+ * @return int  0表示成功，1表示检查点失败
+ */
+template<int order, typename Key, typename Value, typename Compare>
+int DurableBPlusTree<order, Key, Value, Compare>::maybeCheckpoint()
+{
+    if(this->options.checkpointBytes == 0 || this->wal.bytes() < this->options.checkpointBytes
+       || this->checkpointing.exchange(true))
+    {
+        return 0;
+    }
+    int status = this->checkpoint();
+    this->checkpointing = false;
+    return status;
+}
+
+/**
+ * @brief  检查点：阻塞写者，把上次检查点之后的脏节点写入检查点文件并提交，再清空日志
+ * @return int  0表示成功，1表示写入失败（日志保持不变），结果同时记录在checkpointFailed中
+ */
+template<int order, typename Key, typename Value, typename Compare>
+int DurableBPlusTree<order, Key, Value, Compare>::checkpoint()
+{
+    std::unique_lock<std::shared_mutex> guard(this->checkpointMutex);
+    int status = this->tree->writeCheckpoint(this->checkpointFile);
+    // 提交后日志中的记录都已包含在检查点里，在清空前崩溃时重复回放的结果相同
+    if(status == 0)
+    {
+        status = this->wal.truncate();
+    }
+    this->lastCheckpointFailed = status != 0;
+    return status;
+}
+
+#endif
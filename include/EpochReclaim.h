@@ -0,0 +1,111 @@
+#ifndef EPOCHRECLAIM_H
+#define EPOCHRECLAIM_H
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <thread>
+
+/**
+ * 基于纪元的内存回收。乐观读者不加锁地遍历节点，节点从树中摘除后可能仍有读者正在读取，
+ * 不能立即释放。读者在操作开始时于Domain中占一个槽位并登记当时的全局纪元，结束时清除；
+ * 节点摘除时取全局纪元作为标签并让全局纪元加一。标签小于所有在场读者纪元的节点，
+ * 摘除时这些读者都还没有开始，不可能再访问它，可以释放。
+ * 热路径上读者只需一次CAS和一次store，不对节点做引用计数
+ **/
+namespace epoch
+{
+
+class Domain
+{
+public:
+    static constexpr int SLOTS = 128;
+    static constexpr uint64_t IDLE = UINT64_MAX; // 槽位空闲
+
+    // 读者在作用域内登记纪元；domain为nullptr时为空操作（逐层加锁模式不需要登记）
+    class Guard
+    {
+    public:
+        explicit Guard(Domain* domain) : domain(domain), slot(domain ? domain->enter() : -1) {}
+        ~Guard()
+        {
+            if(this->domain)
+            {
+                this->domain->leave(this->slot);
+            }
+        }
+        Guard(const Guard&) = delete;
+        Guard& operator=(const Guard&) = delete;
+
+    private:
+        Domain* domain;
+        int slot;
+    };
+
+    // 当前全局纪元，快照等长期持有节点指针的对象用它固定可回收的上界
+    uint64_t current() const { return this->global.load(); }
+
+    // 摘除节点时调用，返回节点的标签
+    uint64_t advance() { return this->global.fetch_add(1); }
+
+    /**
+     * @brief  在场读者登记的最小纪元
+     * @return uint64_t  没有在场读者时为IDLE
+     */
+    uint64_t oldestActive() const
+    {
+        uint64_t oldest = IDLE;
+        for(const Slot& slot : this->slots)
+        {
+            uint64_t e = slot.epoch.load();
+            oldest = e < oldest ? e : oldest;
+        }
+        return oldest;
+    }
+
+private:
+    struct alignas(64) Slot
+    {
+        std::atomic<uint64_t> epoch{IDLE};
+    };
+
+    std::atomic<uint64_t> global{1};
+    Slot slots[SLOTS];
+
+    /**
+     * @brief  占用一个空闲槽位并登记当前纪元，线程优先复用上次的槽位
+     * @return int  槽位下标
+     */
+    int enter()
+    {
+        static thread_local unsigned hint = std::hash<std::thread::id>()(std::this_thread::get_id()) % SLOTS;
+        for(unsigned i = 0;; i++)
+        {
+            unsigned idx = (hint + i) % SLOTS;
+            uint64_t idle = IDLE;
+            if(this->slots[idx].epoch.load(std::memory_order_relaxed) == IDLE &&
+               this->slots[idx].epoch.compare_exchange_strong(idle, this->global.load()))
+            {
+                hint = idx;
+                // 登记须先于之后对节点的读取；x86上带lock前缀的CAS本身就是全屏障
+#if !defined(__x86_64__) && !defined(__i386__)
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+#endif
+                return idx;
+            }
+            if((i + 1) % SLOTS == 0)
+            {
+                std::this_thread::yield();
+            }
+        }
+    }
+
+    void leave(int slot)
+    {
+        this->slots[slot].epoch.store(IDLE, std::memory_order_release);
+    }
+};
+
+} // namespace epoch
+
+#endif
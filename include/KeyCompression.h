@@ -0,0 +1,126 @@
+#ifndef KEYCOMPRESSION_H
+#define KEYCOMPRESSION_H
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <type_traits>
+#include <vector>
+#include "Codec.h"
+
+/**
+ * 分隔键截断（后缀截断）：叶子分裂或借位时，提升到父节点的分隔键只需满足
+ * 左叶子最大键 < 分隔键 <= 右叶子最小键，不必是右叶子最小键的完整拷贝。
+ * 对共享长前缀的字符串键，截到第一个不同的字符为止，非叶子节点中的键大多能放进
+ * std::string的内联缓冲区，不再为每个分隔键单独分配堆内存。
+ * 叶子内键的公共前缀压缩见LeafStorage.h中的SlottedStorage
+ **/
+namespace keycompress
+{
+
+// 默认不截断，直接使用右叶子的最小键
+template<typename Key, typename Compare>
+struct Separator
+{
+    static Key between(const Key& leftMax, const Key& rightMin)
+    {
+        (void)leftMax;
+        return rightMin;
+    }
+};
+
+// 按字典序比较的字符串：取rightMin中到第一个与leftMax不同的字符为止的最短前缀
+template<>
+struct Separator<std::string, std::less<std::string>>
+{
+    static std::string between(const std::string& leftMax, const std::string& rightMin)
+    {
+        std::size_t limit = std::min(leftMax.size(), rightMin.size());
+        std::size_t i = 0;
+        while(i < limit && leftMax[i] == rightMin[i])
+        {
+            i++;
+        }
+        // leftMax < rightMin，所以rightMin在下标i处还有字符（leftMax是它的真前缀时i == leftMax.size()）
+        return rightMin.substr(0, i + 1);
+    }
+};
+
+/**
+ * 有序键的差分编码：序列化时相邻的键通常很接近，整数只写与前一个键之差的zigzag varint，
+ * 字符串只写与前一个键不同的后缀。SUPPORTED为false的类型按codec逐个写出
+ **/
+template<typename Key, typename Enable = void>
+struct Delta
+{
+    static constexpr bool SUPPORTED = false;
+};
+
+template<typename Key>
+struct Delta<Key, std::enable_if_t<std::is_integral<Key>::value>>
+{
+    static constexpr bool SUPPORTED = true;
+
+    static void encode(const Key& prev, const Key& key, std::string& out)
+    {
+        // 按无符号数回绕相减，比较器为降序时差为负数，zigzag后仍然很短
+        int64_t diff = static_cast<int64_t>(static_cast<uint64_t>(key) - static_cast<uint64_t>(prev));
+        codec::putVarint(out, (static_cast<uint64_t>(diff) << 1) ^ static_cast<uint64_t>(diff >> 63));
+    }
+
+    template<typename Source>
+    static bool decode(const Key& prev, Key& key, Source& in, std::vector<char>&)
+    {
+        uint64_t zigzag;
+        if(!codec::getVarint(in, zigzag))
+        {
+            return false;
+        }
+        uint64_t diff = (zigzag >> 1) ^ (~(zigzag & 1) + 1);
+        key = static_cast<Key>(static_cast<uint64_t>(prev) + diff);
+        return true;
+    }
+};
+
+template<>
+struct Delta<std::string>
+{
+    static constexpr bool SUPPORTED = true;
+
+    // 与前一个键的公共前缀长度、后缀长度、后缀
+    static void encode(const std::string& prev, const std::string& key, std::string& out)
+    {
+        std::size_t limit = std::min(prev.size(), key.size());
+        std::size_t shared = 0;
+        while(shared < limit && prev[shared] == key[shared])
+        {
+            shared++;
+        }
+        codec::putVarint(out, shared);
+        codec::putVarint(out, key.size() - shared);
+        out.append(key, shared, std::string::npos);
+    }
+
+    template<typename Source>
+    static bool decode(const std::string& prev, std::string& key, Source& in, std::vector<char>& scratch)
+    {
+        uint64_t shared, suffix;
+        if(!codec::getVarint(in, shared) || !codec::getVarint(in, suffix) || shared > prev.size() || suffix > UINT32_MAX)
+        {
+            return false;
+        }
+        scratch.resize(suffix);
+        if(!in.read(scratch.data(), suffix))
+        {
+            return false;
+        }
+        key.assign(prev, 0, shared);
+        key.append(scratch.data(), suffix);
+        return true;
+    }
+};
+
+} // namespace keycompress
+
+#endif
@@ -0,0 +1,321 @@
+#ifndef KEYSEARCH_H
+#define KEYSEARCH_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#if defined(__AVX2__) || defined(__SSE4_2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+/**
+ * 节点内的键查找：返回keys[0, n)中第一个不小于key的下标（要求keys已升序排列）。
+ * 对使用std::less比较的int32、int64、float键，按编译目标选择AVX2/SSE实现，
+ * 一次比较一整个向量并在遇到不小于key的元素时提前结束；其余情况使用无分支的二分查找
+ **/
+namespace keysearch
+{
+
+// 无分支二分查找：循环次数只取决于n，不会因比较结果分支预测失败
+template<typename Key>
+inline int branchlessLowerBound(const Key* keys, int n, const Key& key) noexcept
+{
+    if(n <= 0)
+    {
+        return 0;
+    }
+
+    const Key* base = keys;
+    int len = n;
+    while(len > 1)
+    {
+        int half = len >> 1;
+        base += (base[half - 1] < key) ? half : 0;
+        len -= half;
+    }
+    return static_cast<int>(base - keys) + (*base < key);
+}
+
+#if defined(__SSE2__)
+template<typename Key>
+inline int simdLowerBound32(const Key* keys, int n, Key key) noexcept
+{
+    int i = 0;
+#if defined(__AVX2__)
+    const __m256i k = _mm256_set1_epi32(key);
+    for(; i + 8 <= n; i += 8)
+    {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(keys + i));
+        int mask = _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(k, v)));
+        if(mask != 0xFF)
+        {
+            return i + __builtin_popcount(mask);
+        }
+    }
+#else
+    const __m128i k = _mm_set1_epi32(key);
+    for(; i + 4 <= n; i += 4)
+    {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(keys + i));
+        int mask = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpgt_epi32(k, v)));
+        if(mask != 0xF)
+        {
+            return i + __builtin_popcount(mask);
+        }
+    }
+#endif
+    while(i < n && keys[i] < key)
+    {
+        i++;
+    }
+    return i;
+}
+#endif
+
+#if defined(__SSE4_2__)
+template<typename Key>
+inline int simdLowerBound64(const Key* keys, int n, Key key) noexcept
+{
+    int i = 0;
+#if defined(__AVX2__)
+    const __m256i k = _mm256_set1_epi64x(key);
+    for(; i + 4 <= n; i += 4)
+    {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(keys + i));
+        int mask = _mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpgt_epi64(k, v)));
+        if(mask != 0xF)
+        {
+            return i + __builtin_popcount(mask);
+        }
+    }
+#else
+    const __m128i k = _mm_set1_epi64x(key);
+    for(; i + 2 <= n; i += 2)
+    {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(keys + i));
+        int mask = _mm_movemask_pd(_mm_castsi128_pd(_mm_cmpgt_epi64(k, v)));
+        if(mask != 0x3)
+        {
+            return i + __builtin_popcount(mask);
+        }
+    }
+#endif
+    while(i < n && keys[i] < key)
+    {
+        i++;
+    }
+    return i;
+}
+#endif
+
+#if defined(__SSE2__)
+inline int simdLowerBoundFloat(const float* keys, int n, float key) noexcept
+{
+    int i = 0;
+#if defined(__AVX2__)
+    const __m256 k = _mm256_set1_ps(key);
+    for(; i + 8 <= n; i += 8)
+    {
+        int mask = _mm256_movemask_ps(_mm256_cmp_ps(_mm256_loadu_ps(keys + i), k, _CMP_LT_OQ));
+        if(mask != 0xFF)
+        {
+            return i + __builtin_popcount(mask);
+        }
+    }
+#else
+    const __m128 k = _mm_set1_ps(key);
+    for(; i + 4 <= n; i += 4)
+    {
+        int mask = _mm_movemask_ps(_mm_cmplt_ps(_mm_loadu_ps(keys + i), k));
+        if(mask != 0xF)
+        {
+            return i + __builtin_popcount(mask);
+        }
+    }
+#endif
+    while(i < n && keys[i] < key)
+    {
+        i++;
+    }
+    return i;
+}
+#endif
+
+template<typename Key>
+constexpr bool isSignedInt(std::size_t bytes)
+{
+    return std::is_integral<Key>::value && std::is_signed<Key>::value && sizeof(Key) == bytes;
+}
+
+} // namespace keysearch
+
+// 通用版本：没有可用的向量化实现，由调用方使用自己的比较器查找
+template<typename Key, typename Compare, typename = void>
+struct KeySearch
+{
+    static constexpr bool ENABLED = false;
+};
+
+template<typename Key>
+struct KeySearch<Key, std::less<Key>, std::enable_if_t<keysearch::isSignedInt<Key>(4)>>
+{
+    static constexpr bool ENABLED = true;
+
+    static inline int lowerBound(const Key* keys, int n, Key key) noexcept
+    {
+#if defined(__SSE2__)
+        return keysearch::simdLowerBound32(keys, n, key);
+#else
+        return keysearch::branchlessLowerBound(keys, n, key);
+#endif
+    }
+};
+
+template<typename Key>
+struct KeySearch<Key, std::less<Key>, std::enable_if_t<keysearch::isSignedInt<Key>(8)>>
+{
+    static constexpr bool ENABLED = true;
+
+    static inline int lowerBound(const Key* keys, int n, Key key) noexcept
+    {
+#if defined(__SSE4_2__)
+        return keysearch::simdLowerBound64(keys, n, key);
+#else
+        return keysearch::branchlessLowerBound(keys, n, key);
+#endif
+    }
+};
+
+template<>
+struct KeySearch<float, std::less<float>>
+{
+    static constexpr bool ENABLED = true;
+
+    static inline int lowerBound(const float* keys, int n, float key) noexcept
+    {
+#if defined(__SSE2__)
+        return keysearch::simdLowerBoundFloat(keys, n, key);
+#else
+        return keysearch::branchlessLowerBound(keys, n, key);
+#endif
+    }
+};
+
+namespace keysearch
+{
+
+// 有序数组keys[0, n)中第一个大于等于key的下标：算术键用向量化比较，其余键二分查找
+template<typename Key, typename Compare>
+inline int lowerBound(const Key* keys, int n, const Key& key, const Compare& compare) noexcept
+{
+    if constexpr(KeySearch<Key,Compare>::ENABLED)
+    {
+        return KeySearch<Key,Compare>::lowerBound(keys, n, key);
+    }
+
+    // 避免因为极端情况导致的查询效果低下
+    if(!n || !compare(keys[0],key))
+    {
+        return 0;
+    }
+
+    if(n && compare(keys[n-1],key))
+    {
+        return n;
+    } 
+
+    int i = 1, j = n - 1;
+    while(i <= j)
+    {
+        int mid = i + ((j - i) >> 1);
+        if(keys[mid] == key)
+        {
+            return mid;
+        }
+
+        if(compare(keys[mid],key)) 
+        {
+            i = mid + 1;
+        }
+        else
+        {
+            j = mid - 1;
+        }
+    }
+
+    return i;
+}
+
+} // namespace keysearch
+
+/**
+ * 批量操作的排序：按proj取出的键稳定排序（相等的键保持原顺序）。
+ * 乱序输入下比较排序的每次比较都难以预测，用std::less比较的整数键改为按字节的LSD基数排序，
+ * 所有元素在某个字节上都相同时跳过该趟，集中在一段范围内的键通常只需两趟
+ **/
+template<typename Key, typename Compare, typename = void>
+struct KeySort
+{
+    template<typename T, typename Proj>
+    static void stableSort(std::vector<T>& items, Proj proj, const Compare& compare)
+    {
+        std::stable_sort(items.begin(), items.end(), [&](const T& a, const T& b)
+        {
+            return compare(proj(a), proj(b));
+        });
+    }
+};
+
+template<typename Key>
+struct KeySort<Key, std::less<Key>, std::enable_if_t<std::is_integral<Key>::value>>
+{
+    // 元素较少时分配缓冲区和计数的开销超过比较排序
+    static constexpr std::size_t RADIX_MIN = 256;
+
+    template<typename T, typename Proj>
+    static void stableSort(std::vector<T>& items, Proj proj, const std::less<Key>& compare)
+    {
+        if(items.size() < RADIX_MIN)
+        {
+            std::stable_sort(items.begin(), items.end(), [&](const T& a, const T& b)
+            {
+                return compare(proj(a), proj(b));
+            });
+            return;
+        }
+
+        // 有符号数翻转符号位后按无符号数的顺序排列
+        using Bits = std::make_unsigned_t<Key>;
+        const Bits flip = std::is_signed<Key>::value ? static_cast<Bits>(Bits(1) << (sizeof(Key) * 8 - 1)) : Bits(0);
+        std::vector<T> buffer(items.size());
+        for(std::size_t shift = 0; shift < sizeof(Key) * 8; shift += 8)
+        {
+            std::size_t count[257] = {};
+            for(const T& item : items)
+            {
+                count[((static_cast<Bits>(proj(item)) ^ flip) >> shift & 0xFF) + 1]++;
+            }
+            if(std::find(count + 1, count + 257, items.size()) != count + 257)
+            {
+                continue;
+            }
+            for(int digit = 1; digit <= 256; digit++)
+            {
+                count[digit] += count[digit - 1];
+            }
+            for(T& item : items)
+            {
+                std::size_t digit = (static_cast<Bits>(proj(item)) ^ flip) >> shift & 0xFF;
+                buffer[count[digit]++] = std::move(item);
+            }
+            items.swap(buffer);
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,458 @@
+#ifndef LEAFSTORAGE_H
+#define LEAFSTORAGE_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "KeySearch.h"
+#include "Codec.h"
+
+/**
+ * 叶子节点中键值对的存放方式，叶子的插入、删除、分裂与合并只通过下面的操作访问键值：
+ *   key(i)/value(i)                 读取第i个键值
+ *   lowerBound/keyEquals/keyBefore/keyAfter  与第i个键比较
+ *   put(i, key, value)              在第i个位置写入新的键值对
+ *   move(dst, src)                  叶子内移动键值对，release(i)丢弃第i个键值对
+ *   admit(key, n)/admitFrom(src, n) 写入key或拷贝src的键值对之前调整存储（前缀压缩）
+ *   copy(dst, src, i)               从另一个叶子拷贝键值对（分裂、合并）
+ *   tidy(n)/compact(n)              整理存储，n为叶子中的键数
+ * 键和值都可按位拷贝（或无法编码）时用定长数组ArrayStorage，乐观读者可以直接读取；
+ * 否则用槽页SlottedStorage：槽数组按键序记录每个键值对在叶子堆中的位置，
+ * 所有键和值的编码连续存放在叶子自己的一块堆内存中，不再为每个std::string单独分配内存。
+ * 按字节比较的键还做前缀压缩：叶子中所有键的公共前缀在堆首只存一份，槽中只记后缀，
+ * 查找时先用前缀判断key是否落在叶子的键之间，再只比较后缀
+ **/
+namespace leafstore
+{
+
+// 有不能按位拷贝的键或值，且两者都能用codec编码时使用槽页
+template<typename Key, typename Value>
+struct Slotted
+{
+    static constexpr bool value = !(std::is_trivially_copyable<Key>::value && std::is_trivially_copyable<Value>::value)
+                                  && codec::Codec<Key>::SUPPORTED && codec::Codec<Value>::SUPPORTED;
+};
+
+// 编码后的字节序即键序时，槽页直接比较堆中的字节，查找时不必解码出键对象
+template<typename Key, typename Compare>
+struct ByteOrdered
+{
+    static constexpr bool value = false;
+};
+
+template<>
+struct ByteOrdered<std::string, std::less<std::string>>
+{
+    static constexpr bool value = true;
+};
+
+template<int order, typename Key, typename Value, typename Compare>
+struct ArrayStorage
+{
+    using KeyRef = const Key&;
+    using ValueRef = const Value&;
+
+    Key keys[order];
+    Value values[order];
+
+    KeyRef key(int i) const { return this->keys[i]; }
+    ValueRef value(int i) const { return this->values[i]; }
+
+    // [0, n)中第一个大于等于key的下标
+    int lowerBound(int n, const Key& key, const Compare& compare) const noexcept
+    {
+        return keysearch::lowerBound(this->keys, n, key, compare);
+    }
+
+    bool keyEquals(int i, const Key& key) const { return this->keys[i] == key; }
+    // 第i个键小于key
+    bool keyBefore(int i, const Key& key, const Compare& compare) const { return compare(this->keys[i], key); }
+    // key小于第i个键
+    bool keyAfter(int i, const Key& key, const Compare& compare) const { return compare(key, this->keys[i]); }
+
+    template<typename K, typename V>
+    void put(int i, K&& key, V&& value)
+    {
+        this->keys[i] = std::forward<K>(key);
+        this->values[i] = std::forward<V>(value);
+    }
+
+    template<typename V>
+    void setValue(int i, V&& value) { this->values[i] = std::forward<V>(value); }
+
+    void move(int dst, int src)
+    {
+        this->keys[dst] = std::move(this->keys[src]);
+        this->values[dst] = std::move(this->values[src]);
+    }
+
+    void copy(int dst, const ArrayStorage& src, int i)
+    {
+        this->keys[dst] = src.keys[i];
+        this->values[dst] = src.values[i];
+    }
+
+    void admit(const Key&, int) {}
+    void admitFrom(const ArrayStorage&, int) {}
+
+    void release(int) {}
+    void tidy(int) {}
+    void compact(int) {}
+
+    // 节点之外另行占用的字节数
+    std::size_t heapBytes() const { return 0; }
+};
+
+template<int order, typename Key, typename Value, typename Compare>
+struct SlottedStorage
+{
+    static constexpr bool BYTE_ORDERED = ByteOrdered<Key, Compare>::value;
+    using KeyRef = Key;
+    using ValueRef = Value;
+
+    // 第i个键值对的编码位于heap[offset, offset + keyBytes + valueBytes)，键（去掉公共前缀）在前值在后
+    struct Slot
+    {
+        uint32_t offset;
+        uint32_t keyBytes;
+        uint32_t valueBytes;
+    };
+
+    Slot slots[order];
+    std::vector<char> heap; // [0, prefixBytes)是所有键的公共前缀，之后是各键值对的记录
+    uint32_t prefixBytes = 0; // 只有按字节比较的键才有前缀
+    uint32_t garbage = 0; // heap中已被删除或覆盖的记录字节数
+
+    Key key(int i) const
+    {
+        if constexpr(BYTE_ORDERED)
+        {
+            std::string_view suffix = this->keyBytes(i);
+            Key key;
+            key.reserve(this->prefixBytes + suffix.size());
+            key.append(this->heap.data(), this->prefixBytes);
+            key.append(suffix.data(), suffix.size());
+            return key;
+        }
+        else
+        {
+            return decoded<Key>(this->heap.data() + this->slots[i].offset, this->slots[i].keyBytes);
+        }
+    }
+
+    Value value(int i) const
+    {
+        const Slot& slot = this->slots[i];
+        return decoded<Value>(this->heap.data() + slot.offset + slot.keyBytes, slot.valueBytes);
+    }
+
+    int lowerBound(int n, const Key& key, const Compare& compare) const
+    {
+        if constexpr(BYTE_ORDERED)
+        {
+            // 不以前缀开头的key小于或大于叶子中所有的键
+            int head = this->comparePrefix(key);
+            if(head != 0)
+            {
+                return head < 0 ? 0 : n;
+            }
+            std::string_view rest = std::string_view(key).substr(this->prefixBytes);
+            int i = 0, j = n;
+            while(i < j)
+            {
+                int mid = i + ((j - i) >> 1);
+                if(this->keyBytes(mid) < rest)
+                {
+                    i = mid + 1;
+                }
+                else
+                {
+                    j = mid;
+                }
+            }
+            return i;
+        }
+        else
+        {
+            int i = 0, j = n;
+            while(i < j)
+            {
+                int mid = i + ((j - i) >> 1);
+                if(compare(this->key(mid), key))
+                {
+                    i = mid + 1;
+                }
+                else
+                {
+                    j = mid;
+                }
+            }
+            return i;
+        }
+    }
+
+    bool keyEquals(int i, const Key& key) const
+    {
+        if constexpr(BYTE_ORDERED)
+        {
+            return this->comparePrefix(key) == 0 && this->keyBytes(i) == std::string_view(key).substr(this->prefixBytes);
+        }
+        else
+        {
+            return this->key(i) == key;
+        }
+    }
+
+    bool keyBefore(int i, const Key& key, const Compare& compare) const
+    {
+        if constexpr(BYTE_ORDERED)
+        {
+            int head = this->comparePrefix(key);
+            return head != 0 ? head > 0 : this->keyBytes(i) < std::string_view(key).substr(this->prefixBytes);
+        }
+        else
+        {
+            return compare(this->key(i), key);
+        }
+    }
+
+    bool keyAfter(int i, const Key& key, const Compare& compare) const
+    {
+        if constexpr(BYTE_ORDERED)
+        {
+            int head = this->comparePrefix(key);
+            return head != 0 ? head < 0 : std::string_view(key).substr(this->prefixBytes) < this->keyBytes(i);
+        }
+        else
+        {
+            return compare(key, this->key(i));
+        }
+    }
+
+    // 写入不以当前前缀开头的key之前把前缀缩短为两者的公共部分，n为叶子中的键数
+    void admit(const Key& key, int n)
+    {
+        if constexpr(BYTE_ORDERED)
+        {
+            if(this->comparePrefix(key) != 0)
+            {
+                this->rebuild(n, common(this->prefix(), key));
+            }
+        }
+    }
+
+    // 拷贝src的键值对之前使自身的前缀是src前缀的前缀；自身为空时直接沿用src的前缀
+    void admitFrom(const SlottedStorage& src, int n)
+    {
+        if constexpr(BYTE_ORDERED)
+        {
+            if(n == 0)
+            {
+                this->heap.assign(src.heap.data(), src.heap.data() + src.prefixBytes);
+                this->prefixBytes = src.prefixBytes;
+                this->garbage = 0;
+            }
+            else if(common(this->prefix(), src.prefix()) < this->prefixBytes)
+            {
+                this->rebuild(n, common(this->prefix(), src.prefix()));
+            }
+        }
+    }
+
+    // 调用前须已用admit使key以当前前缀开头
+    template<typename K, typename V>
+    void put(int i, K&& key, V&& value)
+    {
+        Slot& slot = this->slots[i];
+        slot.offset = static_cast<uint32_t>(this->heap.size());
+        if constexpr(BYTE_ORDERED)
+        {
+            std::string_view suffix = std::string_view(key).substr(this->prefixBytes);
+            this->heap.insert(this->heap.end(), suffix.begin(), suffix.end());
+        }
+        else
+        {
+            append(this->heap, key);
+        }
+        slot.keyBytes = static_cast<uint32_t>(this->heap.size() - slot.offset);
+        append(this->heap, value);
+        slot.valueBytes = static_cast<uint32_t>(this->heap.size() - slot.offset - slot.keyBytes);
+    }
+
+    // 新值不长于旧值时原地覆盖，否则把键和新值写到堆末尾
+    template<typename V>
+    void setValue(int i, V&& value)
+    {
+        Slot& slot = this->slots[i];
+        std::size_t bytes = encodedSize(value);
+        if(bytes <= slot.valueBytes)
+        {
+            encode(value, this->heap.data() + slot.offset + slot.keyBytes);
+            this->garbage += slot.valueBytes - static_cast<uint32_t>(bytes);
+            slot.valueBytes = static_cast<uint32_t>(bytes);
+            return;
+        }
+        this->garbage += slot.keyBytes + slot.valueBytes;
+        std::size_t offset = this->heap.size();
+        this->heap.resize(offset + slot.keyBytes + bytes);
+        std::memcpy(this->heap.data() + offset, this->heap.data() + slot.offset, slot.keyBytes);
+        encode(value, this->heap.data() + offset + slot.keyBytes);
+        slot.offset = static_cast<uint32_t>(offset);
+        slot.valueBytes = static_cast<uint32_t>(bytes);
+    }
+
+    // 槽只是堆中记录的位置，叶子内移动键值对不拷贝数据
+    void move(int dst, int src) { this->slots[dst] = this->slots[src]; }
+
+    // 调用前须已用admitFrom使自身前缀是src前缀的前缀，src前缀多出的部分补进后缀
+    void copy(int dst, const SlottedStorage& src, int i)
+    {
+        const Slot& from = src.slots[i];
+        Slot& slot = this->slots[dst];
+        slot = from;
+        slot.offset = static_cast<uint32_t>(this->heap.size());
+        slot.keyBytes += src.prefixBytes - this->prefixBytes;
+        this->heap.insert(this->heap.end(), src.heap.data() + this->prefixBytes, src.heap.data() + src.prefixBytes);
+        const char* record = src.heap.data() + from.offset;
+        this->heap.insert(this->heap.end(), record, record + from.keyBytes + from.valueBytes);
+    }
+
+    void release(int i) { this->garbage += this->slots[i].keyBytes + this->slots[i].valueBytes; }
+
+    // 删除和覆盖留下的空洞超过堆的一半时整理
+    void tidy(int n)
+    {
+        if(this->garbage > ((this->heap.size() - this->prefixBytes) >> 1))
+        {
+            this->compact(n);
+        }
+    }
+
+    // 按槽的顺序把[0, n)的记录重新紧凑地写入新堆；有序的键的公共前缀就是首尾两个键的公共前缀，借此把前缀延长
+    void compact(int n)
+    {
+        uint32_t length = 0;
+        if constexpr(BYTE_ORDERED)
+        {
+            length = n > 0 ? this->prefixBytes + common(this->keyBytes(0), this->keyBytes(n - 1)) : 0;
+        }
+        this->rebuild(n, length);
+    }
+
+    std::size_t heapBytes() const { return this->heap.capacity(); }
+
+private:
+    std::string_view prefix() const { return std::string_view(this->heap.data(), this->prefixBytes); }
+
+    std::string_view keyBytes(int i) const { return std::string_view(this->heap.data() + this->slots[i].offset, this->slots[i].keyBytes); }
+
+    // key的前prefixBytes个字节与前缀比较：0表示key以前缀开头，否则key小于（负）或大于（正）叶子中所有的键
+    int comparePrefix(const Key& key) const
+    {
+        return std::string_view(key).compare(0, this->prefixBytes, this->prefix());
+    }
+
+    static uint32_t common(std::string_view a, std::string_view b)
+    {
+        std::size_t limit = std::min(a.size(), b.size());
+        std::size_t i = 0;
+        while(i < limit && a[i] == b[i])
+        {
+            i++;
+        }
+        return static_cast<uint32_t>(i);
+    }
+
+    // 以第0个键的前length个字节为新前缀，把[0, n)的记录紧凑地写入新堆；前缀缩短时多出的字节补回各个后缀
+    void rebuild(int n, uint32_t length)
+    {
+        std::string_view prefix = this->prefix();
+        uint32_t restored = prefix.size() > length ? static_cast<uint32_t>(prefix.size()) - length : 0;
+        uint32_t dropped = length > prefix.size() ? length - static_cast<uint32_t>(prefix.size()) : 0;
+        std::vector<char> next;
+        next.reserve(length + this->heap.size() - this->prefixBytes - this->garbage + static_cast<std::size_t>(n) * restored);
+        next.insert(next.end(), prefix.begin(), prefix.begin() + std::min<std::size_t>(length, prefix.size()));
+        if(dropped > 0)
+        {
+            std::string_view first = this->keyBytes(0);
+            next.insert(next.end(), first.begin(), first.begin() + dropped);
+        }
+        for(int i = 0; i < n; i++)
+        {
+            Slot& slot = this->slots[i];
+            const char* record = this->heap.data() + slot.offset;
+            uint32_t offset = static_cast<uint32_t>(next.size());
+            next.insert(next.end(), prefix.end() - restored, prefix.end());
+            next.insert(next.end(), record + dropped, record + slot.keyBytes + slot.valueBytes);
+            slot.offset = offset;
+            slot.keyBytes = slot.keyBytes + restored - dropped;
+        }
+        this->heap.swap(next);
+        this->prefixBytes = length;
+        this->garbage = 0;
+    }
+
+    template<typename T>
+    static std::size_t encodedSize(const T& item)
+    {
+        if constexpr(codec::Codec<T>::FIXED)
+        {
+            return sizeof(T);
+        }
+        else
+        {
+            return codec::Codec<T>::size(item);
+        }
+    }
+
+    template<typename T>
+    static void encode(const T& item, char* out)
+    {
+        if constexpr(codec::Codec<T>::FIXED)
+        {
+            std::memcpy(out, &item, sizeof(T));
+        }
+        else
+        {
+            codec::Codec<T>::encode(item, out);
+        }
+    }
+
+    template<typename T>
+    static void append(std::vector<char>& heap, const T& item)
+    {
+        std::size_t offset = heap.size();
+        heap.resize(offset + encodedSize(item));
+        encode(item, heap.data() + offset);
+    }
+
+    template<typename T>
+    static T decoded(const char* data, std::size_t bytes)
+    {
+        T item;
+        if constexpr(codec::Codec<T>::FIXED)
+        {
+            std::memcpy(&item, data, sizeof(T));
+        }
+        else
+        {
+            codec::Codec<T>::decode(data, bytes, item);
+        }
+        return item;
+    }
+};
+
+template<int order, typename Key, typename Value, typename Compare>
+using Storage = std::conditional_t<Slotted<Key, Value>::value,
+                                   SlottedStorage<order, Key, Value, Compare>,
+                                   ArrayStorage<order, Key, Value, Compare>>;
+
+} // namespace leafstore
+
+#endif
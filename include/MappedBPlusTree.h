@@ -0,0 +1,284 @@
+#ifndef MAPPEDBPLUSTREE_H
+#define MAPPEDBPLUSTREE_H
+
+#include <algorithm>
+#include <functional>
+#include <iostream>
+#include <iterator>
+#include <optional>
+#include <string>
+#include <utility>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "KeySearch.h"
+#include "PageFormat.h"
+
+/**
+ * 只读的内存映射B+树：直接 mmap 由 BPlusTree::writePages 写出的页文件，
+ * 打开时只校验文件头，节点所在的页在第一次被访问时才由缺页中断读入。
+ * 节点页没有校验和，每次访问时检查页号和关键字个数，下降的层数和沿叶子链表移动的步数也有上限，
+ * 损坏的文件不会造成越界访问或死循环，只会表现为找不到键或迭代提前结束
+ **/
+template<int order, typename Key, typename Value, typename Compare = std::less<Key>>
+class MappedBPlusTree
+{
+private:
+    using Layout = pagefile::Layout<order, Key, Value>;
+    using NodePage = typename Layout::NodePage;
+    using LeafPage = typename Layout::LeafPage;
+    using InnerPage = typename Layout::InnerPage;
+
+    static constexpr int MAX_HEIGHT = 64; // 与BPlusTree相同，超过时说明孩子页号成环
+
+    const char* base; // 映射的起始地址
+    std::size_t length; // 映射的字节数
+    Compare compare;
+
+    MappedBPlusTree(const char* base, std::size_t length) : base(base), length(length), compare(Compare()) {}
+
+    const pagefile::Header* header() const
+    {
+        return reinterpret_cast<const pagefile::Header*>(this->base);
+    }
+
+    // 页号越界或节点头不合法时返回nullptr
+    const NodePage* page(uint64_t id) const
+    {
+        if(id == pagefile::NO_PAGE || id >= this->header()->pageCount)
+        {
+            return nullptr;
+        }
+        const NodePage* node = reinterpret_cast<const NodePage*>(this->base + id * Layout::PAGE_SIZE);
+        if(node->isLeaf > 1 || node->n < (node->isLeaf ? 0 : 1) || node->n >= order)
+        {
+            return nullptr;
+        }
+        return node;
+    }
+
+    const LeafPage* leafPage(uint64_t id) const
+    {
+        const NodePage* node = this->page(id);
+        return node && node->isLeaf ? reinterpret_cast<const LeafPage*>(node) : nullptr;
+    }
+
+
+    // 返回第一个大于等于key的下标
+    int search(const NodePage* node, const Key& key) const
+    {
+        if constexpr(KeySearch<Key,Compare>::ENABLED)
+        {
+            return KeySearch<Key,Compare>::lowerBound(node->keys, node->n, key);
+        }
+        return std::lower_bound(node->keys, node->keys + node->n, key, this->compare) - node->keys;
+    }
+
+    // 下降到可能含有key的叶子，空树或文件损坏时返回nullptr
+    const LeafPage* findLeaf(const Key& key) const
+    {
+        const NodePage* node = this->page(this->header()->rootPage);
+        for(int depth = 1; node && !node->isLeaf; depth++)
+        {
+            // 与分隔键相等的key位于右子树
+            int arg = this->search(node, key);
+            if(arg < node->n && node->keys[arg] == key) arg++;
+            node = depth < MAX_HEIGHT ? this->page(reinterpret_cast<const InnerPage*>(node)->children[arg]) : nullptr;
+        }
+        return reinterpret_cast<const LeafPage*>(node);
+    }
+
+public:
+    /**
+     * 沿叶子页的前后页号移动的只读前向迭代器，leaf为nullptr表示end()
+     **/
+    class const_iterator
+    {
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = std::pair<Key, Value>;
+        using difference_type = std::ptrdiff_t;
+        using reference = std::pair<const Key&, const Value&>;
+        using pointer = void;
+
+        const_iterator() : tree(nullptr), leaf(nullptr), idx(0), hops(0) {}
+
+        const Key& key() const { return this->leaf->node.keys[this->idx]; }
+        const Value& value() const { return this->leaf->values[this->idx]; }
+        reference operator*() const { return reference(this->key(), this->value()); }
+
+        const_iterator& operator++()
+        {
+            this->idx++;
+            this->skipForward();
+            return *this;
+        }
+
+        const_iterator operator++(int)
+        {
+            const_iterator old = *this;
+            ++*this;
+            return old;
+        }
+
+        bool operator==(const const_iterator& other) const { return this->leaf == other.leaf && this->idx == other.idx; }
+        bool operator!=(const const_iterator& other) const { return !(*this == other); }
+
+    private:
+        friend class MappedBPlusTree;
+
+        const MappedBPlusTree* tree;
+        const LeafPage* leaf;
+        int idx;
+        uint64_t hops; // 已沿链表移动的叶子数，超过页数说明链表成环
+
+        const_iterator(const MappedBPlusTree* tree, const LeafPage* leaf, int idx) : tree(tree), leaf(leaf), idx(idx), hops(0)
+        {
+            this->skipForward();
+        }
+
+        // 越过叶子末尾时移到下一个非空叶子
+        void skipForward()
+        {
+            while(this->leaf && this->idx >= this->leaf->node.n)
+            {
+                bool cyclic = ++this->hops >= this->tree->header()->pageCount;
+                this->leaf = cyclic ? nullptr : this->tree->leafPage(this->leaf->next);
+                this->idx = 0;
+            }
+        }
+    };
+
+    MappedBPlusTree(const MappedBPlusTree&) = delete;
+    MappedBPlusTree& operator=(const MappedBPlusTree&) = delete;
+
+    ~MappedBPlusTree()
+    {
+        munmap(const_cast<char*>(this->base), this->length);
+    }
+
+    static MappedBPlusTree* open(const std::string& path);
+
+    long size() const { return this->header()->size; }
+
+    const Value* find(const Key& key) const;
+    std::optional<Value> get(const Key& key) const;
+    bool contains(const Key& key) const;
+
+    const_iterator begin() const { return const_iterator(this, this->leafPage(this->header()->headPage), 0); }
+    const_iterator end() const { return const_iterator(this, nullptr, 0); }
+    const_iterator lower_bound(const Key& key) const;
+};
+
+/**
+ * @brief  映射页文件并校验文件头，不读取任何节点
+ * @param  path 页文件路径
+ * @return MappedBPlusTree*  文件不存在、格式或模板参数不匹配时返回nullptr
+ */
+template<int order, typename Key, typename Value, typename Compare>
+MappedBPlusTree<order, Key, Value, Compare>* MappedBPlusTree<order, Key, Value, Compare>::open(const std::string& path)
+{
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if(fd < 0)
+    {
+        std::cerr << "Error: cannot open page file " << path << std::endl;
+        return nullptr;
+    }
+
+    struct stat st;
+    if(fstat(fd, &st) != 0 || static_cast<std::size_t>(st.st_size) < Layout::PAGE_SIZE)
+    {
+        std::cerr << "Error: page file " << path << " is truncated" << std::endl;
+        ::close(fd);
+        return nullptr;
+    }
+
+    std::size_t length = st.st_size;
+    void* addr = mmap(nullptr, length, PROT_READ, MAP_SHARED, fd, 0);
+    // 映射建立后文件描述符可以关闭
+    ::close(fd);
+    if(addr == MAP_FAILED)
+    {
+        std::cerr << "Error: cannot map page file " << path << std::endl;
+        return nullptr;
+    }
+
+    const pagefile::Header* header = static_cast<const pagefile::Header*>(addr);
+    if(header->magic != pagefile::MAGIC || header->order != order || header->keySize != sizeof(Key)
+       || header->valueSize != sizeof(Value) || header->pageSize != Layout::PAGE_SIZE
+       || header->pageCount * Layout::PAGE_SIZE != length)
+    {
+        std::cerr << "Error: page file " << path << " does not match current template parameters" << std::endl;
+        munmap(addr, length);
+        return nullptr;
+    }
+    return new MappedBPlusTree(static_cast<const char*>(addr), length);
+}
+
+/**
+ * @brief  根据键查找数据
+ * @param  key 要查找的键
+ * @return const Value*  指向映射页中值的指针，键不存在时返回nullptr；指针在树对象销毁前有效
+ */
+template<int order, typename Key, typename Value, typename Compare>
+const Value* MappedBPlusTree<order, Key, Value, Compare>::find(const Key& key) const
+{
+    const LeafPage* leaf = this->findLeaf(key);
+    if(leaf == nullptr)
+    {
+        return nullptr;
+    }
+
+    int arg = this->search(&leaf->node, key);
+    if(arg < leaf->node.n && leaf->node.keys[arg] == key)
+    {
+        return &leaf->values[arg];
+    }
+    return nullptr;
+}
+
+/**
+ * @brief  根据键查找数据并拷贝出值
+ * @param  key 要查找的键
+ * @return std::optional<Value>  键不存在时为空
+ */
+template<int order, typename Key, typename Value, typename Compare>
+std::optional<Value> MappedBPlusTree<order, Key, Value, Compare>::get(const Key& key) const
+{
+    const Value* value = this->find(key);
+    if(value == nullptr)
+    {
+        return std::nullopt;
+    }
+    return *value;
+}
+
+/**
+ * @brief  判断树中是否含有key
+ * @param  key 要查找的键
+ * @return bool
+ */
+template<int order, typename Key, typename Value, typename Compare>
+bool MappedBPlusTree<order, Key, Value, Compare>::contains(const Key& key) const
+{
+    return this->find(key) != nullptr;
+}
+
+/**
+ * @brief  定位第一个不小于key的元素
+ * @param  key 键值
+ * @return const_iterator 不存在时为end()
+ */
+template<int order, typename Key, typename Value, typename Compare>
+typename MappedBPlusTree<order, Key, Value, Compare>::const_iterator MappedBPlusTree<order, Key, Value, Compare>::lower_bound(const Key& key) const
+{
+    const LeafPage* leaf = this->findLeaf(key);
+    if(leaf == nullptr)
+    {
+        return this->end();
+    }
+    return const_iterator(this, leaf, this->search(&leaf->node, key));
+}
+
+#endif
@@ -0,0 +1,70 @@
+#ifndef NODEORDER_H
+#define NODEORDER_H
+
+#include <cstddef>
+#include <functional>
+#include <type_traits>
+#include "BPlusTree.h"
+
+/**
+ * 按硬件尺寸推导节点的阶数：策略给出节点的字节预算，阶数取节点不超过预算的最大值。
+ * 节点大小直接取BPlusTree实际的LeafNode和InnerNode（版本锁等头部、键值数组、指针和对齐填充都计算在内），
+ * 在编译期对阶数二分查找，不需要手工估算。
+ * BPlusTree的键数组位于两种节点的公共头部，叶子和非叶子节点只能共用一个阶数（扇出），
+ * 因此order()是两种节点都不超过预算的最大阶数，通常由值数组更大的叶子决定
+ **/
+namespace nodeorder
+{
+
+constexpr std::size_t CACHE_LINE = 64;
+constexpr int MIN_ORDER = 3;
+
+// [lo, hi]内两种节点都不超过budget字节的最大阶数，都超过时为lo-1（节点大小随阶数单调递增）
+template<typename Key, typename Value, std::size_t budget, int lo, int hi, bool empty = (lo > hi)>
+struct Largest
+{
+    static constexpr int mid = lo + (hi - lo) / 2;
+    using Tree = BPlusTree<mid, Key, Value>;
+    static constexpr bool fits = Tree::LEAF_BYTES <= budget && Tree::INNER_BYTES <= budget;
+    static constexpr int value = std::conditional_t<fits,
+        Largest<Key, Value, budget, mid + 1, hi>,
+        Largest<Key, Value, budget, lo, mid - 1>>::value;
+};
+
+template<typename Key, typename Value, std::size_t budget, int lo, int hi>
+struct Largest<Key, Value, budget, lo, hi, true>
+{
+    static constexpr int value = lo - 1;
+};
+
+// 每个节点不超过bytes字节
+template<std::size_t bytes>
+struct Budget
+{
+    static constexpr std::size_t BYTES = bytes;
+
+    // 叶子和非叶子节点共用的阶数；节点至少含有order个键，阶数不会超过bytes / sizeof(Key)
+    template<typename Key, typename Value>
+    static constexpr int order()
+    {
+        constexpr int result = Largest<Key, Value, bytes, MIN_ORDER, static_cast<int>(bytes / sizeof(Key))>::value;
+        static_assert(result >= MIN_ORDER, "node budget cannot hold a node of order 3");
+        return result;
+    }
+};
+
+// 节点占用lines个缓存行，适合内存中的随机读写
+template<std::size_t lines>
+struct CacheLineSized : Budget<lines * CACHE_LINE> {};
+
+// 节点占用一页，键多而树浅，适合扫描为主或节点数受限的场景
+template<std::size_t pageBytes>
+struct PageSized : Budget<pageBytes> {};
+
+} // namespace nodeorder
+
+// 阶数由策略推导的B+树，例如TunedBPlusTree<nodeorder::CacheLineSized<4>, int, int>
+template<typename Policy, typename Key, typename Value, typename Compare = std::less<Key>, typename Allocator = NodePool>
+using TunedBPlusTree = BPlusTree<Policy::template order<Key, Value>(), Key, Value, Compare, Allocator>;
+
+#endif
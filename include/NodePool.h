@@ -0,0 +1,280 @@
+#ifndef NODEPOOL_H
+#define NODEPOOL_H
+
+#include <algorithm>
+#include <cstddef>
+#include <mutex>
+#include <new>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+/**
+ * 节点分配器接口：allocate(bytes, alignment) / deallocate(p, bytes, alignment)。
+ * BPlusTree 通过模板参数接受任意满足该接口的分配器，节点的构造和析构由树负责。
+ * 可选接口 release()：一次归还分配器持有的全部内存，之前分配的块不必再逐个 deallocate
+ **/
+
+template<typename Allocator, typename = void>
+struct ReleasesAll : std::false_type {};
+
+template<typename Allocator>
+struct ReleasesAll<Allocator, std::void_t<decltype(std::declval<Allocator&>().release())>> : std::true_type {};
+
+// 直接使用全局的对齐 operator new / delete
+class NewDeleteAllocator
+{
+public:
+    void* allocate(std::size_t bytes, std::size_t alignment)
+    {
+        return ::operator new(bytes, std::align_val_t(alignment));
+    }
+
+    void deallocate(void* p, std::size_t bytes, std::size_t alignment) noexcept
+    {
+        ::operator delete(p, bytes, std::align_val_t(alignment));
+    }
+};
+
+/**
+ * 默认的节点池：按 64 字节粒度划分尺寸类，每个线程为每个尺寸类维护一条空闲链表。
+ * 链表为空时从全局仓库整条取回其他线程退出时归还的块，仓库也为空时才切分一个新的大块（slab）。
+ * 分配和释放在线程本地完成，稳定状态下不再调用 malloc；slab 在进程生命周期内不归还系统
+ **/
+class NodePool
+{
+public:
+    void* allocate(std::size_t bytes, std::size_t alignment)
+    {
+        std::size_t cls = sizeClass(bytes, alignment);
+        if(cls >= MAX_CLASSES)
+        {
+            return ::operator new(bytes, std::align_val_t(alignment));
+        }
+
+        ThreadCache& cache = threadCache();
+        if(cache.lists[cls] == nullptr)
+        {
+            cache.lists[cls] = refill(cls);
+        }
+        FreeBlock* block = cache.lists[cls];
+        cache.lists[cls] = block->next;
+        return block;
+    }
+
+    void deallocate(void* p, std::size_t bytes, std::size_t alignment) noexcept
+    {
+        std::size_t cls = sizeClass(bytes, alignment);
+        if(cls >= MAX_CLASSES)
+        {
+            ::operator delete(p, bytes, std::align_val_t(alignment));
+            return;
+        }
+
+        // 由哪个线程释放就回到哪个线程的空闲链表
+        ThreadCache& cache = threadCache();
+        FreeBlock* block = static_cast<FreeBlock*>(p);
+        block->next = cache.lists[cls];
+        cache.lists[cls] = block;
+    }
+
+private:
+    static constexpr std::size_t BLOCK_ALIGN = 64; // 节点按缓存行对齐
+    static constexpr std::size_t MAX_CLASSES = 256; // 16KB 以上的节点直接走 operator new
+    static constexpr std::size_t SLAB_BYTES = 1 << 20;
+
+    struct FreeBlock
+    {
+        FreeBlock* next;
+    };
+
+    // 线程本地的空闲链表，线程退出时整条归还给仓库
+    struct ThreadCache
+    {
+        FreeBlock* lists[MAX_CLASSES] = {};
+
+        ~ThreadCache()
+        {
+            Depot& d = depot();
+            std::lock_guard<std::mutex> guard(d.mtx);
+            for(std::size_t cls = 0; cls < MAX_CLASSES; cls++)
+            {
+                while(this->lists[cls])
+                {
+                    FreeBlock* block = this->lists[cls];
+                    this->lists[cls] = block->next;
+                    block->next = d.lists[cls];
+                    d.lists[cls] = block;
+                }
+            }
+        }
+    };
+
+    struct Depot
+    {
+        std::mutex mtx;
+        FreeBlock* lists[MAX_CLASSES] = {};
+        std::vector<void*> slabs;
+    };
+
+    static std::size_t sizeClass(std::size_t bytes, std::size_t alignment) noexcept
+    {
+        if(alignment > BLOCK_ALIGN)
+        {
+            return MAX_CLASSES;
+        }
+        return (bytes + BLOCK_ALIGN - 1) / BLOCK_ALIGN;
+    }
+
+    static ThreadCache& threadCache()
+    {
+        thread_local ThreadCache cache;
+        return cache;
+    }
+
+    // 仓库及其 slab 永不析构，其他线程或静态对象析构时仍可能持有池中的块
+    static Depot& depot()
+    {
+        static Depot* d = new Depot();
+        return *d;
+    }
+
+    // 取回仓库中该尺寸类的整条链表，没有则切分一个新的 slab
+    static FreeBlock* refill(std::size_t cls)
+    {
+        Depot& d = depot();
+        std::lock_guard<std::mutex> guard(d.mtx);
+        if(d.lists[cls])
+        {
+            FreeBlock* list = d.lists[cls];
+            d.lists[cls] = nullptr;
+            return list;
+        }
+
+        std::size_t blockBytes = cls * BLOCK_ALIGN;
+        char* slab = static_cast<char*>(::operator new(SLAB_BYTES, std::align_val_t(BLOCK_ALIGN)));
+        d.slabs.push_back(slab);
+
+        FreeBlock* list = nullptr;
+        for(std::size_t offset = (SLAB_BYTES / blockBytes) * blockBytes; offset >= blockBytes; offset -= blockBytes)
+        {
+            FreeBlock* block = reinterpret_cast<FreeBlock*>(slab + offset - blockBytes);
+            block->next = list;
+            list = block;
+        }
+        return list;
+    }
+};
+
+/**
+ * 每棵树独占的节点 arena：按 64 字节粒度的尺寸类维护空闲链表，链表为空时从本 arena 当前的大块中顺序切分。
+ * 与 NodePool 不同，大块属于分配器实例而不是整个进程，release() 一次归还全部大块，
+ * 键和值都无需析构时 BPlusTree::clear 直接丢弃大块，不再逐个访问节点。分配和释放由一把互斥量保护。
+ * 16KB 以上或对齐超过 64 字节的节点单独分配，deallocate 时立即归还
+ **/
+class ArenaAllocator
+{
+public:
+    ArenaAllocator() = default;
+    ArenaAllocator(const ArenaAllocator&) = delete;
+    ArenaAllocator& operator=(const ArenaAllocator&) = delete;
+
+    ~ArenaAllocator()
+    {
+        this->release();
+    }
+
+    void* allocate(std::size_t bytes, std::size_t alignment)
+    {
+        std::size_t blockBytes = (bytes + BLOCK_ALIGN - 1) / BLOCK_ALIGN * BLOCK_ALIGN;
+        std::size_t cls = blockBytes / BLOCK_ALIGN;
+        std::lock_guard<std::mutex> guard(this->mtx);
+        if(alignment <= BLOCK_ALIGN && cls < MAX_CLASSES && this->lists[cls])
+        {
+            FreeBlock* block = this->lists[cls];
+            this->lists[cls] = block->next;
+            return block;
+        }
+
+        // 超过对齐粒度或尺寸类的节点单独分配，不进空闲链表
+        if(alignment > BLOCK_ALIGN || cls >= MAX_CLASSES)
+        {
+            std::size_t align = std::max(alignment, BLOCK_ALIGN);
+            void* p = ::operator new(blockBytes, std::align_val_t(align));
+            this->large.emplace(p, align);
+            return p;
+        }
+
+        if(this->remaining < blockBytes)
+        {
+            this->cursor = static_cast<char*>(::operator new(CHUNK_BYTES, std::align_val_t(BLOCK_ALIGN)));
+            this->remaining = CHUNK_BYTES;
+            this->chunks.push_back({this->cursor, BLOCK_ALIGN});
+        }
+        void* p = this->cursor;
+        this->cursor += blockBytes;
+        this->remaining -= blockBytes;
+        return p;
+    }
+
+    void deallocate(void* p, std::size_t bytes, std::size_t alignment) noexcept
+    {
+        std::size_t cls = (bytes + BLOCK_ALIGN - 1) / BLOCK_ALIGN;
+        std::lock_guard<std::mutex> guard(this->mtx);
+        if(alignment > BLOCK_ALIGN || cls >= MAX_CLASSES)
+        {
+            auto it = this->large.find(p);
+            ::operator delete(p, std::align_val_t(it->second));
+            this->large.erase(it);
+            return;
+        }
+        FreeBlock* block = static_cast<FreeBlock*>(p);
+        block->next = this->lists[cls];
+        this->lists[cls] = block;
+    }
+
+    // 归还全部大块，之前分配的块随之失效
+    void release() noexcept
+    {
+        std::lock_guard<std::mutex> guard(this->mtx);
+        for(const Chunk& chunk : this->chunks)
+        {
+            ::operator delete(chunk.p, std::align_val_t(chunk.alignment));
+        }
+        this->chunks.clear();
+        for(const auto& block : this->large)
+        {
+            ::operator delete(block.first, std::align_val_t(block.second));
+        }
+        this->large.clear();
+        std::fill(this->lists, this->lists + MAX_CLASSES, nullptr);
+        this->cursor = nullptr;
+        this->remaining = 0;
+    }
+
+private:
+    static constexpr std::size_t BLOCK_ALIGN = 64;
+    static constexpr std::size_t MAX_CLASSES = 256;
+    static constexpr std::size_t CHUNK_BYTES = 1 << 20;
+
+    struct FreeBlock
+    {
+        FreeBlock* next;
+    };
+
+    struct Chunk
+    {
+        void* p;
+        std::size_t alignment;
+    };
+
+    std::mutex mtx;
+    FreeBlock* lists[MAX_CLASSES] = {};
+    std::vector<Chunk> chunks;
+    std::unordered_map<void*, std::size_t> large; // 单独分配的节点 -> 对齐
+    char* cursor = nullptr; // 当前大块中尚未切分的部分
+    std::size_t remaining = 0;
+};
+
+#endif
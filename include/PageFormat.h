@@ -0,0 +1,71 @@
+#ifndef PAGEFORMAT_H
+#define PAGEFORMAT_H
+
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
+/**
+ * 定长页文件格式：第0页为文件头，其余每页保存一个节点，节点之间用页号互相引用。
+ * 页号乘以页大小即为文件内偏移，文件可以直接 mmap 后只读查询，无需反序列化。
+ * 节点按层序写出，同一层的节点（包括全部叶子）在文件中连续存放
+ **/
+namespace pagefile
+{
+
+constexpr uint64_t MAGIC = 0x3145474150545042ULL; // "BPTPAGE1"
+constexpr uint64_t NO_PAGE = 0; // 第0页是文件头，不会被节点引用
+
+// 文件头，记录校验所需的模板参数和根、首尾叶子的页号
+struct Header
+{
+    uint64_t magic;
+    uint32_t order;
+    uint32_t keySize;
+    uint32_t valueSize;
+    uint32_t pageSize;
+    uint64_t pageCount; // 包括文件头在内的总页数
+    uint64_t rootPage;
+    uint64_t headPage; // 第一个叶子
+    uint64_t tailPage; // 最后一个叶子
+    int64_t size; // 键值对个数
+};
+
+template<int order, typename Key, typename Value>
+struct Layout
+{
+    static_assert(std::is_trivially_copyable<Key>::value && std::is_trivially_copyable<Value>::value,
+                  "page file stores keys and values by their bytes");
+
+    // 叶子页和非叶子页的公共头部
+    struct NodePage
+    {
+        uint32_t isLeaf;
+        int32_t n;
+        Key keys[order];
+    };
+
+    struct LeafPage
+    {
+        NodePage node;
+        Value values[order];
+        uint64_t prev; // 前一个叶子的页号
+        uint64_t next; // 后一个叶子的页号
+    };
+
+    // keys[i]的左子树是children[i]，右子树是children[i+1]
+    struct InnerPage
+    {
+        NodePage node;
+        uint64_t children[order + 1];
+    };
+
+    static constexpr std::size_t maxOf(std::size_t a, std::size_t b) { return a > b ? a : b; }
+
+    // 页大小取能容纳任一种页和文件头的最小的缓存行整数倍
+    static constexpr std::size_t PAGE_SIZE = (maxOf(maxOf(sizeof(LeafPage), sizeof(InnerPage)), sizeof(Header)) + 63) / 64 * 64;
+};
+
+} // namespace pagefile
+
+#endif
@@ -0,0 +1,493 @@
+#ifndef PAGEDBPLUSTREE_H
+#define PAGEDBPLUSTREE_H
+
+#include <algorithm>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
+#include <string>
+#include "BufferPool.h"
+#include "KeySearch.h"
+#include "PageFormat.h"
+
+/**
+ * 磁盘上的B+树：节点是页文件中的定长页，孩子和前后叶子用页号引用，
+ * 访问节点时通过容量有限的缓冲池pin住页，因此树可以远大于内存，只有热点页常驻。
+ * 文件格式与BPlusTree::writePages相同，flush后也可以用MappedBPlusTree只读打开。
+ * 读操作共享、写操作独占树级读写锁；删除不做借位与合并，被删空的叶子保留在树中。
+ * 读写页失败或页内容损坏时操作返回错误；插入在分裂途中失败时各层页已不一致，
+ * 树进入失败状态：之后不再写回缓冲池中的页，所有操作都返回错误，需要重新打开。
+ * 页文件不保证崩溃或失败后的一致性：分裂途中已解除pin的脏页可能在失败前就被换出写回，
+ * 失败或崩溃后的文件可能含有只完成一部分的分裂（新的兄弟页已写入、父页还没有引用它），
+ * 只有flush成功返回时文件才与内存中的树一致
+ **/
+template<int order, typename Key, typename Value, typename Compare = std::less<Key>>
+class PagedBPlusTree
+{
+private:
+    using Layout = pagefile::Layout<order, Key, Value>;
+    using NodePage = typename Layout::NodePage;
+    using LeafPage = typename Layout::LeafPage;
+    using InnerPage = typename Layout::InnerPage;
+
+    static constexpr int MAX_HEIGHT = 64;
+    // 一次插入最多同时pin住6个页，读操作每次只pin一个页，所以任意多个读者并发时pin也不会永久等待
+    static constexpr std::size_t MIN_POOL_PAGES = 8;
+
+    mutable BufferPool pool;
+    mutable std::shared_mutex latch;
+    Compare compare;
+    bool failed; // 插入在分裂途中失败过
+
+    explicit PagedBPlusTree(std::size_t poolPages)
+        : pool(Layout::PAGE_SIZE, std::max(poolPages, MIN_POOL_PAGES)), compare(Compare()), failed(false) {}
+
+    // 返回第一个大于等于key的下标
+    int search(const NodePage* node, const Key& key) const
+    {
+        if constexpr(KeySearch<Key,Compare>::ENABLED)
+        {
+            return KeySearch<Key,Compare>::lowerBound(node->keys, node->n, key);
+        }
+        return std::lower_bound(node->keys, node->keys + node->n, key, this->compare) - node->keys;
+    }
+
+    // 非叶子节点中key所在的孩子下标：与分隔键相等的key位于右子树
+    int childIndex(const NodePage* node, const Key& key) const
+    {
+        int arg = this->search(node, key);
+        if(arg < node->n && node->keys[arg] == key) arg++;
+        return arg;
+    }
+
+    int descend(const Key& key, uint64_t root, uint64_t* path) const;
+
+    // 进入失败状态，之后的写回全部放弃；已经换出写回的页无法撤销
+    int fail()
+    {
+        this->failed = true;
+        this->pool.discardWrites();
+        return -1;
+    }
+
+public:
+    PagedBPlusTree(const PagedBPlusTree&) = delete;
+    PagedBPlusTree& operator=(const PagedBPlusTree&) = delete;
+
+    static PagedBPlusTree* open(const std::string& path, std::size_t poolPages);
+
+    int insert(Key key, Value value);
+    int remove(Key key);
+    std::optional<Value> get(const Key& key) const;
+    bool contains(const Key& key) const { return this->get(key).has_value(); }
+    long size() const;
+
+    // 把缓冲池中的脏页写回文件，析构时也会自动写回；失败状态下返回1
+    int flush() { return this->pool.flush(); }
+
+    // 缓冲池的命中、缺页和换出计数，用于确定池的大小
+    const BufferPool& bufferPool() const { return this->pool; }
+};
+
+/**
+ * @brief  打开（不存在则创建）页文件
+ * @param  path 页文件路径
+ * @param  poolPages 缓冲池最多缓存的页数（至少为8）
+ * @return PagedBPlusTree*  文件无法打开、读取或与模板参数不匹配时返回nullptr
+ */
+template<int order, typename Key, typename Value, typename Compare>
+PagedBPlusTree<order, Key, Value, Compare>* PagedBPlusTree<order, Key, Value, Compare>::open(const std::string& path, std::size_t poolPages)
+{
+    PagedBPlusTree* tree = new PagedBPlusTree(poolPages);
+    if(tree->pool.open(path) != 0)
+    {
+        std::cerr << "Error: cannot open page file " << path << std::endl;
+        delete tree;
+        return nullptr;
+    }
+
+    bool created = tree->pool.filePages() == 0;
+    bool matched = true;
+    {
+        PageGuard header(tree->pool, 0);
+        if(!header.valid())
+        {
+            std::cerr << "Error: cannot read page file " << path << std::endl;
+            delete tree;
+            return nullptr;
+        }
+        pagefile::Header* h = header.as<pagefile::Header>();
+        if(created)
+        {
+            h->magic = pagefile::MAGIC;
+            h->order = order;
+            h->keySize = sizeof(Key);
+            h->valueSize = sizeof(Value);
+            h->pageSize = Layout::PAGE_SIZE;
+            h->pageCount = 1;
+            header.markDirty();
+        }
+        else
+        {
+            matched = h->magic == pagefile::MAGIC && h->order == order && h->keySize == sizeof(Key)
+                      && h->valueSize == sizeof(Value) && h->pageSize == Layout::PAGE_SIZE;
+        }
+    }
+    if(!matched)
+    {
+        std::cerr << "Error: page file " << path << " does not match current template parameters" << std::endl;
+        delete tree;
+        return nullptr;
+    }
+    return tree;
+}
+
+/**
+ * @brief  从根页下降到可能含有key的叶子页，逐页pin和unpin
+ * @param  key 键值
+ * @param  root 根页号
+ * @param  path 输出根到叶子的页号
+ * @return int 路径长度，读页失败、页头损坏或超过MAX_HEIGHT层（孩子页号成环）时返回0
+ */
+template<int order, typename Key, typename Value, typename Compare>
+int PagedBPlusTree<order, Key, Value, Compare>::descend(const Key& key, uint64_t root, uint64_t* path) const
+{
+    int depth = 0;
+    uint64_t id = root;
+    while(depth < MAX_HEIGHT && id != 0)
+    {
+        path[depth++] = id;
+        PageGuard page(this->pool, id);
+        if(!page.valid())
+        {
+            return 0;
+        }
+        const NodePage* node = page.as<NodePage>();
+        if(node->isLeaf > 1 || node->n < (node->isLeaf ? 0 : 1) || node->n >= order)
+        {
+            return 0;
+        }
+        if(node->isLeaf)
+        {
+            return depth;
+        }
+        id = page.as<InnerPage>()->children[this->childIndex(node, key)];
+    }
+    return 0;
+}
+
+/**
+ * @brief  插入键值对，叶子满时分裂并把分隔键逐层插入父节点
+ * @param  key 新的键
+ * @param  value 新的值
+ * @return int  0表示插入成功，1表示节点已存在，更新value，-1表示读写页失败或树处于失败状态
+ */
+template<int order, typename Key, typename Value, typename Compare>
+int PagedBPlusTree<order, Key, Value, Compare>::insert(Key key, Value value)
+{
+    std::unique_lock<std::shared_mutex> guard(this->latch);
+    if(this->failed)
+    {
+        return -1;
+    }
+    PageGuard header(this->pool, 0);
+    if(!header.valid())
+    {
+        return -1;
+    }
+    pagefile::Header* h = header.as<pagefile::Header>();
+
+    if(h->rootPage == pagefile::NO_PAGE)
+    {
+        PageGuard page(this->pool, h->pageCount);
+        if(!page.valid())
+        {
+            return -1;
+        }
+        uint64_t id = h->pageCount++;
+        header.markDirty();
+        LeafPage* leaf = page.as<LeafPage>();
+        std::memset(leaf, 0, Layout::PAGE_SIZE);
+        leaf->node.isLeaf = 1;
+        leaf->node.n = 1;
+        leaf->node.keys[0] = key;
+        leaf->values[0] = value;
+        page.markDirty();
+        h->rootPage = h->headPage = h->tailPage = id;
+        h->size++;
+        return 0;
+    }
+
+    uint64_t path[MAX_HEIGHT];
+    int depth = this->descend(key, h->rootPage, path);
+    if(depth == 0)
+    {
+        return -1;
+    }
+
+    PageGuard leafGuard(this->pool, path[depth - 1]);
+    if(!leafGuard.valid())
+    {
+        return -1;
+    }
+    LeafPage* leaf = leafGuard.as<LeafPage>();
+    int arg = this->search(&leaf->node, key);
+    if(arg < leaf->node.n && leaf->node.keys[arg] == key)
+    {
+        leaf->values[arg] = value;
+        leafGuard.markDirty();
+        return 1;
+    }
+
+    // 叶子要分裂时先pin住新页和后继叶子，失败时树还没有改动
+    std::optional<PageGuard> rightGuard, next;
+    if(leaf->node.n + 1 >= order)
+    {
+        rightGuard.emplace(this->pool, h->pageCount);
+        if(leaf->next != pagefile::NO_PAGE)
+        {
+            next.emplace(this->pool, leaf->next);
+        }
+        if(!rightGuard->valid() || (next && !next->valid()))
+        {
+            return -1;
+        }
+    }
+
+    header.markDirty();
+    leafGuard.markDirty();
+    for(int i = leaf->node.n; i > arg; i--)
+    {
+        leaf->node.keys[i] = leaf->node.keys[i - 1];
+        leaf->values[i] = leaf->values[i - 1];
+    }
+    leaf->node.keys[arg] = key;
+    leaf->values[arg] = value;
+    leaf->node.n++;
+    h->size++;
+    if(leaf->node.n < order)
+    {
+        return 0;
+    }
+
+    // 叶子分裂：后一半移入新页，新页接入叶子链表
+    int mid = (order >> 1);
+    uint64_t rightId = h->pageCount++;
+    LeafPage* right = rightGuard->as<LeafPage>();
+    std::memset(right, 0, Layout::PAGE_SIZE);
+    rightGuard->markDirty();
+    right->node.isLeaf = 1;
+    for(int i = 0, j = mid; j < leaf->node.n; i++, j++)
+    {
+        right->node.keys[i] = leaf->node.keys[j];
+        right->values[i] = leaf->values[j];
+        right->node.n++;
+    }
+    leaf->node.n = mid;
+    right->prev = path[depth - 1];
+    right->next = leaf->next;
+    if(next)
+    {
+        next->as<LeafPage>()->prev = rightId;
+        next->markDirty();
+    }
+    else
+    {
+        h->tailPage = rightId;
+    }
+    leaf->next = rightId;
+
+    // 分隔键逐层上移，直到某个父节点不再上溢出。下层已经分裂，此后pin失败只能进入失败状态
+    Key separator = right->node.keys[0];
+    uint64_t rightChild = rightId;
+    for(int level = depth - 2; level >= 0; level--)
+    {
+        PageGuard parentGuard(this->pool, path[level]);
+        if(!parentGuard.valid())
+        {
+            return this->fail();
+        }
+        InnerPage* parent = parentGuard.as<InnerPage>();
+        std::optional<PageGuard> newGuard;
+        if(parent->node.n + 1 >= order)
+        {
+            newGuard.emplace(this->pool, h->pageCount);
+            if(!newGuard->valid())
+            {
+                return this->fail();
+            }
+        }
+        parentGuard.markDirty();
+        int pos = this->search(&parent->node, separator);
+        for(int i = parent->node.n; i > pos; i--)
+        {
+            parent->node.keys[i] = parent->node.keys[i - 1];
+            parent->children[i + 1] = parent->children[i];
+        }
+        parent->node.keys[pos] = separator;
+        parent->children[pos + 1] = rightChild;
+        parent->node.n++;
+        if(parent->node.n < order)
+        {
+            return 0;
+        }
+
+        uint64_t newId = h->pageCount++;
+        InnerPage* sibling = newGuard->as<InnerPage>();
+        std::memset(sibling, 0, Layout::PAGE_SIZE);
+        newGuard->markDirty();
+        sibling->children[0] = parent->children[mid + 1];
+        for(int i = 0, j = mid + 1; j < parent->node.n; i++, j++)
+        {
+            sibling->node.keys[i] = parent->node.keys[j];
+            sibling->children[i + 1] = parent->children[j + 1];
+            sibling->node.n++;
+        }
+        separator = parent->node.keys[mid];
+        parent->node.n = mid;
+        rightChild = newId;
+    }
+
+    // 根结点分裂，树长高一层
+    PageGuard rootGuard(this->pool, h->pageCount);
+    if(!rootGuard.valid())
+    {
+        return this->fail();
+    }
+    uint64_t rootId = h->pageCount++;
+    InnerPage* root = rootGuard.as<InnerPage>();
+    std::memset(root, 0, Layout::PAGE_SIZE);
+    rootGuard.markDirty();
+    root->node.n = 1;
+    root->node.keys[0] = separator;
+    root->children[0] = path[0];
+    root->children[1] = rightChild;
+    h->rootPage = rootId;
+    return 0;
+}
+
+/**
+ * @brief  删除键（不做借位与合并）
+ * @param  key 要被删除的数据的键
+ * @return int  0表示删除成功，1表示键不存在，-1表示读写页失败或树处于失败状态
+ */
+template<int order, typename Key, typename Value, typename Compare>
+int PagedBPlusTree<order, Key, Value, Compare>::remove(Key key)
+{
+    std::unique_lock<std::shared_mutex> guard(this->latch);
+    if(this->failed)
+    {
+        return -1;
+    }
+    PageGuard header(this->pool, 0);
+    if(!header.valid())
+    {
+        return -1;
+    }
+    pagefile::Header* h = header.as<pagefile::Header>();
+    if(h->rootPage == pagefile::NO_PAGE)
+    {
+        return 1;
+    }
+
+    uint64_t path[MAX_HEIGHT];
+    int depth = this->descend(key, h->rootPage, path);
+    if(depth == 0)
+    {
+        return -1;
+    }
+    PageGuard leafGuard(this->pool, path[depth - 1]);
+    if(!leafGuard.valid())
+    {
+        return -1;
+    }
+    LeafPage* leaf = leafGuard.as<LeafPage>();
+    int arg = this->search(&leaf->node, key);
+    if(arg >= leaf->node.n || !(leaf->node.keys[arg] == key))
+    {
+        return 1;
+    }
+
+    for(int i = arg; i < leaf->node.n - 1; i++)
+    {
+        leaf->node.keys[i] = leaf->node.keys[i + 1];
+        leaf->values[i] = leaf->values[i + 1];
+    }
+    leaf->node.n--;
+    leafGuard.markDirty();
+    h->size--;
+    header.markDirty();
+    return 0;
+}
+
+/**
+ * @brief  根据键查找数据
+ * @param  key 要查找的键
+ * @return std::optional<Value>  键不存在、读页失败或树处于失败状态时为空
+ */
+template<int order, typename Key, typename Value, typename Compare>
+std::optional<Value> PagedBPlusTree<order, Key, Value, Compare>::get(const Key& key) const
+{
+    std::shared_lock<std::shared_mutex> guard(this->latch);
+    if(this->failed)
+    {
+        return std::nullopt;
+    }
+    uint64_t root;
+    {
+        PageGuard header(this->pool, 0);
+        if(!header.valid())
+        {
+            return std::nullopt;
+        }
+        root = header.as<pagefile::Header>()->rootPage;
+    }
+    if(root == pagefile::NO_PAGE)
+    {
+        return std::nullopt;
+    }
+
+    uint64_t path[MAX_HEIGHT];
+    int depth = this->descend(key, root, path);
+    if(depth == 0)
+    {
+        return std::nullopt;
+    }
+    PageGuard leafGuard(this->pool, path[depth - 1]);
+    if(!leafGuard.valid())
+    {
+        return std::nullopt;
+    }
+    const LeafPage* leaf = leafGuard.as<LeafPage>();
+    int arg = this->search(&leaf->node, key);
+    if(arg < leaf->node.n && leaf->node.keys[arg] == key)
+    {
+        return leaf->values[arg];
+    }
+    return std::nullopt;
+}
+
+/**
+ * @brief  键值对个数
+ * @return long  读页失败或树处于失败状态时返回-1
+ */
+template<int order, typename Key, typename Value, typename Compare>
+long PagedBPlusTree<order, Key, Value, Compare>::size() const
+{
+    std::shared_lock<std::shared_mutex> guard(this->latch);
+    if(this->failed)
+    {
+        return -1;
+    }
+    PageGuard header(this->pool, 0);
+    if(!header.valid())
+    {
+        return -1;
+    }
+    return header.as<pagefile::Header>()->size;
+}
+
+#endif
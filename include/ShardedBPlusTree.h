@@ -0,0 +1,338 @@
+#ifndef SHARDEDBPLUSTREE_H
+#define SHARDEDBPLUSTREE_H
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
+#include <utility>
+#include <vector>
+#include "BPlusTree.h"
+#include "EpochReclaim.h"
+#include "KeyCompression.h"
+
+/**
+ * 按键的范围分片的B+树：键空间被N-1个边界划分为N段，每段是一棵独立的BPlusTree，
+ * 各自的根结点、smoMutex和锁互不相干，不同分片上的结构修改可以并行。
+ * 点操作按边界路由到一个分片；范围扫描按分片顺序依次扫描，结果天然有序。
+ * rebalance把热点分片靠边界的一部分键迁移给较冷的相邻分片并移动边界，期间其他分片照常读写。
+ *
+ * 边界保存在不可变的Layout中，迁移时换成新的Layout。操作读取Layout后加分片锁，
+ * 再确认Layout没有变化，否则重新路由；旧Layout由纪元回收，路由中的读者不会读到被释放的边界。
+ * 回收在rebalance中进行，有待回收的Layout时点操作和bounds也会顺带尝试，不必等到下一次迁移
+ **/
+template<int order, typename Key, typename Value, typename Compare = std::less<Key>>
+class ShardedBPlusTree
+{
+public:
+    using Tree = BPlusTree<order, Key, Value, Compare>;
+
+    /**
+     * @brief  构造分片的树
+     * @param  bounds 严格递增的分片边界，第i个分片含有[bounds[i-1], bounds[i])内的键，共bounds.size()+1个分片
+     */
+    explicit ShardedBPlusTree(std::vector<Key> bounds) : compare(Compare())
+    {
+        assert(std::adjacent_find(bounds.begin(), bounds.end(), [this](const Key& a, const Key& b)
+        {
+            return !this->compare(a, b);
+        }) == bounds.end());
+        for(size_t i = 0; i <= bounds.size(); i++)
+        {
+            this->shards.push_back(new Shard());
+        }
+        this->layout = new Layout{std::move(bounds)};
+    }
+
+    ShardedBPlusTree(const ShardedBPlusTree&) = delete;
+    ShardedBPlusTree& operator=(const ShardedBPlusTree&) = delete;
+
+    ~ShardedBPlusTree()
+    {
+        for(Shard* shard : this->shards)
+        {
+            delete shard->tree;
+            delete shard;
+        }
+        delete this->layout.load();
+        for(auto& retired : this->retiredLayouts)
+        {
+            delete retired.second;
+        }
+    }
+
+    int insert(Key key, Value value)
+    {
+        return this->route(key, [&](Tree& tree) { return tree.insert(std::move(key), std::move(value)); });
+    }
+
+    int remove(Key key)
+    {
+        return this->route(key, [&](Tree& tree) { return tree.remove(std::move(key)); });
+    }
+
+    std::optional<Value> get(const Key& key) const
+    {
+        return this->route(key, [&](Tree& tree) { return tree.get(key); });
+    }
+
+    bool contains(const Key& key) const
+    {
+        return this->route(key, [&](Tree& tree) { return tree.contains(key); });
+    }
+
+    long size() const;
+    int shardCount() const { return this->shards.size(); }
+    std::vector<Key> bounds() const;
+
+    // 对[lo, hi)内的键值对按升序调用fn(const Key&, const Value&)；扫描某个分片时独占它，阻塞该分片的写者
+    template<typename Fn>
+    void scan(const Key& lo, const Key& hi, Fn&& fn) const;
+
+    long rebalance(double threshold = 2.0);
+
+private:
+    struct Layout
+    {
+        std::vector<Key> bounds;
+    };
+
+    struct alignas(64) Shard
+    {
+        Tree* tree = new Tree();
+        // 点操作共享持有（树内部自己处理并发），扫描和迁移独占持有
+        mutable std::shared_mutex latch;
+        std::atomic<uint64_t> ops{0}; // 上次rebalance之后路由到该分片的操作数
+    };
+
+    Compare compare;
+    std::vector<Shard*> shards;
+    std::atomic<Layout*> layout;
+    mutable epoch::Domain readers; // 路由中的操作登记的纪元，保护被替换的Layout
+    mutable std::mutex rebalanceMutex; // 同一时刻只有一次迁移，并保护retiredLayouts
+    mutable std::vector<std::pair<uint64_t, Layout*>> retiredLayouts;
+    mutable std::atomic<size_t> retiredCount{0}; // retiredLayouts的大小，读操作据此决定是否尝试回收
+
+    // 释放没有读者还在使用的旧Layout，须持有rebalanceMutex
+    void reclaimLayouts() const
+    {
+        uint64_t bound = this->readers.oldestActive();
+        while(!this->retiredLayouts.empty() && this->retiredLayouts.front().first < bound)
+        {
+            delete this->retiredLayouts.front().second;
+            this->retiredLayouts.erase(this->retiredLayouts.begin());
+        }
+        this->retiredCount.store(this->retiredLayouts.size(), std::memory_order_relaxed);
+    }
+
+    // 有待回收的Layout且没有迁移在进行时顺带回收，调用者不能处于纪元保护中
+    void tryReclaimLayouts() const
+    {
+        if(this->retiredCount.load(std::memory_order_relaxed) == 0)
+        {
+            return;
+        }
+        std::unique_lock<std::mutex> lock(this->rebalanceMutex, std::try_to_lock);
+        if(lock.owns_lock())
+        {
+            this->reclaimLayouts();
+        }
+    }
+
+    size_t shardOf(const Layout* layout, const Key& key) const
+    {
+        return std::upper_bound(layout->bounds.begin(), layout->bounds.end(), key, this->compare) - layout->bounds.begin();
+    }
+
+    template<typename Op>
+    auto route(const Key& key, Op&& op) const;
+};
+
+/**
+ * @brief  在含有key的分片上执行op：共享持有分片锁后Layout未变时边界有效，否则有迁移刚完成，重新路由
+ * @param  key 键值
+ * @param  op 形如R(Tree&)的回调
+ * @return op的返回值
+ */
+template<int order, typename Key, typename Value, typename Compare>
+template<typename Op>
+auto ShardedBPlusTree<order, Key, Value, Compare>::route(const Key& key, Op&& op) const
+{
+    this->tryReclaimLayouts();
+    epoch::Domain::Guard guard(&this->readers);
+    for(;;)
+    {
+        Layout* layout = this->layout.load(std::memory_order_acquire);
+        Shard* shard = this->shards[this->shardOf(layout, key)];
+        std::shared_lock<std::shared_mutex> lock(shard->latch);
+        if(this->layout.load(std::memory_order_acquire) == layout)
+        {
+            shard->ops.fetch_add(1, std::memory_order_relaxed);
+            return op(*shard->tree);
+        }
+    }
+}
+
+/**
+ * @brief  键值对总数，各分片分别读取，并发修改时只是近似值
+ * @return long
+ */
+template<int order, typename Key, typename Value, typename Compare>
+long ShardedBPlusTree<order, Key, Value, Compare>::size() const
+{
+    long total = 0;
+    for(Shard* shard : this->shards)
+    {
+        total += shard->tree->size;
+    }
+    return total;
+}
+
+/**
+ * @brief  当前的分片边界
+ * @return std::vector<Key>
+ */
+template<int order, typename Key, typename Value, typename Compare>
+std::vector<Key> ShardedBPlusTree<order, Key, Value, Compare>::bounds() const
+{
+    this->tryReclaimLayouts();
+    epoch::Domain::Guard guard(&this->readers);
+    return this->layout.load(std::memory_order_acquire)->bounds;
+}
+
+/**
+ * @brief  范围扫描：按分片顺序扫描，每个分片独占加锁后确认Layout未变；扫描途中边界移动时
+ *         从已输出的最后一个键之后重新路由，不重复也不遗漏
+ * @param  lo 区间下界（含）
+ * @param  hi 区间上界（不含）
+ * @param  fn 形如void(const Key&, const Value&)的回调
+ * @return void
+ */
+template<int order, typename Key, typename Value, typename Compare>
+template<typename Fn>
+void ShardedBPlusTree<order, Key, Value, Compare>::scan(const Key& lo, const Key& hi, Fn&& fn) const
+{
+    epoch::Domain::Guard guard(&this->readers);
+    std::optional<Key> last;
+    for(;;)
+    {
+        Key from = last ? *last : lo;
+        Layout* layout = this->layout.load(std::memory_order_acquire);
+        bool moved = false;
+        for(size_t i = this->shardOf(layout, from); i < this->shards.size(); i++)
+        {
+            if(i > 0 && !this->compare(layout->bounds[i-1], hi))
+            {
+                break;
+            }
+            std::unique_lock<std::shared_mutex> lock(this->shards[i]->latch);
+            if(this->layout.load(std::memory_order_acquire) != layout)
+            {
+                moved = true;
+                break;
+            }
+            for(auto kv : this->shards[i]->tree->range(from, hi))
+            {
+                if(last && !this->compare(*last, kv.first))
+                {
+                    continue;
+                }
+                fn(kv.first, kv.second);
+                last = kv.first;
+            }
+        }
+        if(!moved)
+        {
+            return;
+        }
+    }
+}
+
+/**
+ * @brief  迁移热点：统计上次调用以来各分片的操作数，最热的分片超过平均值的threshold倍时，
+ *         把它靠近较冷相邻分片一侧的部分键迁移过去并移动两者之间的边界。
+ *         迁移量按两者的操作数之差估计，使迁移后两边的负载大致相当；只阻塞这两个分片
+ * @param  threshold 触发迁移的热度倍数
+ * @return long  迁移的键数，0表示不需要迁移
+ */
+template<int order, typename Key, typename Value, typename Compare>
+long ShardedBPlusTree<order, Key, Value, Compare>::rebalance(double threshold)
+{
+    std::lock_guard<std::mutex> guard(this->rebalanceMutex);
+    size_t count = this->shards.size();
+    if(count < 2)
+    {
+        return 0;
+    }
+
+    std::vector<uint64_t> load(count);
+    uint64_t total = 0;
+    size_t hot = 0;
+    for(size_t i = 0; i < count; i++)
+    {
+        load[i] = this->shards[i]->ops.exchange(0, std::memory_order_relaxed);
+        total += load[i];
+        hot = load[i] > load[hot] ? i : hot;
+    }
+    if(total == 0 || load[hot] < threshold * total / count)
+    {
+        return 0;
+    }
+    size_t cold = hot == 0 ? 1 : (hot + 1 == count || load[hot-1] <= load[hot+1] ? hot - 1 : hot + 1);
+
+    // 按分片下标顺序加锁
+    std::unique_lock<std::shared_mutex> first(this->shards[std::min(hot, cold)]->latch);
+    std::unique_lock<std::shared_mutex> second(this->shards[std::max(hot, cold)]->latch);
+    Tree* from = this->shards[hot]->tree;
+    Tree* to = this->shards[cold]->tree;
+    long size = from->size;
+    long moving = static_cast<long>(size * static_cast<double>(load[hot] - load[cold]) / (2 * load[hot]));
+    moving = std::min(moving, size - 1);
+    if(moving <= 0)
+    {
+        return 0;
+    }
+
+    // 迁往左边取最小的moving个键，迁往右边取最大的moving个键；新边界取迁走的键和留下的键之间最短的分隔键
+    std::vector<std::pair<Key,Value>> items;
+    std::vector<Key> keys;
+    items.reserve(moving);
+    keys.reserve(moving);
+    Layout* current = this->layout.load(std::memory_order_relaxed);
+    Layout* next = new Layout(*current);
+    if(cold < hot)
+    {
+        auto it = from->begin();
+        for(long i = 0; i < moving; i++, ++it)
+        {
+            items.emplace_back(it.key(), it.value());
+            keys.push_back(it.key());
+        }
+        next->bounds[cold] = keycompress::Separator<Key,Compare>::between(keys.back(), it.key());
+    }
+    else
+    {
+        auto it = from->rbegin();
+        for(long i = 0; i < moving; i++, ++it)
+        {
+            items.emplace_back((*it).first, (*it).second);
+            keys.push_back((*it).first);
+        }
+        std::reverse(items.begin(), items.end());
+        std::reverse(keys.begin(), keys.end());
+        next->bounds[hot] = keycompress::Separator<Key,Compare>::between((*it).first, keys.front());
+    }
+    to->insertBatch(std::move(items));
+    from->eraseBatch(std::move(keys));
+
+    // 持有两个分片的锁时发布新Layout，之后拿到分片锁的操作都会看到Layout已变化
+    this->layout.store(next, std::memory_order_release);
+    this->retiredLayouts.emplace_back(this->readers.advance(), current);
+    this->reclaimLayouts();
+    return moving;
+}
+
+#endif
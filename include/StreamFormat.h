@@ -0,0 +1,154 @@
+#ifndef STREAMFORMAT_H
+#define STREAMFORMAT_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <istream>
+#include <ostream>
+#include <string>
+#include <vector>
+#include "Crc32c.h"
+
+/**
+ * 序列化的流式分块格式：
+ *   [MAGIC uint32][VERSION uint32]，之后是若干块 [载荷长度 uint32][载荷的CRC32C uint32][载荷]
+ * 除最后一块外每块的载荷都是BLOCK_SIZE字节，载荷长度为0的块表示结束。
+ * 载荷依次拼接成一个字节流，记录可以跨块；写出时只缓存一块，读入时逐块校验，
+ * 因此不需要把整个文件放进内存，截断或损坏在读到那一块时就能发现
+ **/
+namespace streamfmt
+{
+
+constexpr uint32_t MAGIC = 0x53545042; // 小端字节序下为"BPTS"
+constexpr uint32_t VERSION = 1;
+constexpr uint32_t BLOCK_SIZE = 64 << 10;
+constexpr uint32_t FLAG_KEY_DELTA = 1; // 键按keycompress::Delta差分编码
+
+class BlockWriter
+{
+public:
+    explicit BlockWriter(std::ostream& out) : out(out)
+    {
+        uint32_t header[2] = {MAGIC, VERSION};
+        this->out.write(reinterpret_cast<const char*>(header), sizeof(header));
+    }
+
+    // 记录直接追加到缓冲区，追加后调用flush写出已满的块
+    std::string& buffer() { return this->pending; }
+
+    void flush()
+    {
+        if(this->pending.size() < BLOCK_SIZE)
+        {
+            return;
+        }
+        size_t offset = 0;
+        for(; this->pending.size() - offset >= BLOCK_SIZE; offset += BLOCK_SIZE)
+        {
+            this->emit(this->pending.data() + offset, BLOCK_SIZE);
+        }
+        this->pending.erase(0, offset);
+    }
+
+    /**
+     * @brief  写出剩余的数据和结束块
+     * @return bool  输出流是否正常
+     */
+    bool finish()
+    {
+        this->flush();
+        if(!this->pending.empty())
+        {
+            this->emit(this->pending.data(), this->pending.size());
+            this->pending.clear();
+        }
+        this->emit(nullptr, 0);
+        return static_cast<bool>(this->out);
+    }
+
+private:
+    std::ostream& out;
+    std::string pending;
+
+    void emit(const char* data, uint32_t length)
+    {
+        uint32_t frame[2] = {length, crc32c::value(data, length)};
+        this->out.write(reinterpret_cast<const char*>(frame), sizeof(frame));
+        this->out.write(data, length);
+    }
+};
+
+class BlockReader
+{
+public:
+    // MAGIC和VERSION由调用者读取并确认
+    explicit BlockReader(std::istream& in) : in(in), pos(0), ended(false), ok(true) {}
+
+    /**
+     * @brief  从拼接后的载荷中读取n字节，需要时读入并校验下一块
+     * @param  dst 输出
+     * @param  n 字节数
+     * @return bool  块损坏、流被截断或已读到结束块时返回false
+     */
+    bool read(void* dst, size_t n)
+    {
+        char* out = static_cast<char*>(dst);
+        while(n > 0)
+        {
+            if(this->pos == this->block.size() && !this->next())
+            {
+                return false;
+            }
+            size_t chunk = std::min(n, this->block.size() - this->pos);
+            std::memcpy(out, this->block.data() + this->pos, chunk);
+            this->pos += chunk;
+            out += chunk;
+            n -= chunk;
+        }
+        return true;
+    }
+
+    /**
+     * @brief  确认所有载荷都已读完且后面紧跟结束块
+     * @return bool
+     */
+    bool finish()
+    {
+        return this->ok && this->pos == this->block.size() && !this->next() && this->ended;
+    }
+
+private:
+    std::istream& in;
+    std::vector<char> block;
+    size_t pos;
+    bool ended;
+    bool ok;
+
+    bool next()
+    {
+        if(!this->ok || this->ended)
+        {
+            return false;
+        }
+        uint32_t frame[2];
+        if(!this->in.read(reinterpret_cast<char*>(frame), sizeof(frame)) || frame[0] > BLOCK_SIZE)
+        {
+            this->ok = false;
+            return false;
+        }
+        this->block.resize(frame[0]);
+        this->pos = 0;
+        if(!this->in.read(this->block.data(), frame[0]) || crc32c::value(this->block.data(), frame[0]) != frame[1])
+        {
+            this->ok = false;
+            return false;
+        }
+        this->ended = frame[0] == 0;
+        return !this->ended;
+    }
+};
+
+} // namespace streamfmt
+
+#endif
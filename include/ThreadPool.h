@@ -0,0 +1,197 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * 工作窃取线程池：每个工作线程有自己的任务队列，从队尾取自己新拆出的任务（LIFO，缓存友好），
+ * 自己的队列空了再从其他队列的队首窃取较早拆出、通常也较大的任务。非工作线程提交的任务进入公共队列。
+ * parallelFor把区间二分拆成任务，调用者在等待期间也会执行任务，因此可以在任务中嵌套调用
+ **/
+class ThreadPool
+{
+public:
+    explicit ThreadPool(int threads = std::max(1u, std::thread::hardware_concurrency()))
+        : queues(new Queue[threads + 1]), queueCount(threads + 1)
+    {
+        for(int i = 0; i < threads; i++)
+        {
+            this->workers.emplace_back([this, i]() { this->workerLoop(i); });
+        }
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    ~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(this->sleepMutex);
+            this->stopping = true;
+        }
+        this->wake.notify_all();
+        for(std::thread& worker : this->workers)
+        {
+            worker.join();
+        }
+    }
+
+    // 工作线程数，调用parallelFor的线程也会参与执行
+    int size() const { return this->workers.size(); }
+
+    /**
+     * @brief  对[begin, end)中的每个下标并行调用fn(i)，返回时全部调用已完成
+     * @param  begin 起始下标
+     * @param  end 结束下标（不含）
+     * @param  grain 不再拆分的区间长度
+     * @param  fn 形如void(size_t)的回调，须可并发调用
+     * @return void
+     */
+    template<typename Fn>
+    void parallelFor(size_t begin, size_t end, size_t grain, Fn&& fn)
+    {
+        if(begin >= end)
+        {
+            return;
+        }
+        grain = std::max<size_t>(grain, 1);
+        std::atomic<size_t> remaining{end - begin};
+        std::function<void(size_t, size_t)> run = [&](size_t lo, size_t hi)
+        {
+            // 右半边交给其他线程窃取，自己继续拆左半边
+            while(hi - lo > grain)
+            {
+                size_t mid = lo + (hi - lo) / 2;
+                this->push([&run, mid, hi]() { run(mid, hi); });
+                hi = mid;
+            }
+            for(size_t i = lo; i < hi; i++)
+            {
+                fn(i);
+            }
+            remaining.fetch_sub(hi - lo, std::memory_order_acq_rel);
+        };
+        run(begin, end);
+        while(remaining.load(std::memory_order_acquire) != 0)
+        {
+            if(!this->runOne())
+            {
+                std::this_thread::yield();
+            }
+        }
+    }
+
+private:
+    struct alignas(64) Queue
+    {
+        std::mutex mutex;
+        std::deque<std::function<void()>> tasks;
+    };
+
+    std::vector<std::thread> workers;
+    std::unique_ptr<Queue[]> queues; // 下标workers.size()为非工作线程提交任务的公共队列
+    int queueCount;
+    std::atomic<long> queued{0};
+    std::mutex sleepMutex;
+    std::condition_variable wake;
+    bool stopping = false;
+
+    // 当前线程在本线程池中的工作线程下标，非工作线程为-1
+    int self() const
+    {
+        return current() == this ? index() : -1;
+    }
+
+    static const ThreadPool*& current()
+    {
+        static thread_local const ThreadPool* pool = nullptr;
+        return pool;
+    }
+
+    static int& index()
+    {
+        static thread_local int idx = -1;
+        return idx;
+    }
+
+    void push(std::function<void()> task)
+    {
+        int idx = this->self();
+        Queue& queue = this->queues[idx >= 0 ? idx : this->queueCount - 1];
+        {
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            queue.tasks.push_back(std::move(task));
+        }
+        this->queued.fetch_add(1, std::memory_order_release);
+        {
+            std::lock_guard<std::mutex> lock(this->sleepMutex);
+        }
+        this->wake.notify_one();
+    }
+
+    /**
+     * @brief  取出并执行一个任务：先取自己队列的队尾，再依次窃取其他队列的队首
+     * @return bool  是否执行了任务
+     */
+    bool runOne()
+    {
+        int idx = this->self();
+        int start = idx >= 0 ? idx : this->queueCount - 1;
+        for(int k = 0; k < this->queueCount; k++)
+        {
+            Queue& queue = this->queues[(start + k) % this->queueCount];
+            std::function<void()> task;
+            {
+                std::lock_guard<std::mutex> lock(queue.mutex);
+                if(queue.tasks.empty())
+                {
+                    continue;
+                }
+                if(k == 0)
+                {
+                    task = std::move(queue.tasks.back());
+                    queue.tasks.pop_back();
+                }
+                else
+                {
+                    task = std::move(queue.tasks.front());
+                    queue.tasks.pop_front();
+                }
+            }
+            this->queued.fetch_sub(1, std::memory_order_relaxed);
+            task();
+            return true;
+        }
+        return false;
+    }
+
+    void workerLoop(int idx)
+    {
+        current() = this;
+        index() = idx;
+        for(;;)
+        {
+            if(this->runOne())
+            {
+                continue;
+            }
+            std::unique_lock<std::mutex> lock(this->sleepMutex);
+            this->wake.wait(lock, [this]() { return this->stopping || this->queued.load(std::memory_order_acquire) > 0; });
+            if(this->stopping)
+            {
+                return;
+            }
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,176 @@
+#ifndef TREESTATS_H
+#define TREESTATS_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <sstream>
+#include <string>
+#include <vector>
+
+/**
+ * 树的运行统计。结构信息（高度、每层节点数、填充率直方图、内存占用）由BPlusTree::stats()遍历树得到；
+ * 热路径上的事件（分裂、合并、借位、乐观读重试、smoMutex争用等）只在编译时定义BPLUSTREE_STATS后计数，
+ * 未定义时计数器是空结构，计数调用内联为空操作。快照可导出为JSON或Prometheus文本格式
+ **/
+namespace treestats
+{
+
+#ifdef BPLUSTREE_STATS
+constexpr bool ENABLED = true;
+#else
+constexpr bool ENABLED = false;
+#endif
+
+enum Event
+{
+    LEAF_SPLIT,
+    INNER_SPLIT,
+    ROOT_SPLIT, // 树长高一层
+    LEAF_MERGE,
+    INNER_MERGE,
+    LEAF_BORROW,
+    INNER_BORROW,
+    ROOT_COLLAPSE, // 树降低一层
+    OPTIMISTIC_RESTART, // 乐观下降或升级写锁时发现版本变化而重试
+    SMO_WAIT, // 结构修改时smoMutex已被其他线程持有
+    APPEND_FAST_PATH, // 顺序追加直接写入最右叶子
+    EVENT_COUNT
+};
+
+inline const char* eventName(int event)
+{
+    static const char* const NAMES[EVENT_COUNT] = {
+        "leaf_split", "inner_split", "root_split", "leaf_merge", "inner_merge", "leaf_borrow",
+        "inner_borrow", "root_collapse", "optimistic_restart", "smo_wait", "append_fast_path"
+    };
+    return NAMES[event];
+}
+
+template<bool Enabled>
+struct Counters
+{
+    std::atomic<uint64_t> values[EVENT_COUNT] = {};
+
+    inline void add(Event event) noexcept { this->values[event].fetch_add(1, std::memory_order_relaxed); }
+    inline uint64_t get(int event) const noexcept { return this->values[event].load(std::memory_order_relaxed); }
+};
+
+template<>
+struct Counters<false>
+{
+    inline void add(Event) noexcept {}
+    inline uint64_t get(int) const noexcept { return 0; }
+};
+
+// 填充率直方图的桶数，第i个桶为(i/10, (i+1)/10]，第0个桶也包含空节点
+constexpr int FILL_BUCKETS = 10;
+
+struct Snapshot
+{
+    bool countersEnabled = ENABLED;
+    long size = 0; // 键值对个数
+    int height = 0;
+    std::vector<long> nodesPerLevel; // 下标0为根结点所在层
+    long leafNodes = 0;
+    long innerNodes = 0;
+    long retiredNodes = 0; // 已摘除、尚未释放的节点
+    uint64_t leafFill[FILL_BUCKETS] = {};
+    uint64_t innerFill[FILL_BUCKETS] = {};
+    double leafFillSum = 0; // 各叶子填充率之和，用于求平均值
+    double innerFillSum = 0;
+    uint64_t events[EVENT_COUNT] = {};
+    std::size_t memoryBytes = 0; // 节点本身和槽页叶子的堆占用的字节数，不含键值对象另行分配的堆内存
+
+    std::string toJson() const;
+    std::string toPrometheus(const std::string& prefix = "bplustree") const;
+};
+
+// 节点的键数为n、最多maxKeys个键时所在的填充率桶
+inline int fillBucket(int n, int maxKeys)
+{
+    int bucket = (n * FILL_BUCKETS + maxKeys - 1) / maxKeys - 1;
+    return bucket < 0 ? 0 : (bucket >= FILL_BUCKETS ? FILL_BUCKETS - 1 : bucket);
+}
+
+inline std::string Snapshot::toJson() const
+{
+    std::ostringstream out;
+    auto array = [&out](const char* name, const auto* begin, std::size_t count)
+    {
+        out << "\"" << name << "\":[";
+        for(std::size_t i = 0; i < count; i++)
+        {
+            out << (i ? "," : "") << begin[i];
+        }
+        out << "],";
+    };
+
+    out << "{\"counters_enabled\":" << (this->countersEnabled ? "true" : "false") << ",";
+    out << "\"size\":" << this->size << ",\"height\":" << this->height << ",";
+    array("nodes_per_level", this->nodesPerLevel.data(), this->nodesPerLevel.size());
+    out << "\"leaf_nodes\":" << this->leafNodes << ",\"inner_nodes\":" << this->innerNodes
+        << ",\"retired_nodes\":" << this->retiredNodes << ",";
+    array("leaf_fill_histogram", this->leafFill, FILL_BUCKETS);
+    array("inner_fill_histogram", this->innerFill, FILL_BUCKETS);
+    out << "\"events\":{";
+    for(int i = 0; i < EVENT_COUNT; i++)
+    {
+        out << (i ? "," : "") << "\"" << eventName(i) << "\":" << this->events[i];
+    }
+    out << "},\"memory_bytes\":" << this->memoryBytes << "}";
+    return out.str();
+}
+
+inline std::string Snapshot::toPrometheus(const std::string& prefix) const
+{
+    std::ostringstream out;
+    auto gauge = [&](const std::string& name, const char* help, auto value)
+    {
+        out << "# HELP " << prefix << "_" << name << " " << help << "\n";
+        out << "# TYPE " << prefix << "_" << name << " gauge\n";
+        out << prefix << "_" << name << " " << value << "\n";
+    };
+    auto histogram = [&](const std::string& name, const char* help, const uint64_t* buckets, double sum)
+    {
+        std::string metric = prefix + "_" + name;
+        out << "# HELP " << metric << " " << help << "\n";
+        out << "# TYPE " << metric << " histogram\n";
+        uint64_t cumulative = 0;
+        for(int i = 0; i < FILL_BUCKETS; i++)
+        {
+            cumulative += buckets[i];
+            out << metric << "_bucket{le=\"" << (i + 1) / static_cast<double>(FILL_BUCKETS) << "\"} " << cumulative << "\n";
+        }
+        out << metric << "_bucket{le=\"+Inf\"} " << cumulative << "\n";
+        out << metric << "_sum " << sum << "\n";
+        out << metric << "_count " << cumulative << "\n";
+    };
+
+    gauge("keys", "Number of key-value pairs.", this->size);
+    gauge("height", "Number of levels from the root to the leaves.", this->height);
+    out << "# HELP " << prefix << "_nodes Number of nodes on each level, level 0 is the root.\n";
+    out << "# TYPE " << prefix << "_nodes gauge\n";
+    for(std::size_t level = 0; level < this->nodesPerLevel.size(); level++)
+    {
+        out << prefix << "_nodes{level=\"" << level << "\"} " << this->nodesPerLevel[level] << "\n";
+    }
+    gauge("retired_nodes", "Nodes unlinked from the tree but not yet freed.", this->retiredNodes);
+    gauge("memory_bytes", "Bytes held by nodes and slotted leaf heaps, excluding heap memory owned by key and value objects.", this->memoryBytes);
+    histogram("leaf_fill_ratio", "Leaf node fill ratio.", this->leafFill, this->leafFillSum);
+    histogram("inner_fill_ratio", "Inner node fill ratio.", this->innerFill, this->innerFillSum);
+    if(this->countersEnabled)
+    {
+        out << "# HELP " << prefix << "_events_total Structural and concurrency events since the tree was created.\n";
+        out << "# TYPE " << prefix << "_events_total counter\n";
+        for(int i = 0; i < EVENT_COUNT; i++)
+        {
+            out << prefix << "_events_total{event=\"" << eventName(i) << "\"} " << this->events[i] << "\n";
+        }
+    }
+    return out.str();
+}
+
+} // namespace treestats
+
+#endif
@@ -0,0 +1,227 @@
+#ifndef WRITEAHEADLOG_H
+#define WRITEAHEADLOG_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/**
+ * 只追加的预写日志。每条记录为 [payload长度 uint32][校验和 uint32][类型 uint8][payload]，
+ * 校验和覆盖类型和payload，回放时遇到不完整或校验失败的记录即视为崩溃时写了一半的尾部并截断。
+ * 组提交：append只把记录拷贝进内存缓冲区并分配日志序号，sync时由第一个到达的写者
+ * 把缓冲区整体写入并fdatasync，期间到达的其他写者等待同一次或下一次刷盘，不必各自fsync。
+ * 写入或fdatasync失败后日志进入失败状态：截掉写了一半的尾部，之后所有尚未落盘的sync都返回失败，
+ * 不会有后续的刷盘把丢失的记录算作已落盘；需要重新打开日志
+ **/
+class WriteAheadLog
+{
+public:
+    WriteAheadLog() : fd(-1), fileBytes(0), nextLsn(0), durableLsn(0), flushing(false), failed(false), syncEnabled(true) {}
+
+    WriteAheadLog(const WriteAheadLog&) = delete;
+    WriteAheadLog& operator=(const WriteAheadLog&) = delete;
+
+    ~WriteAheadLog()
+    {
+        if(this->fd >= 0)
+        {
+            ::close(this->fd);
+        }
+    }
+
+    /**
+     * @brief  打开（不存在则创建）日志文件，回放其中所有完整的记录并截掉残缺的尾部
+     * @param  path 日志文件路径
+     * @param  fn 形如void(uint8_t type, const char* payload, uint32_t length)的回放回调
+     * @param  sync false时只写入操作系统缓存、不fdatasync，用于测试或可以容忍丢失的场景
+     * @return int  0表示成功，1表示文件无法打开或截断
+     */
+    template<typename Fn>
+    int open(const std::string& path, Fn&& fn, bool sync = true)
+    {
+        this->syncEnabled = sync;
+        std::vector<char> data;
+        {
+            std::ifstream in(path, std::ios::binary);
+            if(in)
+            {
+                data.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+            }
+        }
+
+        std::size_t offset = 0;
+        while(offset + RECORD_HEADER <= data.size())
+        {
+            uint32_t length, checksum;
+            std::memcpy(&length, data.data() + offset, sizeof(length));
+            std::memcpy(&checksum, data.data() + offset + 4, sizeof(checksum));
+            if(offset + RECORD_HEADER + length > data.size()
+               || checksum != fnv1a(data.data() + offset + 8, length + 1))
+            {
+                break;
+            }
+            fn(static_cast<uint8_t>(data[offset + 8]), data.data() + offset + RECORD_HEADER, length);
+            offset += RECORD_HEADER + length;
+        }
+
+        this->fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_APPEND, 0644);
+        if(this->fd < 0 || ::ftruncate(this->fd, offset) != 0)
+        {
+            return 1;
+        }
+        this->fileBytes = offset;
+        return 0;
+    }
+
+    /**
+     * @brief  把一条记录追加到内存缓冲区
+     * @param  type 记录类型
+     * @param  payload 记录内容
+     * @param  length 记录内容的字节数
+     * @return uint64_t 记录的日志序号，传给sync等待它落盘；日志已失败时记录被丢弃，sync该序号返回失败
+     */
+    uint64_t append(uint8_t type, const void* payload, uint32_t length)
+    {
+        char header[RECORD_HEADER];
+        std::memcpy(header, &length, sizeof(length));
+        header[8] = static_cast<char>(type);
+
+        std::lock_guard<std::mutex> guard(this->mtx);
+        if(this->failed)
+        {
+            return ++this->nextLsn;
+        }
+        std::size_t start = this->buffer.size();
+        this->buffer.insert(this->buffer.end(), header, header + RECORD_HEADER);
+        this->buffer.insert(this->buffer.end(), static_cast<const char*>(payload), static_cast<const char*>(payload) + length);
+        uint32_t checksum = fnv1a(this->buffer.data() + start + 8, length + 1);
+        std::memcpy(this->buffer.data() + start + 4, &checksum, sizeof(checksum));
+        return ++this->nextLsn;
+    }
+
+    /**
+     * @brief  等待序号不超过lsn的记录全部落盘，没有其他写者在刷盘时由本线程负责写入缓冲区并fdatasync
+     * @param  lsn append返回的日志序号
+     * @return int  0表示已落盘，1表示写入或fdatasync失败（本次或之前的刷盘）
+     */
+    int sync(uint64_t lsn)
+    {
+        std::unique_lock<std::mutex> lock(this->mtx);
+        while(this->durableLsn < lsn)
+        {
+            if(this->failed)
+            {
+                return 1;
+            }
+            if(this->flushing)
+            {
+                this->flushed.wait(lock);
+                continue;
+            }
+
+            // 带走当前缓冲区里的所有记录，释放锁后再做IO，其他写者可以继续append
+            this->flushing = true;
+            std::vector<char> batch;
+            batch.swap(this->buffer);
+            uint64_t target = this->nextLsn;
+            lock.unlock();
+
+            bool ok = this->writeAll(batch.data(), batch.size()) && (!this->syncEnabled || ::fdatasync(this->fd) == 0);
+
+            lock.lock();
+            this->flushing = false;
+            this->flushed.notify_all();
+            if(!ok)
+            {
+                // 这一批记录可能只写入了一部分，截掉它们，等待这一批的其他写者醒来后也返回失败
+                this->failed = true;
+                this->buffer.clear();
+                if(::ftruncate(this->fd, this->fileBytes) != 0)
+                {
+                    // 截断也失败时残缺的记录留在尾部，回放时在那里停止，之前的记录不受影响
+                }
+                return 1;
+            }
+            this->fileBytes += batch.size();
+            this->durableLsn = target;
+        }
+        return 0;
+    }
+
+    /**
+     * @brief  检查点完成后清空日志（调用方保证期间没有并发的append和sync）
+     * @return int  0表示成功，1表示截断失败
+     */
+    int truncate()
+    {
+        std::lock_guard<std::mutex> guard(this->mtx);
+        this->buffer.clear();
+        this->durableLsn = this->nextLsn;
+        this->fileBytes = 0;
+        return ::ftruncate(this->fd, 0) == 0 && (!this->syncEnabled || ::fdatasync(this->fd) == 0) ? 0 : 1;
+    }
+
+    // 是否因写入失败而不再接受记录
+    bool hasFailed()
+    {
+        std::lock_guard<std::mutex> guard(this->mtx);
+        return this->failed;
+    }
+
+    // 已写入日志文件的字节数
+    std::size_t bytes()
+    {
+        std::lock_guard<std::mutex> guard(this->mtx);
+        return this->fileBytes;
+    }
+
+private:
+    static constexpr std::size_t RECORD_HEADER = 9;
+
+    int fd;
+    std::size_t fileBytes;
+    std::mutex mtx; // 保护以下成员
+    std::condition_variable flushed;
+    std::vector<char> buffer; // 尚未写入文件的记录
+    uint64_t nextLsn; // 最后一条已分配的日志序号
+    uint64_t durableLsn; // 已落盘的最大日志序号
+    bool flushing; // 是否有写者正在刷盘
+    bool failed; // 刷盘失败后置位，不再恢复
+    bool syncEnabled;
+
+    bool writeAll(const char* data, std::size_t length)
+    {
+        while(length > 0)
+        {
+            ssize_t written = ::write(this->fd, data, length);
+            if(written < 0)
+            {
+                return false;
+            }
+            data += written;
+            length -= written;
+        }
+        return true;
+    }
+
+    static uint32_t fnv1a(const char* data, std::size_t length)
+    {
+        uint32_t hash = 2166136261u;
+        for(std::size_t i = 0; i < length; i++)
+        {
+            hash ^= static_cast<uint8_t>(data[i]);
+            hash *= 16777619u;
+        }
+        return hash;
+    }
+};
+
+#endif
@@ -1,14 +1,25 @@
 #include "../include/BPlusTree.h"
+#include "../include/MappedBPlusTree.h"
+#include "../include/DurableBPlusTree.h"
+#include "../include/PagedBPlusTree.h"
+#include "../include/ShardedBPlusTree.h"
+#include "../include/NodeOrder.h"
 #include <chrono>
+#include <csignal>
 #include <random>
+#include <sstream>
 #include <vector>
 #include <iostream>
+#include <thread>
+#include <sys/resource.h>
+#include <atomic>
 
 
 // B+树插入性能测试
 void pref_test()
 {
-   constexpr int ORDER = 10;
+   // 阶数按键值大小推导，节点占8个缓存行
+   constexpr int ORDER = nodeorder::CacheLineSized<8>::order<int, int>();
    constexpr long N = 10000000;  // 一千万条数据  
 
     BPlusTree<ORDER, int, int> tree;
@@ -47,6 +58,134 @@ void pref_test()
     std::cout << "Insertion completed in "
               << std::chrono::duration_cast<std::chrono::milliseconds>(insert_end - start_time).count()
               << " ms\n";
+
+    // 同样的乱序数据按批插入，每批排序后共享路径
+    constexpr long BATCH = 4096;
+    BPlusTree<ORDER, int, int> batchTree;
+    auto batch_start = std::chrono::steady_clock::now();
+    for (long i = 0; i < N; i += BATCH)
+    {
+        std::vector<std::pair<int, int>> batch;
+        for (long j = i; j < std::min(i + BATCH, N); ++j)
+        {
+            batch.emplace_back(keys[j], values[j]);
+        }
+        batchTree.insertBatch(std::move(batch));
+    }
+    auto batch_end = std::chrono::steady_clock::now();
+    std::cout << "Batched insertion completed in "
+              << std::chrono::duration_cast<std::chrono::milliseconds>(batch_end - batch_start).count()
+              << " ms\n";
+    assert(batchTree.size == N && batchTree.get(keys[0]) == keys[0]);
+
+    // 每批是一段连续的键（批内乱序、批的顺序随机）：同一批的键集中在少数叶子，批量插入共享下降和加锁，
+    // 装满的叶子在插入位置分裂，分裂出的叶子接近装满；
+    // 均匀随机的键几乎各落一个叶子，上面两种插入的耗时相当
+    std::vector<long> batchOrder((N + BATCH - 1) / BATCH);
+    std::iota(batchOrder.begin(), batchOrder.end(), 0);
+    std::shuffle(batchOrder.begin(), batchOrder.end(), std::mt19937{});
+    std::vector<std::vector<std::pair<int, int>>> clustered;
+    for (long b : batchOrder)
+    {
+        std::vector<std::pair<int, int>> batch;
+        for (long key = b * BATCH; key < std::min((b + 1) * BATCH, N); ++key)
+        {
+            batch.emplace_back(key, key);
+        }
+        std::shuffle(batch.begin(), batch.end(), std::mt19937{static_cast<unsigned>(b)});
+        clustered.push_back(std::move(batch));
+    }
+    BPlusTree<ORDER, int, int> clusteredTree;
+    auto clustered_start = std::chrono::steady_clock::now();
+    for (const auto& batch : clustered)
+    {
+        for (const auto& kv : batch)
+        {
+            clusteredTree.insert(kv.first, kv.second);
+        }
+    }
+    auto clustered_end = std::chrono::steady_clock::now();
+    BPlusTree<ORDER, int, int> clusteredBatchTree;
+    for (auto& batch : clustered)
+    {
+        clusteredBatchTree.insertBatch(std::move(batch));
+    }
+    auto clustered_batch_end = std::chrono::steady_clock::now();
+    std::cout << "Clustered insertion completed in "
+              << std::chrono::duration_cast<std::chrono::milliseconds>(clustered_end - clustered_start).count()
+              << " ms, batched in "
+              << std::chrono::duration_cast<std::chrono::milliseconds>(clustered_batch_end - clustered_end).count()
+              << " ms\n";
+    assert(clusteredTree.size == N && clusteredBatchTree.size == N && clusteredBatchTree.get(N - 1) == N - 1);
+    auto clusteredStats = clusteredBatchTree.stats();
+    assert(clusteredStats.leafFillSum / clusteredStats.leafNodes >= 0.85);
+
+    // 有序数据批量构建
+    std::vector<std::pair<int, int>> sorted(N);
+    for (long i = 0; i < N; ++i)
+    {
+        sorted[i] = {static_cast<int>(i), static_cast<int>(i)};
+    }
+
+    BPlusTree<ORDER, int, int> bulkTree;
+    auto bulk_start = std::chrono::steady_clock::now();
+    assert(bulkTree.bulkLoad(sorted.begin(), sorted.end(), 0.9) == 0);
+    auto bulk_end = std::chrono::steady_clock::now();
+    std::cout << "Bulk load of " << N << " sorted pairs completed in "
+              << std::chrono::duration_cast<std::chrono::milliseconds>(bulk_end - bulk_start).count()
+              << " ms\n";
+    assert(bulkTree.get(0) == 0 && bulkTree.get(N - 1) == N - 1 && !bulkTree.contains(N));
+
+    // 同样的数据用线程池并行构建，再并行归约求和、并行遍历计数
+    ThreadPool pool;
+    BPlusTree<ORDER, int, int> parallelTree;
+    auto parallel_start = std::chrono::steady_clock::now();
+    assert(parallelTree.bulkLoad(sorted.begin(), sorted.end(), pool, 0.9) == 0);
+    auto parallel_end = std::chrono::steady_clock::now();
+    std::cout << "Parallel bulk load with " << pool.size() << " workers completed in "
+              << std::chrono::duration_cast<std::chrono::milliseconds>(parallel_end - parallel_start).count()
+              << " ms\n";
+    assert(parallelTree.size == N && parallelTree.get(N / 3) == N / 3 && !parallelTree.contains(-1));
+    long sum = parallelTree.parallelReduce(pool, 0L,
+        [](long acc, const int& key, const int& value) { return acc + key + value; },
+        [](long a, long b) { return a + b; });
+    assert(sum == N * (N - 1));
+    std::atomic<long> visited{0};
+    bulkTree.parallelForEach(pool, [&visited](const int&, const int&) { visited.fetch_add(1, std::memory_order_relaxed); });
+    assert(visited == N);
+
+    // 递增键逐个插入：直接追加到最右叶子，分裂时左叶子保持接近装满
+    BPlusTree<ORDER, int, int> appendTree;
+    auto append_start = std::chrono::steady_clock::now();
+    for (long i = 0; i < N; ++i)
+    {
+        appendTree.insert(i, i);
+    }
+    auto append_end = std::chrono::steady_clock::now();
+    std::cout << "Sequential insertion of " << N << " keys completed in "
+              << std::chrono::duration_cast<std::chrono::milliseconds>(append_end - append_start).count()
+              << " ms\n";
+    assert(appendTree.size == N && appendTree.get(N / 2) == N / 2);
+    auto sequentialStats = appendTree.stats();
+    assert(sequentialStats.leafFillSum / sequentialStats.leafNodes >= 0.85);
+
+    // 拆除：逐个释放节点，以及使用arena分配器时整块丢弃
+    auto clear_start = std::chrono::steady_clock::now();
+    appendTree.clear();
+    auto clear_end = std::chrono::steady_clock::now();
+    std::cout << "Teardown of " << N << " keys completed in "
+              << std::chrono::duration_cast<std::chrono::milliseconds>(clear_end - clear_start).count()
+              << " ms\n";
+    assert(appendTree.size == 0 && appendTree.begin() == appendTree.end() && !appendTree.contains(0));
+    BPlusTree<ORDER, int, int, std::less<int>, ArenaAllocator> arenaTree;
+    assert(arenaTree.bulkLoad(sorted.begin(), sorted.end()) == 0);
+    auto drop_start = std::chrono::steady_clock::now();
+    arenaTree.clear();
+    auto drop_end = std::chrono::steady_clock::now();
+    std::cout << "Arena teardown of " << N << " keys completed in "
+              << std::chrono::duration_cast<std::chrono::microseconds>(drop_end - drop_start).count()
+              << " us\n";
+    assert(arenaTree.size == 0 && arenaTree.insert(1, 1) == 0 && arenaTree.get(1) == 1);
 }
 
 // 功能测试
@@ -74,6 +213,12 @@ void func_test()
     std::cout << "层序遍历：" << std::endl;
     tree->levelOrderTraversal();
 
+    // 查找测试
+    assert(tree->find(15) && *tree->find(15) == "value_15");
+    assert(!tree->find(16));
+    assert(tree->get(30).value() == "value_30");
+    assert(!tree->get(1).has_value());
+    assert(tree->contains(5) && !tree->contains(100));
 
     // 删除测试
     assert(tree->remove(5) == 0);  // 成功删除
@@ -83,6 +228,208 @@ void func_test()
 
     std::cout << "删除键5和18后，叶子层遍历：" << std::endl;
     tree->leafTraversal(); // 观察是否仍有序
+    assert(!tree->contains(5) && !tree->contains(18) && tree->contains(10));
+
+    // 64位整数键和浮点键使用向量化的节点内查找
+    BPlusTree<16, long long, int> wideTree;
+    BPlusTree<16, float, int> floatTree;
+    for (int i = 0; i < 1000; ++i)
+    {
+        assert(wideTree.insert(i * 3LL, i) == 0);
+        assert(floatTree.insert(i * 0.5f, i) == 0);
+    }
+    for (int i = 0; i < 3000; ++i)
+    {
+        assert(wideTree.contains(i) == (i % 3 == 0));
+        assert(floatTree.get(i * 0.25f).has_value() == (i % 2 == 0 && i < 2000));
+    }
+
+    // 变长的键和值按槽页存放在叶子自己的堆中：覆盖为更长的值、删除留下的空洞整理后，读到的键值不变
+    using SlottedTree = BPlusTree<8, std::string, std::string>;
+    static_assert(SlottedTree::SLOTTED_LEAVES && !BPlusTree<8, int, int>::SLOTTED_LEAVES);
+    SlottedTree slottedTree;
+    for (int i = 0; i < 500; ++i)
+    {
+        assert(slottedTree.insert("key-" + std::to_string(i), std::string(i % 50, 'x')) == 0);
+    }
+    for (int i = 0; i < 500; ++i)
+    {
+        if (i % 3 == 0) assert(slottedTree.remove("key-" + std::to_string(i)) == 0);
+        else if (i % 2 == 0) assert(slottedTree.insert("key-" + std::to_string(i), std::string(i % 50 + 20, 'y')) == 1);
+    }
+    for (int i = 0; i < 500; ++i)
+    {
+        std::optional<std::string> value = slottedTree.find("key-" + std::to_string(i));
+        assert(i % 3 == 0 ? !value : *value == std::string(i % 2 == 0 ? i % 50 + 20 : i % 50, i % 2 == 0 ? 'y' : 'x'));
+    }
+    std::string previous;
+    for (auto it = slottedTree.begin(); it != slottedTree.end(); ++it)
+    {
+        assert(previous < it.key() && it.value() == *slottedTree.get(it.key()));
+        previous = it.key();
+    }
+
+    // 叶子内键的公共前缀只存一份：200字节的公共前缀不随键数增长；插入不带前缀的键时前缀缩短，查找和顺序不变
+    SlottedTree prefixTree;
+    const std::string longPrefix(200, 'p');
+    for (int i = 0; i < 1000; ++i)
+    {
+        assert(prefixTree.insert(longPrefix + std::to_string(i), "") == 0);
+    }
+    assert(prefixTree.stats().memoryBytes < 1000 * longPrefix.size());
+    assert(prefixTree.insert("p", "short") == 0 && prefixTree.insert("q", "after") == 0 && prefixTree.insert(longPrefix, "") == 0);
+    assert(*prefixTree.find("p") == "short" && prefixTree.contains(longPrefix + "999") && !prefixTree.contains(longPrefix + "1000"));
+    assert(prefixTree.begin().key() == "p" && (*prefixTree.rbegin()).first == "q" && std::next(prefixTree.begin()).key() == longPrefix);
+
+    // 自定义分配器：节点直接走operator new/delete
+    BPlusTree<4, int, std::string, std::less<int>, NewDeleteAllocator> heapTree;
+    for (int i = 0; i < 500; ++i)
+    {
+        assert(heapTree.insert(i, std::to_string(i)) == 0);
+    }
+    for (int i = 0; i < 500; i += 2)
+    {
+        assert(heapTree.remove(i) == 0);
+    }
+    assert(heapTree.size == 250 && *heapTree.find(251) == "251" && !heapTree.contains(250));
+
+    // 批量插入、查找和删除，结果按输入顺序返回
+    assert(heapTree.insertBatch({{1000, "a"}, {251, "b"}, {999, "c"}, {1000, "d"}}) == 2);
+    auto found = heapTree.findBatch({1000, 250, 251, 999});
+    assert(*found[0] == "d" && !found[1] && *found[2] == "b" && *found[3] == "c");
+    assert(heapTree.eraseBatch({999, 1000, 1000, 250}) == 2 && heapTree.size == 250);
+
+    // 一批连续的键落进已满叶子的空隙：在插入位置分裂，空隙两侧的叶子都不低于下溢出界限；含负数键时基数排序仍然有序
+    BPlusTree<10, int, int> gapTree;
+    for (int i = 0; i < 200; ++i)
+    {
+        assert(gapTree.insert(i * 1000, i) == 0);
+    }
+    std::vector<std::pair<int, int>> gapBatch;
+    for (int key = -500; key < 3000; ++key)
+    {
+        if (key % 1000 != 0)
+        {
+            gapBatch.emplace_back(key, -key);
+        }
+    }
+    std::shuffle(gapBatch.begin(), gapBatch.end(), std::mt19937{5});
+    gapBatch.emplace_back(1500, 7);
+    assert(gapTree.insertBatch(gapBatch) == 3500 - 3);
+    assert(gapTree.size == 200 + 3500 - 3 && gapTree.get(1500) == 7 && gapTree.get(-1) == 1 && gapTree.get(2999) == -2999);
+    int previousKey = std::numeric_limits<int>::min();
+    for (auto kv : gapTree)
+    {
+        assert(kv.first > previousKey);
+        previousKey = kv.first;
+    }
+    auto gapStats = gapTree.stats();
+    assert(gapStats.leafFill[0] + gapStats.leafFill[1] + gapStats.leafFill[2] + gapStats.leafFill[3] <= 1);
+    heapTree.clear();
+    assert(heapTree.size == 0 && heapTree.begin() == heapTree.end());
+    assert(heapTree.insert(7, "7") == 0 && *heapTree.find(7) == "7");
+
+    // 按页大小推导阶数：两种节点都不超过预算，阶数再加一则至少有一种超过
+    using PagePolicy = nodeorder::PageSized<4096>;
+    constexpr int PAGE_ORDER = PagePolicy::order<long long, std::string>();
+    static_assert(BPlusTree<PAGE_ORDER, long long, std::string>::LEAF_BYTES <= 4096 && BPlusTree<PAGE_ORDER, long long, std::string>::INNER_BYTES <= 4096);
+    static_assert(BPlusTree<PAGE_ORDER + 1, long long, std::string>::LEAF_BYTES > 4096 || BPlusTree<PAGE_ORDER + 1, long long, std::string>::INNER_BYTES > 4096);
+    TunedBPlusTree<PagePolicy, long long, std::string> pageTree;
+    for (long long i = 0; i < 3000; ++i)
+    {
+        assert(pageTree.insert(i * 3, std::to_string(i)) == 0);
+    }
+    for (long long i = 0; i < 3000; i += 2)
+    {
+        assert(pageTree.remove(i * 3) == 0);
+    }
+    assert(pageTree.size == 1500 && *pageTree.find(3 * 2999) == "2999" && !pageTree.contains(0));
+
+    // 共享长前缀的字符串键：分隔键截断到第一个不同的字符
+    using StringSeparator = keycompress::Separator<std::string, std::less<std::string>>;
+    assert(StringSeparator::between("tenant-7/orders/0041", "tenant-7/users/0001") == "tenant-7/u");
+    assert(StringSeparator::between("tenant-7/orders", "tenant-7/orders/0001") == "tenant-7/orders/");
+    BPlusTree<5, std::string, int> stringTree;
+    auto stringKey = [](int i) { return "tenant-" + std::to_string(i % 7) + "/table-orders/id-" + std::to_string(100000 + i); };
+    for (int i = 0; i < 2000; ++i)
+    {
+        assert(stringTree.insert(stringKey(i), i) == 0);
+    }
+    for (int i = 0; i < 2000; i += 3)
+    {
+        assert(stringTree.remove(stringKey(i)) == 0);
+    }
+    for (int i = 0; i < 2000; ++i)
+    {
+        assert(stringTree.contains(stringKey(i)) == (i % 3 != 0));
+    }
+    std::string last;
+    for (auto kv : stringTree)
+    {
+        assert(last < kv.first);
+        last = kv.first;
+    }
+
+    // 延迟合并：删除只让叶子变稀疏，compact时再统一借位、合并
+    BPlusTree<8, int, int> lazyTree;
+    lazyTree.setLazyRemove(true);
+    for (int i = 0; i < 2000; ++i)
+    {
+        assert(lazyTree.insert(i, i) == 0);
+    }
+    for (int i = 0; i < 2000; ++i)
+    {
+        if (i % 10 != 0)
+        {
+            assert(lazyTree.remove(i) == 0);
+        }
+    }
+    assert(lazyTree.size == 200 && lazyTree.contains(1990) && !lazyTree.contains(1991));
+    assert(lazyTree.compact() > 0 && lazyTree.compact() == 0);
+    int next = 0;
+    for (auto kv : lazyTree)
+    {
+        assert(kv.first == next && kv.second == next);
+        next += 10;
+    }
+    assert(next == 2000);
+
+    // 统计快照：每层节点数、填充率直方图，可导出为JSON和Prometheus文本
+    auto stats = lazyTree.stats();
+    assert(stats.size == 200 && stats.height == static_cast<int>(stats.nodesPerLevel.size()));
+    assert(stats.nodesPerLevel.front() == 1 && stats.nodesPerLevel.back() == stats.leafNodes);
+    assert(stats.memoryBytes > 0 && stats.countersEnabled == treestats::ENABLED);
+    // 没有在场的读者和快照，合并摘除的节点在结构修改结束时已被回收
+    assert(stats.retiredNodes == 0);
+    assert(stats.toJson().find("\"height\":" + std::to_string(stats.height)) != std::string::npos);
+    assert(stats.toPrometheus().find("bplustree_leaf_fill_ratio_count " + std::to_string(stats.leafNodes)) != std::string::npos);
+
+    // 连续追加时偏斜分裂，左叶子装到约90%；追加与删除、中间插入交替时，
+    // 只有最右一条路径上的节点可能暂时低于下溢出界限（阶为10时4个键，落在填充率第4个桶及以上）
+    BPlusTree<10, int, int> appendTree;
+    for (int i = 0; i < 5000; ++i)
+    {
+        assert(appendTree.insert(i, i) == 0);
+    }
+    auto appendStats = appendTree.stats();
+    assert(appendStats.leafFillSum / appendStats.leafNodes >= 0.85);
+    std::mt19937 rng(17);
+    for (int i = 5000; i < 20000; ++i)
+    {
+        assert(appendTree.insert(i, i) == 0);
+        if (rng() % 3 == 0)
+        {
+            appendTree.remove(rng() % i);
+        }
+        if (rng() % 7 == 0)
+        {
+            appendTree.insert(-static_cast<int>(rng() % 100000) - 1, 0);
+        }
+    }
+    appendStats = appendTree.stats();
+    assert(appendStats.leafFill[0] + appendStats.leafFill[1] + appendStats.leafFill[2] + appendStats.leafFill[3] <= 1);
+    assert(appendStats.innerFill[0] + appendStats.innerFill[1] + appendStats.innerFill[2] + appendStats.innerFill[3] <= static_cast<uint64_t>(appendStats.height));
+    delete tree;
 }
 
 void serialize_test()
@@ -99,6 +446,24 @@ void serialize_test()
     }
     btree.leafTraversal();
 
+    // 范围扫描测试
+    int expected = 40;
+    for (auto kv : btree.range(40, 100))
+    {
+        assert(kv.first == expected);
+        expected += 10;
+    }
+    assert(expected == 100);
+    assert(btree.lower_bound(45).key() == 50 && btree.upper_bound(50).key() == 60);
+    assert(btree.upper_bound(200) == btree.end());
+    expected = 200;
+    for (auto it = btree.rbegin(); it != btree.rend(); ++it)
+    {
+        assert((*it).first == expected);
+        expected -= 10;
+    }
+    assert(expected == 0);
+
     // 序列化到文件
     std::ofstream ofs("bPlusTree.dat", std::ios::binary);
     btree.serialize(ofs);
@@ -114,6 +479,522 @@ void serialize_test()
         restored_tree->leafTraversal();
         delete restored_tree;
     }
+
+    // 变长的键和值按槽页编码，std::string的树可以完整往返
+    using StringTree = BPlusTree<4, std::string, std::string>;
+    StringTree stringTree;
+    for (int i = 0; i < 300; ++i)
+    {
+        stringTree.insert("tenant-" + std::to_string(i % 3) + "/id-" + std::to_string(i), std::string(i % 40, 'v'));
+    }
+    std::stringstream buffer;
+    stringTree.serialize(buffer);
+    auto restored_strings = StringTree::deserialize(buffer);
+    assert(restored_strings && restored_strings->size == 300);
+    auto original = stringTree.begin();
+    for (auto kv : *restored_strings)
+    {
+        assert(kv.first == original.key() && kv.second == original.value());
+        ++original;
+    }
+    assert(original == stringTree.end());
+    delete restored_strings;
+
+    std::string truncated = buffer.str();
+    truncated.resize(truncated.size() / 2);
+    std::istringstream partial(truncated);
+    assert(StringTree::deserialize(partial) == nullptr);
+
+    // 分块校验：翻转任意一个字节都能发现；有序的键差分编码后明显变小
+    assert(crc32c::value("123456789", 9) == 0xE3069283);
+    std::string corrupted = buffer.str();
+    corrupted[corrupted.size() / 2] ^= 0x20;
+    std::istringstream damaged(corrupted);
+    assert(StringTree::deserialize(damaged) == nullptr);
+    // 校验和正确但头部声称有INT_MAX个键：读到数据之前不按头部的键数预留内存
+    std::stringstream forged;
+    streamfmt::BlockWriter writer(forged);
+    int32_t forgedOrder = 4;
+    uint32_t forgedFlags = 0;
+    uint64_t forgedTotal = std::numeric_limits<int>::max();
+    writer.buffer().append(reinterpret_cast<const char*>(&forgedOrder), sizeof(forgedOrder));
+    writer.buffer().append(reinterpret_cast<const char*>(&forgedFlags), sizeof(forgedFlags));
+    writer.buffer().append(reinterpret_cast<const char*>(&forgedTotal), sizeof(forgedTotal));
+    assert(writer.finish() && StringTree::deserialize(forged) == nullptr);
+    std::stringstream plain;
+    stringTree.serialize(plain, false);
+    assert(plain.str().size() > buffer.str().size());
+    auto restored_plain = StringTree::deserialize(plain);
+    assert(restored_plain && restored_plain->size == 300 && restored_plain->get("tenant-1/id-7") == std::string(7, 'v'));
+    delete restored_plain;
+
+    // 快照：之后的插入、删除、分裂、合并都不影响快照看到的内容
+    BPlusTree<4, int, int> liveTree;
+    for (int i = 0; i < 1000; ++i)
+    {
+        liveTree.insert(i, i);
+    }
+    auto view = liveTree.snapshot();
+    for (int i = 0; i < 1000; i += 2)
+    {
+        liveTree.remove(i);
+    }
+    for (int i = 1; i < 3000; i += 2)
+    {
+        liveTree.insert(i, -i);
+    }
+    assert(view->size() == 1000 && liveTree.size == 1500);
+    assert(view->get(500) == 500 && view->get(501) == 501 && !view->get(1001));
+    int seen = 0;
+    view->forEach([&](const int& key, const int& value)
+    {
+        assert(key == seen && value == seen);
+        seen++;
+    });
+    assert(seen == 1000);
+    seen = 100;
+    view->range(100, 200, [&](const int& key, const int&)
+    {
+        assert(key == seen++);
+    });
+    assert(seen == 200);
+    std::stringstream viewBuffer;
+    view->serialize(viewBuffer);
+    delete view;
+    auto restored_view = BPlusTree<4, int, int>::deserialize(viewBuffer);
+    assert(restored_view && restored_view->size == 1000 && restored_view->get(999) == 999);
+    seen = 0;
+    for (auto kv : *restored_view)
+    {
+        assert(kv.first == seen && kv.second == seen);
+        seen++;
+    }
+    assert(seen == 1000);
+    delete restored_view;
+
+    // 写成页文件后直接映射查询，无需反序列化
+    assert(btree.writePages("bPlusTreePages.dat") == 0);
+    auto mapped_tree = MappedBPlusTree<3, int, int>::open("bPlusTreePages.dat");
+    assert(mapped_tree && mapped_tree->size() == 20);
+    assert(mapped_tree->contains(70) && !mapped_tree->contains(75) && mapped_tree->get(200) == 0);
+    expected = 50;
+    for (auto it = mapped_tree->lower_bound(45); it != mapped_tree->end(); ++it)
+    {
+        assert(it.key() == expected);
+        expected += 10;
+    }
+    assert(expected == 210);
+    delete mapped_tree;
+
+    // 根结点的第一个孩子指回根结点：查找左子树的键时拒绝该页而不是死循环
+    using MappedLayout = pagefile::Layout<3, int, int>;
+    std::fstream pages("bPlusTreePages.dat", std::ios::binary | std::ios::in | std::ios::out);
+    uint64_t cycle = 1;
+    pages.seekp(MappedLayout::PAGE_SIZE + offsetof(MappedLayout::InnerPage, children));
+    pages.write(reinterpret_cast<const char*>(&cycle), sizeof(cycle));
+    pages.close();
+    mapped_tree = MappedBPlusTree<3, int, int>::open("bPlusTreePages.dat");
+    assert(mapped_tree && !mapped_tree->contains(10) && mapped_tree->contains(200));
+    delete mapped_tree;
+}
+
+// 并发测试：多个写线程插入、删除互不相交的键，读线程同时查找
+void concurrent_test()
+{
+    constexpr int THREADS = 4;
+    constexpr int PER_THREAD = 100000;
+    BPlusTree<8, int, int> tree;
+
+    std::cout << "=== 并发测试开始 ===" << std::endl;
+
+    std::atomic<bool> done{false};
+    std::thread reader([&tree, &done]()
+    {
+        std::mt19937 gen{42};
+        while (!done)
+        {
+            int key = gen() % (THREADS * PER_THREAD);
+            auto value = tree.get(key);
+            assert(!value || *value == key);
+        }
+    });
+
+    // 每个线程负责 key % THREADS == t 的键，先全部插入再删除其中的偶数轮次
+    std::vector<std::thread> writers;
+    for (int t = 0; t < THREADS; ++t)
+    {
+        writers.emplace_back([&tree, t]()
+        {
+            for (int i = 0; i < PER_THREAD; ++i)
+            {
+                assert(tree.insert(i * THREADS + t, i * THREADS + t) == 0);
+            }
+            for (int i = 0; i < PER_THREAD; i += 2)
+            {
+                assert(tree.remove(i * THREADS + t) == 0);
+            }
+        });
+    }
+    for (auto& writer : writers)
+    {
+        writer.join();
+    }
+    done = true;
+    reader.join();
+
+    assert(tree.size == THREADS * PER_THREAD / 2);
+    for (int key = 0; key < THREADS * PER_THREAD; ++key)
+    {
+        assert(tree.contains(key) == ((key / THREADS) % 2 == 1));
+    }
+    std::cout << "并发插入、删除后剩余 " << tree.size << " 个键" << std::endl;
+
+    // std::string的树不能乐观读取：多个读者加共享锁同时查找，写者插入时读到的值仍然完整
+    BPlusTree<8, int, std::string> stringTree;
+    std::atomic<int> stringReaders{0};
+    std::vector<std::thread> stringThreads;
+    for (int t = 0; t < THREADS; ++t)
+    {
+        stringThreads.emplace_back([&stringTree, &stringReaders, t]()
+        {
+            std::mt19937 gen(t);
+            stringReaders++;
+            while (stringReaders > 0)
+            {
+                int key = gen() % PER_THREAD;
+                auto value = stringTree.get(key);
+                assert(!value || *value == std::to_string(key));
+            }
+        });
+    }
+    for (int key = 0; key < PER_THREAD; ++key)
+    {
+        assert(stringTree.insert(key, std::to_string(key)) == 0);
+    }
+    stringReaders = std::numeric_limits<int>::min();
+    for (auto& thread : stringThreads)
+    {
+        thread.join();
+    }
+    assert(stringTree.size == PER_THREAD && stringTree.get(PER_THREAD / 2) == std::to_string(PER_THREAD / 2));
+}
+
+// 分片测试：写入集中在第一个分片，迁移后边界左移，扫描结果仍然有序且完整
+void sharded_test()
+{
+    constexpr int KEYS = 200000;
+    ShardedBPlusTree<16, int, int> tree({KEYS / 4, KEYS / 2, KEYS / 4 * 3});
+
+    std::cout << "=== 分片测试开始 ===" << std::endl;
+
+    for (int key = KEYS / 4; key < KEYS; ++key)
+    {
+        assert(tree.insert(key, key) == 0);
+    }
+    tree.rebalance();
+
+    // 边界可能先下移、随后又被迁回，因此检查迁移是否发生过，而不是最终的边界位置
+    std::atomic<bool> done{false};
+    long moved = 0;
+    std::thread balancer([&tree, &done, &moved]()
+    {
+        while (!done)
+        {
+            moved += tree.rebalance();
+            std::this_thread::yield();
+        }
+    });
+    std::vector<std::thread> writers;
+    for (int t = 0; t < 4; ++t)
+    {
+        writers.emplace_back([&tree, t]()
+        {
+            for (int key = t; key < KEYS / 4; key += 4)
+            {
+                assert(tree.insert(key, key) == 0);
+                assert(tree.get(key) == key);
+            }
+        });
+    }
+    for (auto& writer : writers)
+    {
+        writer.join();
+    }
+    done = true;
+    balancer.join();
+
+    assert(tree.size() == KEYS && moved > 0);
+    int expected = 0;
+    tree.scan(0, KEYS, [&expected](const int& key, const int& value)
+    {
+        assert(key == expected && value == expected);
+        expected++;
+    });
+    assert(expected == KEYS);
+    assert(tree.remove(KEYS - 1) == 0 && !tree.contains(KEYS - 1));
+    std::cout << "分片边界：";
+    for (int bound : tree.bounds())
+    {
+        std::cout << bound << " ";
+    }
+    std::cout << std::endl;
+}
+
+// 预写日志测试：并发写入后不做检查点直接重新打开，回放日志恢复；检查点后再写入并恢复
+void durable_test()
+{
+    using Durable = DurableBPlusTree<8, int, int>;
+    std::remove("durableTree.ckpt");
+    std::remove("durableTree.wal");
+
+    std::cout << "=== 预写日志测试开始 ===" << std::endl;
+
+    Durable::Options options;
+    options.checkpointBytes = 0;
+    Durable* tree = Durable::open("durableTree", options);
+    assert(tree != nullptr);
+    std::vector<std::thread> writers;
+    for (int t = 0; t < 4; ++t)
+    {
+        writers.emplace_back([tree, t]()
+        {
+            for (int i = t; i < 2000; i += 4)
+            {
+                assert(tree->insert(i, i * 2) == 0);
+            }
+        });
+    }
+    for (auto& writer : writers)
+    {
+        writer.join();
+    }
+    assert(tree->remove(7) == 0 && tree->remove(7) == 1);
+    delete tree;
+
+    tree = Durable::open("durableTree", options);
+    assert(tree->size() == 1999 && tree->get(1998) == 3996 && !tree->contains(7));
+    assert(tree->checkpoint() == 0);
+    assert(tree->insert(5000, 1) == 0 && tree->remove(0) == 0);
+    assert(tree->insert(6000, 3) == 0 && tree->checkpoint() == 0); // 增量检查点只重写少量节点
+    assert(tree->remove(6000) == 0);
+    delete tree;
+
+    // 模拟崩溃时写了一半的日志尾部
+    std::ofstream torn("durableTree.wal", std::ios::binary | std::ios::app);
+    torn.write("\x05\x00\x00", 3);
+    torn.close();
+
+    tree = Durable::open("durableTree", options);
+    assert(tree->size() == 1999 && tree->get(5000) == 1 && !tree->contains(0) && tree->get(1) == 2);
+    delete tree;
+
+    // 节点页没有校验和：关键字个数被破坏的检查点在加载时被拒绝
+    using CheckpointLayout = pagefile::Layout<8, int, int>;
+    std::fstream ckpt("durableTree.ckpt", std::ios::binary | std::ios::in | std::ios::out);
+    ckpt.seekg(0, std::ios::end);
+    uint64_t pageCount = ckpt.tellg() / CheckpointLayout::PAGE_SIZE;
+    int32_t badCount = 0x7fffffff;
+    for (uint64_t id = CheckpointFile::FIRST_PAGE; id < pageCount; ++id)
+    {
+        ckpt.seekp(id * CheckpointLayout::PAGE_SIZE + offsetof(CheckpointLayout::NodePage, n));
+        ckpt.write(reinterpret_cast<const char*>(&badCount), sizeof(badCount));
+    }
+    ckpt.close();
+    assert(Durable::open("durableTree", options) == nullptr);
+    std::remove("durableTree.ckpt");
+    std::remove("durableTree.wal");
+
+    // 限制文件大小使日志写入失败：失败的修改不进入树，之后的写入都失败，重新打开后只有成功落盘的修改
+    tree = Durable::open("durableTree", options);
+    rlimit unlimited;
+    getrlimit(RLIMIT_FSIZE, &unlimited);
+    rlimit limited = unlimited;
+    limited.rlim_cur = 4096;
+    std::signal(SIGXFSZ, SIG_IGN);
+    assert(setrlimit(RLIMIT_FSIZE, &limited) == 0);
+    int accepted = 0;
+    while (accepted < 1000 && tree->insert(accepted, accepted) == 0)
+    {
+        ++accepted;
+    }
+    bool rejected = tree->insert(-1, 0) == -1 && tree->remove(0) == -1;
+    setrlimit(RLIMIT_FSIZE, &unlimited);
+    std::signal(SIGXFSZ, SIG_DFL);
+    assert(accepted > 0 && accepted < 1000 && rejected);
+    assert(tree->size() == accepted && !tree->contains(accepted) && tree->contains(0) && !tree->contains(-1));
+    delete tree;
+    tree = Durable::open("durableTree", options);
+    assert(tree->size() == accepted && tree->get(accepted - 1) == accepted - 1 && !tree->contains(accepted));
+    delete tree;
+    std::remove("durableTree.ckpt");
+    std::remove("durableTree.wal");
+
+    // 校验和正确但长度不符的日志记录被跳过，不会按键值大小越界读取载荷
+    {
+        WriteAheadLog log;
+        assert(log.open("durableTree.wal", [](uint8_t, const char*, uint32_t) {}, false) == 0);
+        char shortRecord = 7;
+        assert(log.sync(log.append(1, &shortRecord, 1)) == 0);
+        assert(log.sync(log.append(2, &shortRecord, 1)) == 0);
+    }
+    tree = Durable::open("durableTree", options);
+    assert(tree && tree->size() == 0);
+    delete tree;
+    std::remove("durableTree.ckpt");
+    std::remove("durableTree.wal");
+
+    // 自动检查点失败：已落盘的修改照常返回成功，失败通过checkpointFailed报告，日志保留记录，重新打开后数据完整
+    Durable::Options eager = options;
+    eager.checkpointBytes = 1;
+    tree = Durable::open("durableTree", eager);
+    for (int i = 0; i < 100; ++i)
+    {
+        assert(tree->insert(i, i) == 0 && !tree->checkpointFailed());
+    }
+    std::ifstream ckptSize("durableTree.ckpt", std::ios::binary | std::ios::ate);
+    limited.rlim_cur = static_cast<rlim_t>(ckptSize.tellg());
+    std::signal(SIGXFSZ, SIG_IGN);
+    assert(setrlimit(RLIMIT_FSIZE, &limited) == 0);
+    int applied = 100;
+    while (applied < 5000 && !tree->checkpointFailed())
+    {
+        assert(tree->insert(applied, applied) == 0);
+        ++applied;
+    }
+    setrlimit(RLIMIT_FSIZE, &unlimited);
+    std::signal(SIGXFSZ, SIG_DFL);
+    assert(applied < 5000 && tree->size() == applied && tree->contains(applied - 1));
+    assert(tree->insert(applied, applied) == 0 && !tree->checkpointFailed());
+    delete tree;
+    tree = Durable::open("durableTree", options);
+    assert(tree && tree->size() == applied + 1 && tree->get(applied) == applied);
+    delete tree;
+    std::remove("durableTree.ckpt");
+    std::remove("durableTree.wal");
+
+    // 检查点写到一半失败：孩子已经换页、自身没能重写的节点留到下一次检查点重写，孩子的旧页随后被复用也不影响加载。
+    // 逐页放宽文件大小上限，让失败落在不同的叶子和非叶子节点上
+    int failedCheckpoints = 0;
+    for (int extra = 0; extra < 40; ++extra)
+    {
+        std::remove("checkpointTree.ckpt");
+        CheckpointFile file;
+        assert(file.open("checkpointTree.ckpt", CheckpointLayout::PAGE_SIZE, false) == 0);
+        BPlusTree<8, int, int> source;
+        for (int i = 0; i < 1000; ++i)
+        {
+            source.insert(i, i);
+        }
+        assert(source.writeCheckpoint(file) == 0);
+        for (int i = 0; i < 1000; ++i)
+        {
+            source.insert(i, i + 1);
+        }
+        std::ifstream probe("checkpointTree.ckpt", std::ios::binary | std::ios::ate);
+        limited.rlim_cur = static_cast<rlim_t>(probe.tellg()) + extra * CheckpointLayout::PAGE_SIZE;
+        std::signal(SIGXFSZ, SIG_IGN);
+        assert(setrlimit(RLIMIT_FSIZE, &limited) == 0);
+        failedCheckpoints += source.writeCheckpoint(file);
+        setrlimit(RLIMIT_FSIZE, &unlimited);
+        std::signal(SIGXFSZ, SIG_DFL);
+        assert(source.writeCheckpoint(file) == 0);
+        for (int i = 0; i < 1000; i += 50)
+        {
+            source.insert(i, i + 2);
+        }
+        assert(source.writeCheckpoint(file) == 0);
+        auto loaded = BPlusTree<8, int, int>::loadCheckpoint(file);
+        assert(loaded && loaded->size == 1000);
+        for (int i = 0; i < 1000; ++i)
+        {
+            assert(loaded->get(i) == i + (i % 50 == 0 ? 2 : 1));
+        }
+        delete loaded;
+    }
+    assert(failedCheckpoints > 0);
+    std::remove("checkpointTree.ckpt");
+}
+
+// 磁盘B+树测试：缓冲池只能容纳一小部分页，关闭后重新打开，并用内存映射只读打开同一文件
+void paged_test()
+{
+    using Paged = PagedBPlusTree<16, int, int>;
+    std::remove("pagedTree.dat");
+
+    std::cout << "=== 缓冲池测试开始 ===" << std::endl;
+
+    Paged* tree = Paged::open("pagedTree.dat", 32);
+    assert(tree != nullptr);
+    std::vector<int> keys(20000);
+    std::iota(keys.begin(), keys.end(), 0);
+    std::shuffle(keys.begin(), keys.end(), std::mt19937{});
+    for (int key : keys)
+    {
+        assert(tree->insert(key, key * 3) == 0);
+    }
+    assert(tree->remove(5) == 0 && tree->remove(5) == 1 && tree->insert(7, 1) == 1);
+    for (int key = 0; key < 20000; ++key)
+    {
+        assert(tree->get(key) == (key == 5 ? std::nullopt : std::optional<int>(key == 7 ? 1 : key * 3)));
+    }
+    std::cout << "缓冲池命中 " << tree->bufferPool().hitCount() << " 次，缺页 " << tree->bufferPool().missCount() << " 次" << std::endl;
+    delete tree;
+
+    tree = Paged::open("pagedTree.dat", 32);
+    assert(tree->size() == 19999 && tree->get(19999) == 59997 && !tree->contains(5));
+    delete tree;
+
+    auto mapped = MappedBPlusTree<16, int, int>::open("pagedTree.dat");
+    assert(mapped && mapped->size() == 19999 && mapped->lower_bound(5).key() == 6);
+    delete mapped;
+
+    // 读者比页帧多：页帧都被pin住时pin等待其他读者unpin，而不是返回无效的页
+    tree = Paged::open("pagedTree.dat", 8);
+    std::atomic<int> found{0};
+    std::vector<std::thread> readers;
+    for (int t = 0; t < 16; ++t)
+    {
+        readers.emplace_back([&, t] {
+            for (int key = t; key < 20000; key += 16)
+            {
+                found += tree->get(key).has_value();
+            }
+        });
+    }
+    for (auto& reader : readers)
+    {
+        reader.join();
+    }
+    assert(found == 19999);
+    delete tree;
+
+    // 限制文件大小使换出的脏页写回失败：插入返回-1；分裂途中失败时树进入失败状态，否则树不受影响
+    std::remove("pagedTree.dat");
+    tree = Paged::open("pagedTree.dat", 8);
+    rlimit unlimited;
+    getrlimit(RLIMIT_FSIZE, &unlimited);
+    rlimit limited = unlimited;
+    limited.rlim_cur = 4096;
+    std::signal(SIGXFSZ, SIG_IGN);
+    assert(setrlimit(RLIMIT_FSIZE, &limited) == 0);
+    int accepted = 0;
+    while (accepted < 20000 && tree->insert(accepted, accepted) == 0)
+    {
+        ++accepted;
+    }
+    setrlimit(RLIMIT_FSIZE, &unlimited);
+    std::signal(SIGXFSZ, SIG_DFL);
+    assert(accepted > 0 && accepted < 20000);
+    if (tree->size() == -1)
+    {
+        assert(tree->insert(accepted, accepted) == -1 && tree->remove(0) == -1 && !tree->contains(0) && tree->flush() == 1);
+    }
+    else
+    {
+        assert(tree->size() == accepted && tree->get(accepted - 1) == accepted - 1 && tree->insert(accepted, accepted) == 0);
+    }
+    delete tree;
+    std::remove("pagedTree.dat");
 }
 
 int main()
@@ -122,6 +1003,10 @@ int main()
     pref_test();// 性能测试
     serialize_test(); // 序列化测试
     func_test();// 功能测试
+    concurrent_test(); // 并发测试
+    sharded_test(); // 分片测试
+    durable_test(); // 预写日志测试
+    paged_test(); // 缓冲池测试
    
     return 0;
 }
\ No newline at end of file